@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core widgets gui opengl
+QT       += core widgets gui opengl concurrent
 CONFIG   += c++11 force_debug_info
 
 
@@ -16,13 +16,64 @@ SOURCES += main.cpp\
         window.cpp \
     ink_layer_glwidget.cpp \
     ink_data.cpp \
-    ink_stroke.cpp
+    ink_stroke.cpp \
+    frame_profiler.cpp \
+    ink_geometry.cpp \
+    pen_recorder.cpp \
+    pen_replayer.cpp \
+    ink_render_thread.cpp \
+    blit_program.cpp \
+    framebuffer_pool.cpp \
+    pixel_readback.cpp \
+    ink_replay.cpp \
+    ink_journal.cpp \
+    ink_autosave.cpp \
+    ink_snapshot.cpp \
+    ink_saver.cpp \
+    ink_selection.cpp \
+    ink_smoothing.cpp \
+    ink_tile_cache.cpp
 
 HEADERS  += window.h \
     ink_layer_glwidget.h \
     ink_data.h \
-    ink_stroke.h
+    ink_stroke.h \
+    frame_profiler.h \
+    ink_geometry.h \
+    binary_codec.h \
+    pen_sample.h \
+    pen_input_queue.h \
+    pen_recorder.h \
+    pen_replayer.h \
+    ink_render_thread.h \
+    blit_program.h \
+    framebuffer_pool.h \
+    pixel_readback.h \
+    ink_replay.h \
+    ink_journal.h \
+    ink_autosave.h \
+    ink_snapshot.h \
+    ink_saver.h \
+    ink_selection.h \
+    ink_smoothing.h \
+    ink_tile_cache.h
 
 FORMS    += window.ui
 
-LIBS += -lopengl32
+win32: LIBS += -lopengl32
+
+# The video recorder (--record-video) needs FFmpeg. It is built when pkg-config finds FFmpeg,
+# with qmake CONFIG+=ffmpeg, or when FFMPEG_DIR points to an install, e.g. qmake FFMPEG_DIR=C:/ffmpeg-dev
+!isEmpty(FFMPEG_DIR)|packagesExist(libavformat libavcodec libavutil): CONFIG += ffmpeg
+
+ffmpeg {
+    DEFINES += HAVE_FFMPEG
+    SOURCES += video_recorder.cpp
+    HEADERS += video_recorder.h
+
+    !isEmpty(FFMPEG_DIR) {
+        INCLUDEPATH += $$FFMPEG_DIR/include
+        LIBS += -L$$FFMPEG_DIR/lib
+    }
+    LIBS += -lavformat -lavcodec -lavutil
+}
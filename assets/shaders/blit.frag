@@ -0,0 +1,12 @@
+#version 150
+
+uniform sampler2D tex0;
+
+in vec2 vTexCoord;
+
+out vec4 oColor;
+
+void main(void)
+{
+	oColor = texture(tex0, vTexCoord);
+}
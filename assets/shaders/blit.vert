@@ -0,0 +1,16 @@
+#version 150
+
+uniform mat4 transform;
+// Texture region to draw: x, y, width, height in texture coordinates.
+uniform vec4 sourceRect;
+
+in vec2 position;
+in vec2 texCoord;
+
+out vec2 vTexCoord;
+
+void main(void)
+{
+	vTexCoord = sourceRect.xy + texCoord * sourceRect.zw;
+	gl_Position = transform * vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,939 @@
+// ink_benchmark.cpp
+//
+// Micro-benchmarks for the ink data model and the geometry hot paths.
+// Runs headless (no window system needed). Machine readable results:
+//
+//   ink_benchmark -o results.xml,xml      QtTest XML, one <BenchmarkResult> per row
+//   ink_benchmark -o results.csv,csv      CSV
+//   ink_benchmark -tickcounter            CPU tick counter instead of wall time
+
+#include <QtTest>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "ink_autosave.h"
+#include "ink_data.h"
+#include "ink_geometry.h"
+#include "ink_journal.h"
+#include "ink_replay.h"
+#include "ink_saver.h"
+#include "ink_selection.h"
+#include "ink_smoothing.h"
+#include "ink_tile_cache.h"
+#include "stroke_generator.h"
+
+class InkBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void addPoint_data();
+    void addPoint();
+
+    void smoothStroke_data();
+    void smoothStroke();
+
+    void boundRect_data();
+    void boundRect();
+
+    void point_data();
+    void point();
+
+    void pointMemory_data();
+    void pointMemory();
+
+    void toJsonString_data();
+    void toJsonString();
+
+    void fromJsonString_data();
+    void fromJsonString();
+
+    void merge_data();
+    void merge();
+
+    void equal_data();
+    void equal();
+
+    void diff_data();
+    void diff();
+
+    void eraseHitTest_data();
+    void eraseHitTest();
+
+    void erasePartial_data();
+    void erasePartial();
+
+    void segmentsHitCircle_data();
+    void segmentsHitCircle();
+
+    void lassoSelect_data();
+    void lassoSelect();
+
+    void selectionCommit_data();
+    void selectionCommit();
+
+    void appendStrokeMesh_data();
+    void appendStrokeMesh();
+
+    void interpolation_data();
+    void interpolation();
+
+    void plotLine_data();
+    void plotLine();
+
+    void pointCountAt_data();
+    void pointCountAt();
+
+    void replaySeek_data();
+    void replaySeek();
+
+    void journalMirror_data();
+    void journalMirror();
+
+    void autosaveStroke_data();
+    void autosaveStroke();
+
+    void backgroundSave_data();
+    void backgroundSave();
+
+    void tilePan_data();
+    void tilePan();
+    void tileInvalidation();
+
+private:
+    void strokeSizes();
+    void documentSizes();
+    void segmentLengths();
+};
+
+namespace
+{
+    // Bytes allocated on the heap, -1 where the C library doesn't tell.
+    qint64 heapInUse()
+    {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+        return static_cast<qint64>(mallinfo2().uordblks);
+#elif defined(__GLIBC__)
+        return static_cast<unsigned int>(mallinfo().uordblks);
+#else
+        return -1;
+#endif
+    }
+}
+
+void InkBenchmark::strokeSizes()
+{
+    QTest::addColumn<int>("pointCount");
+
+    QTest::newRow("10 points") << 10;
+    QTest::newRow("100 points") << 100;
+    QTest::newRow("1000 points") << 1000;
+}
+
+void InkBenchmark::documentSizes()
+{
+    QTest::addColumn<int>("strokeCount");
+    QTest::addColumn<int>("pointsPerStroke");
+
+    QTest::newRow("10x100") << 10 << 100;
+    QTest::newRow("100x100") << 100 << 100;
+    QTest::newRow("1000x100") << 1000 << 100;
+}
+
+void InkBenchmark::segmentLengths()
+{
+    QTest::addColumn<QPointF>("from");
+    QTest::addColumn<QPointF>("to");
+    QTest::addColumn<float>("width");
+
+    QTest::newRow("short") << QPointF(10, 10) << QPointF(14, 13) << 2.0f;
+    QTest::newRow("diagonal") << QPointF(0, 0) << QPointF(1000, 700) << 2.0f;
+    QTest::newRow("horizontal") << QPointF(0, 500) << QPointF(1919, 500) << 2.0f;
+}
+
+void InkBenchmark::addPoint_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::addPoint()
+{
+    QFETCH(int, pointCount);
+
+    StrokeGenerator generator;
+    auto source = generator.stroke(pointCount);
+
+    QBENCHMARK {
+        InkStroke stroke(Qt::yellow);
+        for (int i = 0; i < pointCount; i++)
+        {
+            const auto& pt = source->getPoint(i);
+            stroke.addPoint(pt.first, pt.second);
+        }
+    }
+}
+
+void InkBenchmark::smoothStroke_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::smoothStroke()
+{
+    QFETCH(int, pointCount);
+
+    StrokeGenerator generator;
+    generator.setTimestamps(true);
+    auto source = generator.stroke(pointCount);
+
+    // The input path of a pen stroke: filter, resample, store.
+    InkSmoother smoother;
+    QVector<InkSmoother::Point> smoothed;
+    int storedPoints = 0;
+    QBENCHMARK {
+        InkStroke stroke(Qt::yellow);
+        smoother.reset();
+        for (int i = 0; i <= pointCount; i++)
+        {
+            smoothed.clear();
+            if (i < pointCount)
+            {
+                const auto& pt = source->getPoint(i);
+                smoother.push(pt.first, pt.second, source->timestamp(i), smoothed);
+            }
+            else
+            {
+                smoother.finish(smoothed);
+            }
+
+            for (const auto& point : smoothed)
+            {
+                stroke.addPoint(point.position, point.width, point.timestamp);
+            }
+        }
+        storedPoints = stroke.pointCount();
+    }
+
+    QVERIFY(storedPoints > 0);
+    QCOMPARE(smoother.latencySamples(), 1);
+}
+
+void InkBenchmark::boundRect_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::boundRect()
+{
+    QFETCH(int, pointCount);
+
+    auto stroke = StrokeGenerator().stroke(pointCount);
+    QRect bound;
+
+    QBENCHMARK {
+        bound = stroke->boundRect();
+    }
+
+    QVERIFY(bound.isValid());
+}
+
+void InkBenchmark::point_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::point()
+{
+    QFETCH(int, pointCount);
+
+    auto stroke = StrokeGenerator().stroke(pointCount);
+    double width = 0;
+
+    QBENCHMARK {
+        for (int i = 0; i < pointCount; i++)
+        {
+            width += stroke->point(i).size;
+        }
+    }
+
+    QVERIFY(width > 0);
+}
+
+void InkBenchmark::pointMemory_data()
+{
+    QTest::addColumn<int>("strokeCount");
+    QTest::addColumn<int>("pointsPerStroke");
+    QTest::addColumn<bool>("compact");
+
+    QTest::newRow("1000x100 full") << 1000 << 100 << false;
+    QTest::newRow("1000x100 compact") << 1000 << 100 << true;
+    QTest::newRow("1000x1000 full") << 1000 << 1000 << false;
+    QTest::newRow("1000x1000 compact") << 1000 << 1000 << true;
+}
+
+void InkBenchmark::pointMemory()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+    QFETCH(bool, compact);
+
+    if (heapInUse() < 0)
+    {
+        QSKIP("No heap statistics on this platform");
+    }
+
+    StrokeGenerator generator;
+    generator.setTimestamps(true);
+
+    // Heap used by the document in its steady state: full strokes, or compacted as committed.
+    const qint64 before = heapInUse();
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    if (compact)
+    {
+        for (int i = 0; i < data->strokeCount(); i++)
+        {
+            QVERIFY(data->stroke(i)->compact());
+        }
+    }
+    const qint64 bytes = heapInUse() - before;
+
+    const double bytesPerPoint = double(bytes) / (qint64(strokeCount) * pointsPerStroke);
+    QTest::setBenchmarkResult(bytesPerPoint, QTest::BytesAllocated);
+    qInfo("%.1f bytes per point", bytesPerPoint);
+}
+
+void InkBenchmark::toJsonString_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::toJsonString()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    auto data = StrokeGenerator().document(strokeCount, pointsPerStroke);
+    QString json;
+
+    QBENCHMARK {
+        json = data->toJsonString();
+    }
+
+    QVERIFY(!json.isEmpty());
+}
+
+void InkBenchmark::fromJsonString_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::fromJsonString()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    const QString json = StrokeGenerator().document(strokeCount, pointsPerStroke)->toJsonString();
+    InkData data;
+
+    QBENCHMARK {
+        data.fromJsonString(json);
+    }
+
+    QCOMPARE(data.strokeCount(), strokeCount);
+}
+
+void InkBenchmark::merge_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::merge()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    StrokeGenerator generator;
+    auto first = generator.document(strokeCount, pointsPerStroke);
+    auto second = generator.document(strokeCount, pointsPerStroke);
+
+    QBENCHMARK {
+        InkData merged;
+        merged.clone(*first);
+        merged.merge(*second);
+    }
+}
+
+void InkBenchmark::equal_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::equal()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    auto data = StrokeGenerator().document(strokeCount, pointsPerStroke);
+    InkData copy;
+    copy.clone(*data);
+    bool result = false;
+
+    QBENCHMARK {
+        result = data->equal(copy);
+    }
+
+    QVERIFY(result);
+}
+
+void InkBenchmark::diff_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::diff()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    // Another station's copy: same content, different objects, a few strokes erased and drawn.
+    StrokeGenerator generator;
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    InkData target(data->toJsonString());
+    for (int i = 0; i < 3; i++)
+    {
+        target.removeStroke((i + 1) * target.strokeCount() / 4, false);
+        target.insertStroke(i * target.strokeCount() / 3, generator.stroke(pointsPerStroke), false);
+    }
+
+    QVector<InkStrokeEdit> edits;
+
+    QBENCHMARK {
+        edits = data->diff(target);
+    }
+
+    QCOMPARE(edits.size(), 6);
+    data->applyEdits(edits, false);
+    QVERIFY(data->equal(target));
+}
+
+void InkBenchmark::eraseHitTest_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::eraseHitTest()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    StrokeGenerator generator;
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    const QPoint eraser = generator.point();
+    int hits = 0;
+
+    QBENCHMARK {
+        for (int i = data->strokeCount() - 1; i >= 0; i--)
+        {
+            if (strokeHitTest(*data->stroke(i), eraser, 30))
+            {
+                hits++;
+            }
+        }
+    }
+
+    Q_UNUSED(hits)
+}
+
+void InkBenchmark::erasePartial_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::erasePartial()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    StrokeGenerator generator;
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    const QPoint eraser = generator.point();
+    QVector<QSharedPointer<InkStroke>> pieces;
+    int hits = 0;
+
+    // One eraser move over the page, as in InkLayerGLWidget::eraseStroke.
+    QBENCHMARK {
+        for (int i = data->strokeCount() - 1; i >= 0; i--)
+        {
+            if (eraseStrokePart(*data->stroke(i), eraser, 15, pieces))
+            {
+                hits++;
+            }
+        }
+    }
+
+    Q_UNUSED(hits)
+}
+
+void InkBenchmark::segmentsHitCircle_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::segmentsHitCircle()
+{
+    QFETCH(int, pointCount);
+
+    auto stroke = StrokeGenerator().stroke(pointCount);
+    QVector<float> xs;
+    QVector<float> ys;
+    for (int i = 0; i < pointCount; i++)
+    {
+        xs.push_back(stroke->getPoint(i).first.x());
+        ys.push_back(stroke->getPoint(i).first.y());
+    }
+    QVector<quint8> hits(pointCount);
+    const QPoint center = stroke->getPoint(pointCount / 2).first;
+    int hitCount = 0;
+
+    QBENCHMARK {
+        hitCount = ::segmentsHitCircle(xs.constData(), ys.constData(), pointCount, center.x(), center.y(),
+                                       15, hits.data());
+    }
+
+    QVERIFY(hitCount > 0);
+}
+
+namespace
+{
+    // Circle of 64 vertices around a quarter of the default canvas.
+    QPolygonF lassoPolygon()
+    {
+        QPolygonF lasso;
+        for (int i = 0; i < 64; i++)
+        {
+            const double angle = 2 * M_PI * i / 64;
+            lasso << QPointF(960 + 480 * qCos(angle), 540 + 270 * qSin(angle));
+        }
+        return lasso;
+    }
+}
+
+void InkBenchmark::lassoSelect_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::lassoSelect()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    auto data = StrokeGenerator().document(strokeCount, pointsPerStroke);
+    InkSelection selection(data);
+    const QPolygonF lasso = lassoPolygon();
+    int selected = 0;
+
+    QBENCHMARK {
+        selected = selection.select(lasso);
+    }
+
+    QVERIFY(selected > 0);
+}
+
+void InkBenchmark::selectionCommit_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::selectionCommit()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    auto data = StrokeGenerator().document(strokeCount, pointsPerStroke);
+    InkSelection selection(data);
+    QVERIFY(selection.select(lassoPolygon()) > 0);
+
+    // The release of a drag: bake a small move into the selected strokes.
+    QBENCHMARK {
+        selection.setTransform(QTransform::fromTranslate(5, 3));
+        selection.commit();
+    }
+
+    QVERIFY(!selection.isEmpty());
+}
+
+void InkBenchmark::appendStrokeMesh_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::appendStrokeMesh()
+{
+    QFETCH(int, pointCount);
+
+    auto stroke = StrokeGenerator().stroke(pointCount);
+    QVector<QVector3D> vertices;
+    QVector<QVector3D> colors;
+    QVector<quint32> indices;
+
+    QBENCHMARK {
+        vertices.clear();
+        colors.clear();
+        indices.clear();
+        ::appendStrokeMesh(stroke->points(), stroke->color(), vertices, colors, indices);
+    }
+
+    QCOMPARE(vertices.size(), pointCount + 2);
+}
+
+void InkBenchmark::interpolation_data()
+{
+    segmentLengths();
+}
+
+void InkBenchmark::interpolation()
+{
+    QFETCH(QPointF, from);
+    QFETCH(QPointF, to);
+    QFETCH(float, width);
+
+    QVector<QPointF> points;
+
+    QBENCHMARK {
+        points = ::interpolation(from, to, width);
+    }
+
+    QVERIFY(!points.isEmpty());
+}
+
+void InkBenchmark::plotLine_data()
+{
+    segmentLengths();
+}
+
+void InkBenchmark::plotLine()
+{
+    QFETCH(QPointF, from);
+    QFETCH(QPointF, to);
+    QFETCH(float, width);
+
+    QVector<QPointF> points;
+
+    QBENCHMARK {
+        points = plot_line(from, to, width);
+    }
+
+    QVERIFY(!points.isEmpty());
+}
+
+void InkBenchmark::pointCountAt_data()
+{
+    strokeSizes();
+}
+
+void InkBenchmark::pointCountAt()
+{
+    QFETCH(int, pointCount);
+
+    StrokeGenerator generator;
+    generator.setTimestamps(true);
+    auto stroke = generator.stroke(pointCount);
+    const qint64 start = stroke->startTime();
+    const qint64 span = stroke->endTime() - start + 1;
+    qint64 time = 0;
+    int points = 0;
+
+    QBENCHMARK {
+        time = (time + 37) % span;
+        points += stroke->pointCountAt(start + time);
+    }
+
+    QVERIFY(points > 0);
+}
+
+void InkBenchmark::replaySeek_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::replaySeek()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    StrokeGenerator generator;
+    generator.setTimestamps(true);
+    InkReplay replay(generator.document(strokeCount, pointsPerStroke));
+    const qint64 start = replay.startTime();
+    const qint64 end = replay.endTime();
+    replay.seek(start);
+
+    // Scrub forward at 60 fps, jumping back to the start at the end.
+    qint64 time = start;
+
+    QBENCHMARK {
+        time += 16;
+        if (time > end)
+        {
+            time = start;
+        }
+        replay.seek(time);
+    }
+
+    QVERIFY(replay.output()->strokeCount() <= strokeCount);
+}
+
+void InkBenchmark::journalMirror_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::journalMirror()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    StrokeGenerator generator;
+    generator.setTimestamps(true);
+    auto drawing = generator.document(strokeCount, pointsPerStroke);
+
+    InkJournal::Stats stats;
+    int mirrored = 0;
+
+    QBENCHMARK {
+        auto source = QSharedPointer<InkData>::create();
+        auto mirror = QSharedPointer<InkData>::create();
+        InkJournal journal(source);
+        InkJournalApplier applier(mirror);
+        LoopbackTransport transport;
+        QObject::connect(&journal, &InkJournal::messageReady, &transport, &LoopbackTransport::send);
+        QObject::connect(&transport, &LoopbackTransport::received, &applier, &InkJournalApplier::apply);
+
+        // Draw the document live: a 250 Hz pen batched every 16 ms is 4 points a message.
+        for (int i = 0; i < drawing->strokeCount(); i++)
+        {
+            const auto stroke = drawing->stroke(i);
+            source->currentStroke()->setColor(stroke->color());
+            for (int j = 0; j < stroke->pointCount(); j++)
+            {
+                const auto point = stroke->point(j);
+                source->currentStroke()->addPoint(point.point, point.size, stroke->timestamp(j));
+                if (j % 4 == 3)
+                {
+                    journal.flush();
+                }
+            }
+            source->addCurrentStroke();
+        }
+
+        stats = journal.stats();
+        mirrored = mirror->strokeCount();
+    }
+
+    QCOMPARE(mirrored, strokeCount);
+    qInfo("%.1f bytes per stroke, %.2f bytes per point, %llu messages",
+          double(stats.bytes) / stats.strokes, double(stats.bytes) / stats.points, stats.messages);
+}
+
+void InkBenchmark::autosaveStroke_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::autosaveStroke()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+
+    StrokeGenerator generator;
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    auto stroke = generator.stroke(pointsPerStroke);
+
+    InkAutosave autosave(data, directory.filePath("ink"));
+    autosave.setCompactionInterval(0);
+    autosave.setCompactionThreshold(std::numeric_limits<qint64>::max());
+    QSignalSpy compacted(&autosave, &InkAutosave::compacted);
+    QVERIFY(autosave.start());
+    QVERIFY(compacted.wait());
+
+    // Saving a stroke costs the same whatever the document size.
+    QBENCHMARK {
+        data->insertStroke(data->strokeCount(), stroke, true);
+    }
+
+    InkData recovered;
+    QVERIFY(InkAutosave::load(directory.filePath("ink"), recovered));
+    QCOMPARE(recovered.strokeCount(), data->strokeCount());
+    qInfo("max record %.3f ms", autosave.stats().maxRecordNs / 1e6);
+}
+
+void InkBenchmark::backgroundSave_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::backgroundSave()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    const QString fileName = directory.filePath("ink.json");
+
+    StrokeGenerator generator;
+    auto data = generator.document(strokeCount, pointsPerStroke);
+    auto stroke = generator.stroke(pointsPerStroke);
+    InkSaver saver(data);
+
+    // GUI thread cost of a save while the user keeps inking. Compare with toJsonString.
+    QBENCHMARK {
+        saver.save(fileName);
+        data->insertStroke(data->strokeCount(), stroke, false);
+    }
+
+    saver.waitForFinished();
+
+    QFile file(fileName);
+    QVERIFY(file.open(QFile::ReadOnly));
+    InkData saved(QString::fromUtf8(file.readAll()));
+    QVERIFY(saved.strokeCount() >= strokeCount);
+    qInfo("max request %.3f ms, serialize %.3f ms, write %.3f ms, %llu coalesced",
+          saver.stats().maxRequestNs / 1e6, saver.stats().lastSerializeNs / 1e6,
+          saver.stats().lastWriteNs / 1e6, saver.stats().coalesced);
+}
+
+namespace
+{
+    // Render the view's tiles until nothing is left to render.
+    void renderTiles(InkTileCache& cache, const QRectF& view, qreal scale)
+    {
+        quint64 rendered;
+        do
+        {
+            rendered = cache.stats().rendered;
+            cache.tiles(view, scale);
+            cache.waitForFinished();
+            QCoreApplication::processEvents();
+        } while (cache.stats().rendered != rendered);
+    }
+
+    // Alpha of the view's ink at a canvas point.
+    int tileAlpha(InkTileCache& cache, const QRectF& view, qreal scale, const QPointF& point)
+    {
+        for (const InkTile& tile : cache.tiles(view, scale))
+        {
+            if (tile.rect.contains(point))
+            {
+                const QPointF pixel = tile.source.topLeft() +
+                        QPointF((point.x() - tile.rect.left()) * tile.source.width() / tile.rect.width(),
+                                (point.y() - tile.rect.top()) * tile.source.height() / tile.rect.height());
+                return qAlpha(tile.image.pixel(pixel.toPoint()));
+            }
+        }
+        return -1;
+    }
+}
+
+void InkBenchmark::tilePan_data()
+{
+    documentSizes();
+}
+
+void InkBenchmark::tilePan()
+{
+    QFETCH(int, strokeCount);
+    QFETCH(int, pointsPerStroke);
+
+    auto data = StrokeGenerator().document(strokeCount, pointsPerStroke);
+    InkTileCache cache;
+    cache.setInkData(data);
+
+    // Zoomed out to half size, the whole canvas in view: render every tile once.
+    const qreal scale = 0.5;
+    const QRectF canvas(QPointF(0, 0), QSizeF(data->canvasSize()));
+    quint64 rendered;
+    do
+    {
+        rendered = cache.stats().rendered;
+        cache.tiles(canvas, scale);
+        cache.waitForFinished();
+        QCoreApplication::processEvents();
+    } while (cache.stats().rendered != rendered);
+
+    // Pan a quarter canvas view around: only tile lookups, no stroke is drawn.
+    const QRectF view(QPointF(0, 0), canvas.size() / 2);
+    int step = 0;
+    QBENCHMARK {
+        const QPointF offset((step % 16) * canvas.width() / 32, (step / 16 % 16) * canvas.height() / 32);
+        QVERIFY(!cache.tiles(view.translated(offset), scale).isEmpty());
+        step++;
+    }
+
+    QVERIFY(cache.stats().rendered > 0);
+    qInfo("%llu tiles rendered, max render %.3f ms, %d KiB cached",
+          cache.stats().rendered, cache.stats().maxRenderNs / 1e6, cache.memoryUsed() / 1024);
+}
+
+void InkBenchmark::tileInvalidation()
+{
+    auto data = StrokeGenerator().document(0, 0);
+    InkTileCache cache;
+    cache.setInkData(data);
+
+    const qreal scale = 1.0;
+    const QRectF view(QPointF(0, 0), QSizeF(data->canvasSize()));
+    const int tileCount = qCeil(view.width() / InkTileCache::TILE_SIZE) *
+                          qCeil(view.height() / InkTileCache::TILE_SIZE);
+    renderTiles(cache, view, scale);
+    QCOMPARE(cache.stats().rendered, quint64(tileCount));
+
+    // Inside tile (1, 1), away from its edges.
+    const QPointF inked(350, 300);
+    auto drawLine = [&data]() {
+        data->currentStroke()->setColor(Qt::red);
+        data->currentStroke()->addPoint(QPoint(320, 300), 10);
+        data->currentStroke()->addPoint(QPoint(380, 300), 10);
+        data->addCurrentStroke();
+    };
+
+    // A stroke that isn't saved leaves the tiles alone.
+    data->setSaveStroke(false);
+    drawLine();
+    renderTiles(cache, view, scale);
+    QCOMPARE(tileAlpha(cache, view, scale, inked), 0);
+    QCOMPARE(cache.stats().rendered, quint64(tileCount));
+
+    // An added stroke is painted into the cached tile, nothing is rendered again.
+    data->setSaveStroke(true);
+    drawLine();
+    renderTiles(cache, view, scale);
+    QVERIFY(tileAlpha(cache, view, scale, inked) > 0);
+    QCOMPARE(cache.stats().rendered, quint64(tileCount));
+
+    // Erasing renders only the tile under the stroke again.
+    data->removeStroke(0);
+    renderTiles(cache, view, scale);
+    QCOMPARE(tileAlpha(cache, view, scale, inked), 0);
+    QCOMPARE(cache.stats().rendered, quint64(tileCount + 1));
+
+    // A budget below the view's tiles neither evicts them nor renders them over and over.
+    cache.setMemoryBudget(1);
+    renderTiles(cache, view, scale);
+    const quint64 rendered = cache.stats().rendered;
+    renderTiles(cache, view, scale);
+    QCOMPARE(cache.stats().rendered, rendered);
+    QVERIFY(tileAlpha(cache, view, scale, QPointF(10, 10)) == 0);
+}
+
+QTEST_GUILESS_MAIN(InkBenchmark)
+
+#include "ink_benchmark.moc"
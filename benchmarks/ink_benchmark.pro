@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# Headless micro-benchmarks for the ink model and geometry.
+#
+#-------------------------------------------------
+
+QT       += core gui testlib concurrent
+QT       -= widgets
+CONFIG   += c++11 console force_debug_info
+CONFIG   -= app_bundle
+
+
+TARGET = ink_benchmark
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+
+SOURCES += ink_benchmark.cpp \
+    ../ink_data.cpp \
+    ../ink_stroke.cpp \
+    ../ink_geometry.cpp \
+    ../ink_replay.cpp \
+    ../ink_journal.cpp \
+    ../ink_autosave.cpp \
+    ../ink_snapshot.cpp \
+    ../ink_saver.cpp \
+    ../ink_selection.cpp \
+    ../ink_smoothing.cpp \
+    ../ink_tile_cache.cpp \
+    ../frame_profiler.cpp
+
+HEADERS  += stroke_generator.h \
+    ../ink_data.h \
+    ../ink_stroke.h \
+    ../ink_geometry.h \
+    ../ink_replay.h \
+    ../ink_journal.h \
+    ../ink_autosave.h \
+    ../ink_snapshot.h \
+    ../ink_saver.h \
+    ../ink_selection.h \
+    ../ink_smoothing.h \
+    ../ink_tile_cache.h \
+    ../frame_profiler.h
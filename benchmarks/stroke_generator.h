@@ -0,0 +1,102 @@
+#ifndef STROKE_GENERATOR_H
+#define STROKE_GENERATOR_H
+
+#include <QColor>
+#include <QSharedPointer>
+#include <QSize>
+#include <QtMath>
+
+#include <random>
+
+#include "ink_data.h"
+#include "ink_stroke.h"
+
+/*! \brief Deterministic synthetic pen strokes for benchmarks.
+ *  The same seed always produces the same strokes on every platform.
+ */
+class StrokeGenerator
+{
+public:
+    explicit StrokeGenerator(quint32 seed = 42, QSize canvasSize = QSize(1920, 1080))
+        : m_random(seed)
+        , m_canvasSize(canvasSize)
+        , m_timestamps(false)
+        , m_time(0)
+    { }
+
+    /*! \brief Stamp the points like a 250 Hz pen, strokes following each other.
+     */
+    void setTimestamps(bool timestamps) { m_timestamps = timestamps; }
+
+    /*! \brief Random walk with smoothly changing direction and pen width.
+     */
+    QSharedPointer<InkStroke> stroke(int pointCount)
+    {
+        static const QColor colors[] = { Qt::yellow, Qt::red, Qt::green, Qt::blue };
+
+        auto result = QSharedPointer<InkStroke>::create(colors[uniform(0, 3)]);
+
+        double x = uniform(0, m_canvasSize.width() - 1);
+        double y = uniform(0, m_canvasSize.height() - 1);
+        double angle = uniform(0, 359) * M_PI / 180.0;
+        double width = uniform(4, 20);
+
+        for (int i = 0; i < pointCount; i++)
+        {
+            if (m_timestamps)
+            {
+                result->addPoint(QPoint(qRound(x), qRound(y)), width, m_time);
+                m_time += 4;
+            }
+            else
+            {
+                result->addPoint(QPoint(qRound(x), qRound(y)), width);
+            }
+
+            angle += (uniform(0, 60) - 30) * M_PI / 180.0;
+            x = qBound(0.0, x + 4.0 * qCos(angle), m_canvasSize.width() - 1.0);
+            y = qBound(0.0, y + 4.0 * qSin(angle), m_canvasSize.height() - 1.0);
+            width = qBound(1.0, width + (uniform(0, 10) - 5) / 10.0, 40.0);
+        }
+
+        // Pen up between strokes.
+        m_time += 200;
+
+        return result;
+    }
+
+    /*! \brief Document with strokeCount strokes of pointsPerStroke points each.
+     */
+    QSharedPointer<InkData> document(int strokeCount, int pointsPerStroke)
+    {
+        auto data = QSharedPointer<InkData>::create();
+        data->setCanvasSize(m_canvasSize);
+
+        for (int i = 0; i < strokeCount; i++)
+        {
+            data->insertStroke(data->strokeCount(), stroke(pointsPerStroke), false);
+        }
+
+        return data;
+    }
+
+    QPoint point()
+    {
+        return QPoint(uniform(0, m_canvasSize.width() - 1), uniform(0, m_canvasSize.height() - 1));
+    }
+
+private:
+    int uniform(int min, int max)
+    {
+        // Plain modulo keeps the sequence identical across standard libraries.
+        return min + static_cast<int>(m_random() % static_cast<quint32>(max - min + 1));
+    }
+
+private:
+    std::mt19937 m_random;
+    QSize m_canvasSize;
+    bool m_timestamps;
+    qint64 m_time;
+};
+
+#endif // STROKE_GENERATOR_H
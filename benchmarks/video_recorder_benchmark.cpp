@@ -0,0 +1,211 @@
+// video_recorder_benchmark.cpp
+//
+// Offline throughput of the video recorder: encodes synthetic frames to a temporary file.
+// Runs headless (no window system or GL needed). Reports encoded frames per second:
+//
+//   video_recorder_benchmark                       all rows
+//   video_recorder_benchmark encode:1080p          one resolution
+//   video_recorder_benchmark -o results.csv,csv    CSV
+
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QTemporaryDir>
+
+#include "frame_profiler.h"
+#include "video_recorder.h"
+
+Q_DECLARE_METATYPE(VideoRecorder::DropPolicy)
+
+class VideoRecorderBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void encode_data();
+    void encode();
+
+    void dropPolicy_data();
+    void dropPolicy();
+
+    void convertToYuv420_data();
+    void convertToYuv420();
+
+private:
+    void resolutions();
+    QVector<QImage> syntheticFrames(const QSize& size, int count);
+};
+
+namespace
+{
+    const int FRAME_COUNT = 120;
+    const int FRAMES_PER_SECOND = 30;
+    const qint64 FRAME_INTERVAL_NS = 1000000000LL / FRAMES_PER_SECOND;
+}
+
+void VideoRecorderBenchmark::resolutions()
+{
+    QTest::addColumn<QSize>("size");
+
+    QTest::newRow("360p") << QSize(640, 360);
+    QTest::newRow("720p") << QSize(1280, 720);
+    QTest::newRow("1080p") << QSize(1920, 1080);
+}
+
+QVector<QImage> VideoRecorderBenchmark::syntheticFrames(const QSize& size, int count)
+{
+    // A moving gradient and pen-like strokes, so the encoder has motion and edges to work on.
+    QVector<QImage> frames;
+    frames.reserve(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        QImage frame(size, QImage::Format_RGBA8888_Premultiplied);
+        QPainter painter(&frame);
+        painter.setRenderHint(QPainter::Antialiasing);
+
+        QLinearGradient gradient(0, 0, size.width(), size.height());
+        gradient.setColorAt(0, QColor::fromHsv((i * 3) % 360, 120, 200));
+        gradient.setColorAt(1, QColor::fromHsv((i * 3 + 180) % 360, 120, 80));
+        painter.fillRect(frame.rect(), gradient);
+
+        painter.setPen(QPen(Qt::yellow, 6, Qt::SolidLine, Qt::RoundCap));
+        for (int stroke = 0; stroke < 8; stroke++)
+        {
+            const qreal phase = (i + stroke * 15) * 0.05;
+            painter.drawLine(QPointF(size.width() * (0.5 + 0.4 * qSin(phase)), size.height() * 0.1 * (stroke + 1)),
+                             QPointF(size.width() * (0.5 + 0.4 * qCos(phase)), size.height() * 0.1 * (stroke + 2)));
+        }
+
+        frames.push_back(frame);
+    }
+
+    return frames;
+}
+
+void VideoRecorderBenchmark::encode_data()
+{
+    resolutions();
+}
+
+void VideoRecorderBenchmark::encode()
+{
+    QFETCH(QSize, size);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const auto frames = syntheticFrames(size, FRAME_COUNT);
+
+    VideoRecorder::Settings settings;
+    settings.fileName = dir.filePath("encode.mp4");
+    settings.size = size;
+    settings.framesPerSecond = FRAMES_PER_SECOND;
+    settings.dropPolicy = VideoRecorder::DropPolicy::DropNewest;
+
+    VideoRecorder recorder;
+    QVERIFY(recorder.start(settings));
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Lossless: a refused frame is offered again once the queue has room.
+    for (int i = 0; i < frames.size(); i++)
+    {
+        while (!recorder.submit(frames[i], i * FRAME_INTERVAL_NS))
+        {
+            QThread::usleep(500);
+        }
+    }
+
+    recorder.stop();
+    recorder.wait();
+
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    const auto stats = recorder.stats();
+
+    QCOMPARE(stats.encoded, quint64(FRAME_COUNT));
+    QVERIFY(QFileInfo(settings.fileName).size() > 0);
+
+    QTest::setBenchmarkResult(FRAME_COUNT * 1e9 / elapsedNs, QTest::FramesPerSecond);
+}
+
+void VideoRecorderBenchmark::dropPolicy_data()
+{
+    QTest::addColumn<VideoRecorder::DropPolicy>("policy");
+
+    QTest::newRow("drop newest") << VideoRecorder::DropPolicy::DropNewest;
+    QTest::newRow("drop oldest") << VideoRecorder::DropPolicy::DropOldest;
+}
+
+void VideoRecorderBenchmark::dropPolicy()
+{
+    QFETCH(VideoRecorder::DropPolicy, policy);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QSize size(1920, 1080);
+    const auto frames = syntheticFrames(size, 8);
+
+    VideoRecorder::Settings settings;
+    settings.fileName = dir.filePath("drop.mp4");
+    settings.size = size;
+    settings.framesPerSecond = FRAMES_PER_SECOND;
+    settings.queueCapacity = 2;
+    settings.dropPolicy = policy;
+
+    VideoRecorder recorder;
+    QVERIFY(recorder.start(settings));
+
+    // A burst far faster than the encoder: submit() has to stay cheap and frames get dropped.
+    qint64 maxSubmitNs = 0;
+    for (int i = 0; i < FRAME_COUNT; i++)
+    {
+        const qint64 start = FrameProfiler::now();
+        recorder.submit(frames[i % frames.size()], i * FRAME_INTERVAL_NS);
+        maxSubmitNs = qMax(maxSubmitNs, FrameProfiler::now() - start);
+    }
+
+    recorder.stop();
+    recorder.wait();
+
+    const auto stats = recorder.stats();
+    QCOMPARE(stats.submitted, quint64(FRAME_COUNT));
+    QCOMPARE(stats.encoded + stats.dropped, stats.submitted);
+    QVERIFY(stats.dropped > 0);
+
+    qInfo("encoded %llu, dropped %llu, slowest submit %.3f ms", stats.encoded, stats.dropped, maxSubmitNs / 1e6);
+}
+
+void VideoRecorderBenchmark::convertToYuv420_data()
+{
+    resolutions();
+}
+
+void VideoRecorderBenchmark::convertToYuv420()
+{
+    QFETCH(QSize, size);
+
+    const QImage image = syntheticFrames(size, 1).first();
+
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = size.width();
+    frame->height = size.height();
+    QVERIFY(av_frame_get_buffer(frame, 0) >= 0);
+
+    QBENCHMARK {
+        VideoRecorder::convertToYuv420(image, frame);
+    }
+
+    av_frame_free(&frame);
+}
+
+QTEST_GUILESS_MAIN(VideoRecorderBenchmark)
+
+#include "video_recorder_benchmark.moc"
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Headless throughput benchmark of the FFmpeg video recorder.
+#
+#-------------------------------------------------
+
+QT       += core gui testlib concurrent
+QT       -= widgets
+CONFIG   += c++11 console force_debug_info
+CONFIG   -= app_bundle
+
+
+TARGET = video_recorder_benchmark
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+
+SOURCES += video_recorder_benchmark.cpp \
+    ../video_recorder.cpp \
+    ../frame_profiler.cpp
+
+HEADERS  += ../video_recorder.h \
+    ../frame_profiler.h
+
+!isEmpty(FFMPEG_DIR) {
+    INCLUDEPATH += $$FFMPEG_DIR/include
+    LIBS += -L$$FFMPEG_DIR/lib
+}
+LIBS += -lavformat -lavcodec -lavutil
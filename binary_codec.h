@@ -0,0 +1,97 @@
+#ifndef BINARY_CODEC_H
+#define BINARY_CODEC_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/*! \brief Append an unsigned LEB128 varint.
+ */
+inline void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out.append(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(static_cast<char>(value));
+}
+
+/*! \brief Append a signed value as zigzag varint, so small negative numbers stay small.
+ */
+inline void appendZigzag(QByteArray& out, qint64 value)
+{
+    appendVarint(out, (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63));
+}
+
+/*! \brief Sequential reader for data written with appendVarint/appendZigzag.
+ *  Reading past the end sets the error flag and returns zero.
+ */
+class BinaryReader
+{
+public:
+    explicit BinaryReader(const QByteArray& data, int offset = 0)
+        : m_data(data)
+        , m_position(offset)
+        , m_error(false)
+    { }
+
+    quint64 readVarint()
+    {
+        quint64 value = 0;
+        int shift = 0;
+
+        while (m_position < m_data.size() && shift < 64)
+        {
+            quint8 byte = static_cast<quint8>(m_data.at(m_position++));
+            value |= static_cast<quint64>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                return value;
+            }
+            shift += 7;
+        }
+
+        m_error = true;
+        return 0;
+    }
+
+    qint64 readZigzag()
+    {
+        quint64 value = readVarint();
+        return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+    }
+
+    quint8 readByte()
+    {
+        if (m_position >= m_data.size())
+        {
+            m_error = true;
+            return 0;
+        }
+        return static_cast<quint8>(m_data.at(m_position++));
+    }
+
+    QByteArray readBytes(int count)
+    {
+        if (count < 0 || m_position + count > m_data.size())
+        {
+            m_error = true;
+            return QByteArray();
+        }
+
+        QByteArray bytes = m_data.mid(m_position, count);
+        m_position += count;
+        return bytes;
+    }
+
+    bool atEnd() const { return m_position >= m_data.size(); }
+    bool hasError() const { return m_error; }
+    int position() const { return m_position; }
+
+private:
+    const QByteArray& m_data;
+    int m_position;
+    bool m_error;
+};
+
+#endif // BINARY_CODEC_H
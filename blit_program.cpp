@@ -0,0 +1,104 @@
+#include <QDebug>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QVector4D>
+
+#include "blit_program.h"
+
+namespace
+{
+    const int POSITION_ATTRIBUTE = 0;
+    const int TEXCOORD_ATTRIBUTE = 1;
+
+    // Full viewport quad as a triangle strip: position, texture coordinate.
+    const GLfloat QUAD_VERTICES[] = {
+        -1.0f, -1.0f, 0.0f, 0.0f,
+         1.0f, -1.0f, 1.0f, 0.0f,
+        -1.0f,  1.0f, 0.0f, 1.0f,
+         1.0f,  1.0f, 1.0f, 1.0f
+    };
+}
+
+QString loadProgram(QString fileLocation)
+{
+    QFile file(fileLocation);
+    file.open(QFile::ReadOnly);
+    return file.readAll();
+}
+
+BlitProgram::BlitProgram()
+    : m_quadVbo(QOpenGLBuffer::VertexBuffer)
+    , m_transformUniform(-1)
+    , m_sourceRectUniform(-1)
+{ }
+
+BlitProgram::~BlitProgram()
+{ }
+
+bool BlitProgram::create()
+{
+    m_program = QSharedPointer<QOpenGLShaderProgram>::create();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, loadProgram("./assets/shaders/blit.vert"));
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, loadProgram("./assets/shaders/blit.frag"));
+    m_program->bindAttributeLocation("position", POSITION_ATTRIBUTE);
+    m_program->bindAttributeLocation("texCoord", TEXCOORD_ATTRIBUTE);
+    if (!m_program->link())
+    {
+        qWarning() << "BlitProgram: failed to link" << m_program->log();
+        m_program.reset();
+        return false;
+    }
+
+    m_transformUniform = m_program->uniformLocation("transform");
+    m_sourceRectUniform = m_program->uniformLocation("sourceRect");
+
+    m_program->bind();
+    m_program->setUniformValue("tex0", 0);
+    m_program->release();
+
+    m_quadVao.create();
+    m_quadVao.bind();
+
+    m_quadVbo.create();
+    m_quadVbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    m_quadVbo.bind();
+    m_quadVbo.allocate(QUAD_VERTICES, sizeof(QUAD_VERTICES));
+    m_program->enableAttributeArray(POSITION_ATTRIBUTE);
+    m_program->setAttributeBuffer(POSITION_ATTRIBUTE, GL_FLOAT, 0, 2, 4 * sizeof(GLfloat));
+    m_program->enableAttributeArray(TEXCOORD_ATTRIBUTE);
+    m_program->setAttributeBuffer(TEXCOORD_ATTRIBUTE, GL_FLOAT, 2 * sizeof(GLfloat), 2, 4 * sizeof(GLfloat));
+    m_quadVbo.release();
+
+    m_quadVao.release();
+
+    return true;
+}
+
+void BlitProgram::destroy()
+{
+    m_quadVao.destroy();
+    m_quadVbo.destroy();
+    m_program.reset();
+}
+
+void BlitProgram::draw(GLuint texture, const QMatrix4x4& transform, const QRectF& source)
+{
+    if (!m_program) return;
+
+    auto f = QOpenGLContext::currentContext()->functions();
+
+    m_program->bind();
+    m_program->setUniformValue(m_transformUniform, transform);
+    m_program->setUniformValue(m_sourceRectUniform, QVector4D(source.x(), source.y(), source.width(), source.height()));
+
+    f->glActiveTexture(GL_TEXTURE0);
+    f->glBindTexture(GL_TEXTURE_2D, texture);
+
+    m_quadVao.bind();
+    f->glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    m_quadVao.release();
+
+    f->glBindTexture(GL_TEXTURE_2D, 0);
+    m_program->release();
+}
@@ -0,0 +1,51 @@
+#ifndef BLIT_PROGRAM_H
+#define BLIT_PROGRAM_H
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QRectF>
+#include <QSharedPointer>
+
+/*! \brief Load a shader source file.
+ */
+QString loadProgram(QString fileLocation);
+
+/*! \brief Draws a texture as a full viewport quad with core-profile GL.
+ *
+ *  Holds a static quad VBO, its VAO and the textured-quad shader. A VAO is not shared between
+ *  contexts, so create one BlitProgram per context. Blending is left to the caller.
+ */
+class BlitProgram
+{
+public:
+    BlitProgram();
+    ~BlitProgram();
+
+    /*! \brief Build the shader and the quad. Call with the target context current.
+     */
+    bool create();
+
+    /*! \brief Release the GL resources. Call with the same context current.
+     */
+    void destroy();
+
+    bool isCreated() const { return m_program != nullptr; }
+
+    /*! \brief Draw the texture over the viewport.
+     *  \param transform Applied to the quad in clip space (-1..1), e.g. zoom and pan.
+     *  \param source Region of the texture to draw, in texture coordinates.
+     */
+    void draw(GLuint texture, const QMatrix4x4& transform = QMatrix4x4(),
+              const QRectF& source = QRectF(0, 0, 1, 1));
+
+private:
+    QSharedPointer<QOpenGLShaderProgram> m_program;
+    QOpenGLBuffer m_quadVbo;
+    QOpenGLVertexArrayObject m_quadVao;
+    int m_transformUniform;
+    int m_sourceRectUniform;
+};
+
+#endif // BLIT_PROGRAM_H
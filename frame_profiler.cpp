@@ -0,0 +1,141 @@
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QThread>
+
+#include "frame_profiler.h"
+
+std::atomic<bool> FrameProfiler::s_enabled(false);
+
+namespace
+{
+    thread_local void* t_threadBuffer = nullptr;
+
+    const QElapsedTimer& clock()
+    {
+        static QElapsedTimer timer;
+        static bool started = (timer.start(), true);
+        Q_UNUSED(started)
+        return timer;
+    }
+}
+
+FrameProfiler& FrameProfiler::instance()
+{
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+void FrameProfiler::setEnabled(bool enabled)
+{
+    // Make sure the clock origin is set before the first span is taken.
+    clock();
+    s_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+qint64 FrameProfiler::now()
+{
+    return clock().nsecsElapsed();
+}
+
+FrameProfiler::ThreadBuffer* FrameProfiler::threadBuffer()
+{
+    if (!t_threadBuffer)
+    {
+        auto buffer = QSharedPointer<ThreadBuffer>::create();
+        buffer->threadId = reinterpret_cast<quint64>(QThread::currentThreadId());
+
+        auto thread = QThread::currentThread();
+        buffer->threadName = thread ? thread->objectName() : QString();
+        if (buffer->threadName.isEmpty())
+        {
+            buffer->threadName = QString("Thread %1").arg(buffer->threadId);
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_buffers.push_back(buffer);
+        t_threadBuffer = buffer.data();
+    }
+
+    return static_cast<ThreadBuffer*>(t_threadBuffer);
+}
+
+void FrameProfiler::record(const char* name, qint64 startNs, qint64 endNs)
+{
+    auto buffer = threadBuffer();
+
+    quint64 head = buffer->head.load(std::memory_order_relaxed);
+    Span& span = buffer->spans[static_cast<int>(head % RING_CAPACITY)];
+    span.name = name;
+    span.start = startNs;
+    span.duration = endNs - startNs;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void FrameProfiler::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    for (auto buffer : m_buffers)
+    {
+        // head belongs to the recording thread, resetting it would race with record().
+        buffer->clearedAt.store(buffer->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+QByteArray FrameProfiler::toChromeTrace() const
+{
+    QJsonArray events;
+
+    QMutexLocker locker(&m_mutex);
+    for (auto buffer : m_buffers)
+    {
+        events.append(QJsonObject{
+                          {"name", "thread_name"},
+                          {"ph", "M"},
+                          {"pid", 1},
+                          {"tid", static_cast<double>(buffer->threadId)},
+                          {"args", QJsonObject{{"name", buffer->threadName}}}
+                      });
+
+        quint64 head = buffer->head.load(std::memory_order_acquire);
+        quint64 first = head > quint64(RING_CAPACITY) ? head - RING_CAPACITY : 0;
+        first = qMax(first, qMin(head, buffer->clearedAt.load(std::memory_order_relaxed)));
+
+        for (quint64 i = first; i < head; ++i)
+        {
+            const Span& span = buffer->spans.at(static_cast<int>(i % RING_CAPACITY));
+
+            // Chrome trace timestamps are in microseconds.
+            events.append(QJsonObject{
+                              {"name", QString::fromLatin1(span.name)},
+                              {"ph", "X"},
+                              {"pid", 1},
+                              {"tid", static_cast<double>(buffer->threadId)},
+                              {"ts", span.start / 1000.0},
+                              {"dur", span.duration / 1000.0}
+                          });
+        }
+    }
+
+    QJsonObject trace{
+        {"traceEvents", events},
+        {"displayTimeUnit", "ns"}
+    };
+
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+bool FrameProfiler::saveChromeTrace(const QString& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        return false;
+    }
+
+    return file.write(toChromeTrace()) >= 0;
+}
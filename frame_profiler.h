@@ -0,0 +1,129 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include <atomic>
+
+/*! \brief Lightweight span profiler.
+ *
+ *  Every thread records into its own fixed size ring buffer, so recording a span never
+ *  takes a lock. When the profiler is disabled a ProfileScope costs one relaxed atomic load.
+ *  The collected spans can be exported as Chrome trace-event JSON (chrome://tracing, Perfetto).
+ */
+class FrameProfiler
+{
+public:
+    /*! \brief Number of spans each thread keeps before the oldest ones are overwritten.
+     */
+    static const int RING_CAPACITY = 16384;
+
+    static FrameProfiler& instance();
+
+    /*! \brief Is span recording switched on?
+     */
+    static inline bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /*! \brief Switch span recording on or off at runtime.
+     */
+    static void setEnabled(bool enabled);
+
+    /*! \brief Monotonic clock in nanoseconds.
+     */
+    static qint64 now();
+
+    /*! \brief Record a finished span on the calling thread.
+     *  \param name Span name. Must be a string literal (only the pointer is stored).
+     */
+    void record(const char* name, qint64 startNs, qint64 endNs);
+
+    /*! \brief Drop all recorded spans. Safe while threads record: spans recorded concurrently
+     *  may be dropped or kept.
+     */
+    void clear();
+
+    /*! \brief Convert the recorded spans to Chrome trace-event JSON.
+     *  Export while the recording threads are quiet to get a consistent snapshot.
+     */
+    QByteArray toChromeTrace() const;
+
+    /*! \brief Write the Chrome trace-event JSON to a file.
+     */
+    bool saveChromeTrace(const QString& fileName) const;
+
+private:
+    struct Span
+    {
+        const char* name;
+        qint64 start;
+        qint64 duration;
+    };
+
+    struct ThreadBuffer
+    {
+        ThreadBuffer() : head(0), clearedAt(0), spans(RING_CAPACITY) { }
+
+        quint64 threadId;
+        QString threadName;
+
+        // Written by the owning thread only, read by the exporter.
+        std::atomic<quint64> head;
+        // head at the last clear(), the exporter skips the spans before it. Written under m_mutex.
+        std::atomic<quint64> clearedAt;
+        QVector<Span> spans;
+    };
+
+    FrameProfiler() { }
+
+    ThreadBuffer* threadBuffer();
+
+private:
+    static std::atomic<bool> s_enabled;
+
+    // Guards m_buffers. Only taken when a thread records its first span and on export.
+    mutable QMutex m_mutex;
+
+    // Buffers are kept alive after their thread exits so the spans can still be exported.
+    QVector<QSharedPointer<ThreadBuffer>> m_buffers;
+};
+
+/*! \brief Records the lifetime of the enclosing scope as a span.
+ */
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name)
+        : m_name(FrameProfiler::isEnabled() ? name : nullptr)
+        , m_start(m_name ? FrameProfiler::now() : 0)
+    { }
+
+    ~ProfileScope()
+    {
+        if (m_name)
+        {
+            FrameProfiler::instance().record(m_name, m_start, FrameProfiler::now());
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(ProfileScope)
+
+    const char* m_name;
+    qint64 m_start;
+};
+
+#define PROFILE_SCOPE_CONCAT_INNER(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT_INNER(a, b)
+
+/*! \brief Profile the rest of the enclosing scope under the given name.
+ */
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_SCOPE_CONCAT(profileScope_, __LINE__)(name)
+
+#endif // FRAME_PROFILER_H
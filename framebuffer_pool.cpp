@@ -0,0 +1,115 @@
+#include <QMutexLocker>
+
+#include "framebuffer_pool.h"
+
+namespace
+{
+    // Granularity of the size classes in pixels.
+    const int SIZE_CLASS_STEP = 128;
+
+    int roundUp(int value)
+    {
+        return qMax(1, (value + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP) * SIZE_CLASS_STEP;
+    }
+}
+
+FramebufferPool::FramebufferPool(int maxPooled, qint64 maxPooledBytes)
+    : m_maxPooled(maxPooled)
+    , m_maxPooledBytes(maxPooledBytes)
+{ }
+
+FramebufferPool::~FramebufferPool()
+{
+    clear();
+}
+
+QSize FramebufferPool::sizeClass(const QSize& size)
+{
+    return QSize(roundUp(size.width()), roundUp(size.height()));
+}
+
+qint64 FramebufferPool::byteSize(const QOpenGLFramebufferObject& fbo)
+{
+    // RGBA8 color plus a packed 24/8 depth stencil when attached.
+    const int bytesPerPixel = fbo.attachment() == QOpenGLFramebufferObject::NoAttachment ? 4 : 8;
+    const int samples = qMax(1, fbo.format().samples());
+    return static_cast<qint64>(fbo.width()) * fbo.height() * bytesPerPixel * samples;
+}
+
+QSharedPointer<QOpenGLFramebufferObject> FramebufferPool::acquire(const QSize& size,
+                                                                  const QOpenGLFramebufferObjectFormat& format)
+{
+    const QSize classSize = sizeClass(size);
+
+    // Most recently released first, it is the most likely to still be resident.
+    for (int i = m_pooled.size() - 1; i >= 0; i--)
+    {
+        const auto& candidate = m_pooled.at(i);
+        if (candidate->size() == classSize && candidate->format() == format)
+        {
+            auto fbo = m_pooled.takeAt(i);
+            const qint64 bytes = byteSize(*fbo);
+
+            QMutexLocker locker(&m_statsMutex);
+            m_stats.reuses++;
+            m_stats.bytesPooled -= bytes;
+            m_stats.bytesInUse += bytes;
+            m_stats.pooled = m_pooled.size();
+            return fbo;
+        }
+    }
+
+    auto fbo = QSharedPointer<QOpenGLFramebufferObject>::create(classSize, format);
+
+    QMutexLocker locker(&m_statsMutex);
+    m_stats.allocations++;
+    m_stats.bytesInUse += byteSize(*fbo);
+    return fbo;
+}
+
+void FramebufferPool::release(const QSharedPointer<QOpenGLFramebufferObject>& fbo)
+{
+    if (!fbo) return;
+
+    m_pooled.push_back(fbo);
+
+    {
+        const qint64 bytes = byteSize(*fbo);
+
+        QMutexLocker locker(&m_statsMutex);
+        m_stats.bytesInUse -= bytes;
+        m_stats.bytesPooled += bytes;
+        m_stats.pooled = m_pooled.size();
+    }
+
+    evict();
+}
+
+void FramebufferPool::evict()
+{
+    QMutexLocker locker(&m_statsMutex);
+
+    while (!m_pooled.isEmpty() && (m_pooled.size() > m_maxPooled || m_stats.bytesPooled > m_maxPooledBytes))
+    {
+        auto fbo = m_pooled.takeFirst();
+        m_stats.bytesPooled -= byteSize(*fbo);
+        m_stats.evictions++;
+    }
+
+    m_stats.pooled = m_pooled.size();
+}
+
+void FramebufferPool::clear()
+{
+    m_pooled.clear();
+
+    QMutexLocker locker(&m_statsMutex);
+    m_stats.bytesPooled = 0;
+    m_stats.pooled = 0;
+}
+
+FramebufferPool::Stats FramebufferPool::stats() const
+{
+    QMutexLocker locker(&m_statsMutex);
+    return m_stats;
+}
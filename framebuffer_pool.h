@@ -0,0 +1,75 @@
+#ifndef FRAMEBUFFER_POOL_H
+#define FRAMEBUFFER_POOL_H
+
+#include <QList>
+#include <QMutex>
+#include <QOpenGLFramebufferObject>
+#include <QSharedPointer>
+#include <QSize>
+
+/*! \brief Recycles framebuffer objects of one GL context.
+ *
+ *  Sizes are rounded up to size classes, so a window resize or a layout animation keeps getting
+ *  the same few FBOs instead of allocating a new one per step. Whoever draws into one has to stay
+ *  in the requested size (viewport, scissor). Released FBOs are kept until the pool exceeds its
+ *  entry or byte budget, then the least recently released ones are deleted.
+ *
+ *  Use from the thread the context is current on. stats() may be called from any thread.
+ */
+class FramebufferPool
+{
+public:
+    struct Stats
+    {
+        // FBOs created and deleted by the pool.
+        quint64 allocations = 0;
+        quint64 evictions = 0;
+        // acquire() calls served from the pool.
+        quint64 reuses = 0;
+        // Estimated GPU memory of the FBOs handed out and kept in the pool.
+        qint64 bytesInUse = 0;
+        qint64 bytesPooled = 0;
+        int pooled = 0;
+    };
+
+    explicit FramebufferPool(int maxPooled = 6, qint64 maxPooledBytes = 64 * 1024 * 1024);
+    ~FramebufferPool();
+
+    /*! \brief Get an FBO of at least size with the format.
+     *  The returned FBO is sizeClass(size) large, only the bottom-left size pixels are meant to be used.
+     */
+    QSharedPointer<QOpenGLFramebufferObject> acquire(const QSize& size,
+                                                     const QOpenGLFramebufferObjectFormat& format = QOpenGLFramebufferObjectFormat());
+
+    /*! \brief Give an FBO from acquire() back to the pool.
+     */
+    void release(const QSharedPointer<QOpenGLFramebufferObject>& fbo);
+
+    /*! \brief Delete the pooled FBOs. Call with the context current.
+     */
+    void clear();
+
+    Stats stats() const;
+
+    /*! \brief Size an FBO for size is rounded up to.
+     */
+    static QSize sizeClass(const QSize& size);
+
+private:
+    static qint64 byteSize(const QOpenGLFramebufferObject& fbo);
+
+    void evict();
+
+private:
+    const int m_maxPooled;
+    const qint64 m_maxPooledBytes;
+
+    // Released FBOs, least recently released first.
+    QList<QSharedPointer<QOpenGLFramebufferObject>> m_pooled;
+
+    // Guards m_stats only.
+    mutable QMutex m_statsMutex;
+    Stats m_stats;
+};
+
+#endif // FRAMEBUFFER_POOL_H
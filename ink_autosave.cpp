@@ -0,0 +1,515 @@
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include "binary_codec.h"
+#include "frame_profiler.h"
+#include "ink_autosave.h"
+#include "ink_data.h"
+#include "ink_journal.h"
+
+namespace
+{
+    const char SNAPSHOT_MAGIC[] = "INKS";
+    const int SNAPSHOT_MAGIC_SIZE = 4;
+    const quint8 SNAPSHOT_VERSION = 1;
+
+    enum AutosaveRecord : quint8
+    {
+        // Stroke.
+        AddStroke = 1,
+        // Index, stroke.
+        InsertStroke = 2,
+        // Index.
+        RemoveStroke = 3,
+        Clear = 4,
+        // InkSnapshot::toBinary().
+        Reset = 5,
+        // Width, height.
+        CanvasSize = 6,
+        // Edit count, then per edit InsertStroke or RemoveStroke and its fields.
+        EditStrokes = 7
+    };
+
+    struct Document
+    {
+        QSize canvasSize;
+        QVector<QSharedPointer<InkStroke>> strokes;
+    };
+
+    // Reads InkSnapshot::toBinary().
+    bool readDocument(BinaryReader& reader, Document& document)
+    {
+        const int width = static_cast<int>(reader.readVarint());
+        const int height = static_cast<int>(reader.readVarint());
+        const quint64 count = reader.readVarint();
+
+        QVector<QSharedPointer<InkStroke>> strokes;
+        for (quint64 i = 0; i < count && !reader.hasError(); i++)
+        {
+            strokes.push_back(InkJournal::readStroke(reader));
+        }
+
+        if (reader.hasError()) return false;
+
+        document.canvasSize = QSize(width, height);
+        document.strokes = strokes;
+        return true;
+    }
+
+    bool applyRecord(const QByteArray& payload, Document& document)
+    {
+        BinaryReader reader(payload);
+
+        switch (reader.readByte())
+        {
+        case AddStroke:
+        {
+            auto stroke = InkJournal::readStroke(reader);
+            if (reader.hasError()) return false;
+            document.strokes.push_back(stroke);
+            return true;
+        }
+        case InsertStroke:
+        {
+            const quint64 index = reader.readVarint();
+            auto stroke = InkJournal::readStroke(reader);
+            if (reader.hasError() || index > static_cast<quint64>(document.strokes.size())) return false;
+            document.strokes.insert(static_cast<int>(index), stroke);
+            return true;
+        }
+        case RemoveStroke:
+        {
+            const quint64 index = reader.readVarint();
+            if (reader.hasError() || index >= static_cast<quint64>(document.strokes.size())) return false;
+            document.strokes.remove(static_cast<int>(index));
+            return true;
+        }
+        case Clear:
+            document.strokes.clear();
+            return true;
+        case Reset:
+            return readDocument(reader, document);
+        case CanvasSize:
+        {
+            const int width = static_cast<int>(reader.readVarint());
+            const int height = static_cast<int>(reader.readVarint());
+            if (reader.hasError()) return false;
+            document.canvasSize = QSize(width, height);
+            return true;
+        }
+        case EditStrokes:
+        {
+            // All or nothing, like the edit in the data.
+            QVector<QSharedPointer<InkStroke>> strokes = document.strokes;
+            const quint64 count = reader.readVarint();
+            for (quint64 i = 0; i < count && !reader.hasError(); i++)
+            {
+                const quint8 type = reader.readByte();
+                const quint64 index = reader.readVarint();
+                if (type == InsertStroke)
+                {
+                    auto stroke = InkJournal::readStroke(reader);
+                    if (reader.hasError() || index > static_cast<quint64>(strokes.size())) return false;
+                    strokes.insert(static_cast<int>(index), stroke);
+                }
+                else if (type == RemoveStroke && index < static_cast<quint64>(strokes.size()))
+                {
+                    strokes.remove(static_cast<int>(index));
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            if (reader.hasError()) return false;
+            document.strokes = strokes;
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+
+    /*! \brief Replay the records of a segment up to the first incomplete or damaged one.
+     */
+    void replaySegment(const QByteArray& data, Document& document)
+    {
+        int position = 0;
+        while (position < data.size())
+        {
+            BinaryReader reader(data, position);
+            const quint64 size = reader.readVarint();
+            if (reader.hasError() || size > static_cast<quint64>(data.size() - reader.position() - 2))
+            {
+                return;
+            }
+
+            const QByteArray payload = reader.readBytes(static_cast<int>(size));
+            const quint16 low = reader.readByte();
+            const quint16 checksum = low | (reader.readByte() << 8);
+            if (checksum != qChecksum(payload.constData(), payload.size()) || !applyRecord(payload, document))
+            {
+                return;
+            }
+
+            position = reader.position();
+        }
+    }
+}
+
+InkAutosave::InkAutosave(QSharedPointer<InkData> data, const QString& basePath, QObject* parent)
+    : QObject(parent)
+    , m_data(data)
+    , m_basePath(basePath)
+    , m_segment(-1)
+    , m_dirty(false)
+    , m_compactionThreshold(DEFAULT_COMPACTION_THRESHOLD)
+    , m_compactionStart(0)
+{
+    m_compactionTimer.setInterval(DEFAULT_COMPACTION_INTERVAL_MS);
+    connect(&m_compactionTimer, &QTimer::timeout, this, &InkAutosave::compact);
+    connect(&m_compaction, &QFutureWatcher<bool>::finished, this, &InkAutosave::onCompactionFinished);
+}
+
+InkAutosave::~InkAutosave()
+{
+    m_compaction.waitForFinished();
+    m_journal.close();
+}
+
+QString InkAutosave::segmentFileName(const QString& basePath, int segment)
+{
+    return QString("%1.journal.%2").arg(basePath).arg(segment);
+}
+
+QVector<int> InkAutosave::segments(const QString& basePath)
+{
+    const QFileInfo base(basePath);
+    const QString prefix = base.fileName() + ".journal.";
+
+    QVector<int> result;
+    for (const auto& name : base.dir().entryList({ prefix + "*" }, QDir::Files))
+    {
+        bool ok = false;
+        const int segment = name.mid(prefix.size()).toInt(&ok);
+        if (ok)
+        {
+            result.push_back(segment);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool InkAutosave::load(const QString& basePath, InkData& data)
+{
+    PROFILE_SCOPE("InkAutosave::load");
+
+    Document document;
+    document.canvasSize = data.canvasSize();
+    int lastSegment = -1;
+    bool found = false;
+
+    QFile snapshot(basePath + ".snapshot");
+    if (snapshot.open(QFile::ReadOnly))
+    {
+        const QByteArray bytes = snapshot.readAll();
+        BinaryReader reader(bytes, SNAPSHOT_MAGIC_SIZE);
+
+        if (!bytes.startsWith(QByteArray(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE)) ||
+            reader.readByte() != SNAPSHOT_VERSION)
+        {
+            qWarning() << "InkAutosave: unknown snapshot format" << snapshot.fileName();
+            return false;
+        }
+
+        lastSegment = static_cast<int>(reader.readVarint()) - 1;
+        if (!readDocument(reader, document))
+        {
+            qWarning() << "InkAutosave: damaged snapshot" << snapshot.fileName();
+            return false;
+        }
+        found = true;
+    }
+
+    for (int segment : segments(basePath))
+    {
+        if (segment <= lastSegment) continue;
+
+        QFile file(segmentFileName(basePath, segment));
+        if (file.open(QFile::ReadOnly))
+        {
+            replaySegment(file.readAll(), document);
+            found = true;
+        }
+    }
+
+    if (!found) return false;
+
+    InkData recovered;
+    for (const auto& stroke : document.strokes)
+    {
+        recovered.insertStroke(recovered.strokeCount(), stroke, false);
+    }
+
+    data.setCanvasSize(document.canvasSize);
+    data.clone(recovered);
+    return true;
+}
+
+bool InkAutosave::recover()
+{
+    if (!load(m_basePath, *m_data))
+    {
+        return false;
+    }
+
+    // Continue in a new segment, the recovered ones may end with a torn record.
+    const auto existing = segments(m_basePath);
+    openSegment(existing.isEmpty() ? 0 : existing.last() + 1);
+    connectData();
+    return true;
+}
+
+bool InkAutosave::start()
+{
+    QFile::remove(m_basePath + ".snapshot");
+    for (int segment : segments(m_basePath))
+    {
+        QFile::remove(segmentFileName(m_basePath, segment));
+    }
+
+    if (!openSegment(0))
+    {
+        return false;
+    }
+
+    connectData();
+    onStrokesReset();
+    return true;
+}
+
+void InkAutosave::setCompactionInterval(int milliseconds)
+{
+    m_compactionTimer.setInterval(milliseconds);
+
+    if (milliseconds <= 0)
+    {
+        m_compactionTimer.stop();
+    }
+    else if (m_segment >= 0)
+    {
+        m_compactionTimer.start();
+    }
+}
+
+void InkAutosave::connectData()
+{
+    connect(m_data.data(), &InkData::strokeAdded, this, &InkAutosave::onStrokeAdded);
+    connect(m_data.data(), &InkData::strokeRemoved, this, &InkAutosave::onStrokeRemoved);
+    connect(m_data.data(), &InkData::strokeInserted, this, &InkAutosave::onStrokeInserted);
+    connect(m_data.data(), &InkData::strokesEdited, this, &InkAutosave::onStrokesEdited);
+    connect(m_data.data(), &InkData::cleared, this, &InkAutosave::onCleared);
+    connect(m_data.data(), &InkData::strokesReset, this, &InkAutosave::onStrokesReset);
+    connect(m_data.data(), &InkData::canvasSizeChanged, this, &InkAutosave::onCanvasSizeChanged);
+
+    if (m_compactionTimer.interval() > 0)
+    {
+        m_compactionTimer.start();
+    }
+}
+
+bool InkAutosave::openSegment(int segment)
+{
+    m_journal.close();
+    m_journal.setFileName(segmentFileName(m_basePath, segment));
+    m_segment = segment;
+
+    if (!m_journal.open(QFile::WriteOnly | QFile::Append))
+    {
+        qWarning() << "InkAutosave: failed to open" << m_journal.fileName();
+        return false;
+    }
+
+    return true;
+}
+
+void InkAutosave::appendRecord(const QByteArray& payload)
+{
+    if (!m_journal.isOpen()) return;
+
+    PROFILE_SCOPE("InkAutosave::appendRecord");
+
+    const qint64 start = FrameProfiler::now();
+
+    // Length, payload, CRC-16 of the payload. One write, so a crash leaves at most one torn record.
+    QByteArray record;
+    record.reserve(payload.size() + 6);
+    appendVarint(record, payload.size());
+    record.append(payload);
+    const quint16 checksum = qChecksum(payload.constData(), payload.size());
+    record.append(static_cast<char>(checksum & 0xff));
+    record.append(static_cast<char>(checksum >> 8));
+
+    m_journal.write(record);
+    m_journal.flush();
+    m_dirty = true;
+
+    const qint64 elapsed = FrameProfiler::now() - start;
+    m_stats.records++;
+    m_stats.bytes += record.size();
+    m_stats.lastRecordNs = elapsed;
+    m_stats.maxRecordNs = qMax(m_stats.maxRecordNs, elapsed);
+
+    if (m_journal.size() >= m_compactionThreshold)
+    {
+        compact();
+    }
+}
+
+void InkAutosave::onStrokeAdded(QSharedPointer<InkStroke> addedStroke)
+{
+    const int count = m_data->strokeCount();
+    if (count == 0 || m_data->stroke(count - 1) != addedStroke)
+    {
+        // Not kept by the data.
+        return;
+    }
+
+    QByteArray payload;
+    payload.append(static_cast<char>(AddStroke));
+    InkJournal::appendStroke(payload, *addedStroke);
+    appendRecord(payload);
+}
+
+void InkAutosave::onStrokeRemoved(int index)
+{
+    QByteArray payload;
+    payload.append(static_cast<char>(RemoveStroke));
+    appendVarint(payload, index);
+    appendRecord(payload);
+}
+
+void InkAutosave::onStrokeInserted(int index, QSharedPointer<InkStroke> stroke)
+{
+    QByteArray payload;
+    payload.append(static_cast<char>(InsertStroke));
+    appendVarint(payload, index);
+    InkJournal::appendStroke(payload, *stroke);
+    appendRecord(payload);
+}
+
+void InkAutosave::onStrokesEdited(const QVector<InkStrokeEdit>& edits)
+{
+    QByteArray payload;
+    payload.append(static_cast<char>(EditStrokes));
+    appendVarint(payload, edits.size());
+    for (const auto& edit : edits)
+    {
+        const bool insert = edit.type == InkStrokeEdit::Insert;
+        payload.append(static_cast<char>(insert ? InsertStroke : RemoveStroke));
+        appendVarint(payload, edit.index);
+        if (insert)
+        {
+            InkJournal::appendStroke(payload, *edit.stroke);
+        }
+    }
+    appendRecord(payload);
+}
+
+void InkAutosave::onCleared()
+{
+    QByteArray payload;
+    payload.append(static_cast<char>(Clear));
+    appendRecord(payload);
+}
+
+void InkAutosave::onStrokesReset()
+{
+    // The whole document once, then fold it into a snapshot so recovery doesn't replay it.
+    QByteArray payload;
+    payload.append(static_cast<char>(Reset));
+    payload.append(m_data->snapshot().toBinary());
+    appendRecord(payload);
+
+    compact();
+}
+
+void InkAutosave::onCanvasSizeChanged(QSize size)
+{
+    QByteArray payload;
+    payload.append(static_cast<char>(CanvasSize));
+    appendVarint(payload, qMax(0, size.width()));
+    appendVarint(payload, qMax(0, size.height()));
+    appendRecord(payload);
+}
+
+void InkAutosave::compact()
+{
+    if (!m_dirty || m_compaction.isRunning()) return;
+
+    PROFILE_SCOPE("InkAutosave::compact");
+
+    // Writes from now on go to the next segment, the snapshot folds in everything before it.
+    const int lastSegment = m_segment;
+    openSegment(m_segment + 1);
+    m_dirty = false;
+    m_compactionStart = FrameProfiler::now();
+
+    const QString basePath = m_basePath;
+    const InkSnapshot snapshot = m_data->snapshot();
+    m_compaction.setFuture(QtConcurrent::run([basePath, lastSegment, snapshot]() {
+        return writeSnapshot(basePath, lastSegment, snapshot);
+    }));
+}
+
+bool InkAutosave::writeSnapshot(const QString& basePath, int lastSegment, const InkSnapshot& snapshot)
+{
+    PROFILE_SCOPE("InkAutosave::writeSnapshot");
+
+    QByteArray data;
+    data.append(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    data.append(static_cast<char>(SNAPSHOT_VERSION));
+    appendVarint(data, static_cast<quint64>(lastSegment + 1));
+    data.append(snapshot.toBinary());
+
+    // Replaces the previous snapshot atomically, a crash leaves either one intact.
+    QSaveFile file(basePath + ".snapshot");
+    if (!file.open(QFile::WriteOnly) || file.write(data) != data.size() || !file.commit())
+    {
+        qWarning() << "InkAutosave: failed to write" << file.fileName();
+        return false;
+    }
+
+    for (int segment : segments(basePath))
+    {
+        if (segment <= lastSegment)
+        {
+            QFile::remove(segmentFileName(basePath, segment));
+        }
+    }
+
+    return true;
+}
+
+void InkAutosave::onCompactionFinished()
+{
+    const bool success = m_compaction.result();
+
+    if (success)
+    {
+        m_stats.compactions++;
+        m_stats.lastCompactionNs = FrameProfiler::now() - m_compactionStart;
+    }
+    else
+    {
+        // Keep the segments and try again next time.
+        m_dirty = true;
+    }
+
+    emit compacted(success);
+}
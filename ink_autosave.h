@@ -0,0 +1,119 @@
+#ifndef INK_AUTOSAVE_H
+#define INK_AUTOSAVE_H
+
+#include <QFile>
+#include <QFutureWatcher>
+#include <QObject>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+
+class InkData;
+class InkSnapshot;
+class InkStroke;
+struct InkStrokeEdit;
+
+/*! \brief Crash-safe autosave of an InkData as a snapshot plus an append-only journal.
+ *
+ *  Every stroke change appends one record to the current journal segment and flushes it, so
+ *  the cost of a save is that of the changed stroke, not of the document. From time to time
+ *  (or when the segment grows large) the segment is closed, a new one opened, and a worker
+ *  thread folds the document into a new snapshot and deletes the folded segments.
+ *
+ *  Files: <basePath>.snapshot and <basePath>.journal.<segment>. The snapshot names the last
+ *  segment it contains, recovery loads it and replays the newer segments. A torn record at the
+ *  end of a segment (crash while writing) is ignored.
+ */
+class InkAutosave : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        quint64 records = 0;
+        quint64 bytes = 0;
+        quint64 compactions = 0;
+        qint64 lastRecordNs = 0;
+        qint64 maxRecordNs = 0;
+        qint64 lastCompactionNs = 0;
+    };
+
+    static const int DEFAULT_COMPACTION_INTERVAL_MS = 60000;
+    static const qint64 DEFAULT_COMPACTION_THRESHOLD = 4 * 1024 * 1024;
+
+    InkAutosave(QSharedPointer<InkData> data, const QString& basePath, QObject* parent = nullptr);
+
+    /*! \brief Waits for a running compaction.
+     */
+    ~InkAutosave();
+
+    /*! \brief Replace the data with the autosaved document, then keep saving.
+     *  \return False when there is nothing to recover. Call start() then.
+     */
+    bool recover();
+
+    /*! \brief Drop any previous autosave and start saving the data as it is now.
+     */
+    bool start();
+
+    /*! \brief Compact every interval ms if anything was written. 0 disables the timer.
+     */
+    void setCompactionInterval(int milliseconds);
+
+    /*! \brief Compact once the current segment reaches this many bytes.
+     */
+    void setCompactionThreshold(qint64 bytes) { m_compactionThreshold = bytes; }
+
+    Stats stats() const { return m_stats; }
+
+    /*! \brief Load the autosaved document into data without starting to save.
+     */
+    static bool load(const QString& basePath, InkData& data);
+
+public slots:
+    /*! \brief Fold the journal into a new snapshot on a worker thread.
+     */
+    void compact();
+
+signals:
+    void compacted(bool success);
+
+private slots:
+    void onStrokeAdded(QSharedPointer<InkStroke> addedStroke);
+    void onStrokeRemoved(int index);
+    void onStrokeInserted(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokesEdited(const QVector<InkStrokeEdit>& edits);
+    void onCleared();
+    void onStrokesReset();
+    void onCanvasSizeChanged(QSize size);
+    void onCompactionFinished();
+
+private:
+    void connectData();
+    bool openSegment(int segment);
+    void appendRecord(const QByteArray& payload);
+
+    static bool writeSnapshot(const QString& basePath, int lastSegment, const InkSnapshot& snapshot);
+    static QVector<int> segments(const QString& basePath);
+    static QString segmentFileName(const QString& basePath, int segment);
+
+private:
+    QSharedPointer<InkData> m_data;
+    QString m_basePath;
+
+    QFile m_journal;
+    int m_segment;
+    bool m_dirty;
+
+    QTimer m_compactionTimer;
+    qint64 m_compactionThreshold;
+    QFutureWatcher<bool> m_compaction;
+    qint64 m_compactionStart;
+
+    Stats m_stats;
+};
+
+#endif // INK_AUTOSAVE_H
@@ -1,11 +1,52 @@
 #include <QDebug>
+#include <QMultiHash>
 #include <QPolygon>
 
+#include <algorithm>
+#include <limits>
+
 #include "ink_data.h"
+#include "frame_profiler.h"
 
 bool operator==(const InkStroke& stroke1, const InkStroke& stroke2)
 {
-    return (stroke1.m_color == stroke2.m_color && stroke1.m_points == stroke2.m_points);
+    // Different hashes rule out equal content without looking at the points.
+    if (stroke1.contentHash() != stroke2.contentHash() || stroke1.m_color != stroke2.m_color ||
+        stroke1.pointCount() != stroke2.pointCount())
+    {
+        return false;
+    }
+
+    if (!stroke1.isCompact() && !stroke2.isCompact())
+    {
+        return stroke1.m_points == stroke2.m_points;
+    }
+
+    for (int i = 0; i < stroke1.pointCount(); i++)
+    {
+        const InkPoint point1 = stroke1.point(i);
+        const InkPoint point2 = stroke2.point(i);
+        if (point1.point != point2.point || point1.size != point2.size)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+namespace
+{
+    QVector<quint64> contentHashes(const QVector<QSharedPointer<InkStroke>>& strokes)
+    {
+        QVector<quint64> hashes;
+        hashes.reserve(strokes.size());
+        for (const auto& stroke : strokes)
+        {
+            hashes.push_back(stroke->contentHash());
+        }
+        return hashes;
+    }
 }
 
 InkData::InkData()
@@ -13,6 +54,9 @@ InkData::InkData()
     , m_needSave(true)
     , m_currentStroke(new InkStroke)
     , m_canvasSize(QSize(1920,1080))
+    , m_timeIndexValid(false)
+    , m_revision(0)
+    , m_compactStrokes(false)
 { }
 
 InkData::InkData(const QString &jsonStrokes)
@@ -29,7 +73,27 @@ void InkData::addCurrentStroke(bool notify)
 
         if(m_needSave)
         {
+            // Compact before the stroke is shared with snapshots, it's immutable from here on.
+            if (m_compactStrokes)
+            {
+                stroke->compact();
+            }
+
             m_strokes.push_back(stroke);
+            m_revision++;
+
+            // Strokes are mostly appended in time order, keep the index without a rebuild.
+            const auto span = strokeSpan(m_strokes.size() - 1);
+            if (m_timeIndexValid && (m_timeIndex.isEmpty() || m_timeIndex.last().start <= span.start))
+            {
+                m_timeIndex.push_back(span);
+                m_timeIndexEnds.push_back(m_timeIndexEnds.isEmpty() ? span.end
+                                                                   : qMax(m_timeIndexEnds.last(), span.end));
+            }
+            else
+            {
+                m_timeIndexValid = false;
+            }
         }
 
         m_currentStroke.reset(new InkStroke);
@@ -45,6 +109,8 @@ void InkData::removeStroke(int index, bool notify)
 {
     auto stroke = this->stroke(index);
     m_strokes.removeAt(index);
+    m_timeIndexValid = false;
+    m_revision++;
 
     if(notify)
     {
@@ -55,6 +121,8 @@ void InkData::removeStroke(int index, bool notify)
 void InkData::clear()
 {
     m_strokes.clear();
+    m_timeIndexValid = false;
+    m_revision++;
     emit cleared();
 }
 
@@ -65,30 +133,63 @@ int InkData::strokeCount()
 
 QSharedPointer<InkStroke> InkData::stroke(int index)
 {
-    return m_strokes[index];
+    // at() doesn't detach the vector from the snapshots sharing it.
+    return m_strokes.at(index);
 }
 
 void InkData::merge(const InkData& inkData)
 {
+    PROFILE_SCOPE("InkData::merge");
+
+    // Strokes by content hash. Equal hashes only make a bucket, a colliding stroke isn't a duplicate.
+    QMultiHash<quint64, const InkStroke*> present;
+    present.reserve(m_strokes.size() + inkData.m_strokes.size());
+    for(const auto& stroke : m_strokes)
+    {
+        present.insert(stroke->contentHash(), stroke.data());
+    }
+
     for(auto stroke : inkData.m_strokes)
     {
-        m_strokes.push_back(stroke);
+        const quint64 hash = stroke->contentHash();
+        bool duplicate = false;
+        for(auto it = present.constFind(hash); it != present.constEnd() && it.key() == hash; ++it)
+        {
+            if(*it.value() == *stroke)
+            {
+                duplicate = true;
+                break;
+            }
+        }
+
+        if(!duplicate)
+        {
+            present.insert(hash, stroke.data());
+            m_strokes.push_back(stroke);
+        }
     }
+    m_timeIndexValid = false;
+    m_revision++;
+
+    emit strokesReset();
 }
 
 QString InkData::toJsonString()
 {
-    QJsonArray array;
-    for(auto stroke : m_strokes)
-    {
-        array.append(stroke->toJson());
-    }
+    PROFILE_SCOPE("InkData::toJsonString");
 
-    return QString(QJsonDocument(array).toJson(QJsonDocument::Compact));
+    return snapshot().toJsonString();
+}
+
+InkSnapshot InkData::snapshot() const
+{
+    return InkSnapshot(m_strokes, m_canvasSize, m_revision);
 }
 
 bool InkData::fromJsonString(const QString& jsonStrokes)
 {
+    PROFILE_SCOPE("InkData::fromJsonString");
+
     auto doc = QJsonDocument::fromJson(jsonStrokes.toUtf8());
     clear();
 
@@ -96,8 +197,17 @@ bool InkData::fromJsonString(const QString& jsonStrokes)
     {
         for(auto stroke : doc.array())
         {
-            m_strokes.append(QSharedPointer<InkStroke>::create(stroke.toObject()));
+            auto inkStroke = QSharedPointer<InkStroke>::create(stroke.toObject());
+            if (m_compactStrokes)
+            {
+                inkStroke->compact();
+            }
+            m_strokes.append(inkStroke);
         }
+        m_timeIndexValid = false;
+        m_revision++;
+
+        emit strokesReset();
         return true;
     }
 
@@ -107,11 +217,179 @@ bool InkData::fromJsonString(const QString& jsonStrokes)
 void InkData::clone(const InkData& inkData)
 {
     m_strokes = inkData.m_strokes;
+    m_timeIndexValid = false;
+    m_revision++;
+
+    emit strokesReset();
 }
 
 bool InkData::equal(const InkData& inkData)
 {
-    return (m_strokes == inkData.m_strokes);
+    if (m_strokes.size() != inkData.m_strokes.size())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < m_strokes.size(); i++)
+    {
+        const auto& stroke = m_strokes.at(i);
+        const auto& other = inkData.m_strokes.at(i);
+        // operator== rejects on the content hash first, a match is confirmed on the points.
+        if (stroke != other && !(*stroke == *other))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+QVector<InkStrokeEdit> InkData::diff(const InkData& target) const
+{
+    PROFILE_SCOPE("InkData::diff");
+
+    const QVector<quint64> from = contentHashes(m_strokes);
+    const QVector<quint64> to = contentHashes(target.m_strokes);
+
+    // The hashes only reject: strokes with equal hashes are compared point by point.
+    const auto same = [&](int i, int j) {
+        return from.at(i) == to.at(j) &&
+               (m_strokes.at(i) == target.m_strokes.at(j) || *m_strokes.at(i) == *target.m_strokes.at(j));
+    };
+
+    // Most edits touch a few strokes, skip the common start and end.
+    int prefix = 0;
+    while (prefix < from.size() && prefix < to.size() && same(prefix, prefix))
+    {
+        prefix++;
+    }
+
+    int suffix = 0;
+    while (suffix < from.size() - prefix && suffix < to.size() - prefix &&
+           same(from.size() - 1 - suffix, to.size() - 1 - suffix))
+    {
+        suffix++;
+    }
+
+    // Myers' shortest edit script on the rest. Moving right removes from[x], down inserts to[y].
+    const int n = from.size() - prefix - suffix;
+    const int m = to.size() - prefix - suffix;
+    const int max = n + m;
+
+    QVector<int> v(2 * max + 3, 0);
+    const int offset = max + 1;
+    // Per edit count d, v[-d..d] before the step, for the backtracking.
+    QVector<QVector<int>> trace;
+
+    for (int d = 0; d <= max; d++)
+    {
+        trace.push_back(v.mid(offset - d, 2 * d + 1));
+
+        bool done = false;
+        for (int k = -d; k <= d; k += 2)
+        {
+            int x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1]
+                                                                                  : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && same(prefix + x, prefix + y))
+            {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+
+            if (x >= n && y >= m)
+            {
+                done = true;
+                break;
+            }
+        }
+
+        if (done) break;
+    }
+
+    // Walk back from the end, collecting the steps in reverse: -1 keep, 0 remove, 1 insert.
+    QVector<int> steps;
+    int x = n;
+    int y = m;
+    for (int d = trace.size() - 1; d > 0; d--)
+    {
+        const auto& previous = trace.at(d);
+        const int k = x - y;
+        const int previousK = (k == -d || (k != d && previous.at(k - 1 + d) < previous.at(k + 1 + d))) ? k + 1 : k - 1;
+        const int previousX = previous.at(previousK + d);
+        const int previousY = previousX - previousK;
+
+        while (x > previousX && y > previousY)
+        {
+            steps.push_back(-1);
+            x--;
+            y--;
+        }
+
+        steps.push_back(x == previousX ? 1 : 0);
+        x = previousX;
+        y = previousY;
+    }
+
+    while (x > 0 && y > 0)
+    {
+        steps.push_back(-1);
+        x--;
+        y--;
+    }
+
+    std::reverse(steps.begin(), steps.end());
+
+    QVector<InkStrokeEdit> edits;
+    int position = prefix;
+    int fromIndex = prefix;
+    int toIndex = prefix;
+    for (int step : steps)
+    {
+        if (step == 0)
+        {
+            edits.push_back(InkStrokeEdit{ InkStrokeEdit::Remove, position, m_strokes.at(fromIndex++) });
+        }
+        else if (step == 1)
+        {
+            edits.push_back(InkStrokeEdit{ InkStrokeEdit::Insert, position++, target.m_strokes.at(toIndex++) });
+        }
+        else
+        {
+            position++;
+            fromIndex++;
+            toIndex++;
+        }
+    }
+
+    return edits;
+}
+
+void InkData::applyEdits(const QVector<InkStrokeEdit>& edits, bool notify)
+{
+    PROFILE_SCOPE("InkData::applyEdits");
+
+    if (edits.isEmpty()) return;
+
+    for (const auto& edit : edits)
+    {
+        if (edit.type == InkStrokeEdit::Insert)
+        {
+            m_strokes.insert(edit.index, edit.stroke);
+        }
+        else
+        {
+            m_strokes.removeAt(edit.index);
+        }
+    }
+    m_timeIndexValid = false;
+    m_revision++;
+
+    if (notify)
+    {
+        emit strokesEdited(edits);
+    }
 }
 
 QSharedPointer<InkStroke> InkData::currentStroke() const
@@ -129,6 +407,7 @@ void InkData::setCanvasSize(QSize newSize)
     if (m_canvasSize != newSize)
     {
         m_canvasSize = newSize;
+        m_revision++;
         emit canvasSizeChanged(newSize);
     }
 }
@@ -136,9 +415,74 @@ void InkData::setCanvasSize(QSize newSize)
 void InkData::insertStroke(int index, QSharedPointer<InkStroke> stroke, bool notify)
 {
     m_strokes.insert(index, stroke);
+    m_timeIndexValid = false;
+    m_revision++;
 
     if (notify)
     {
         emit strokeInserted(index, stroke);
     }
 }
+
+InkStrokeSpan InkData::strokeSpan(int index) const
+{
+    const auto& stroke = m_strokes.at(index);
+    if (!stroke->hasTimestamps())
+    {
+        return InkStrokeSpan{ std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::min(), index };
+    }
+
+    return InkStrokeSpan{ stroke->startTime(), stroke->endTime(), index };
+}
+
+void InkData::rebuildTimeIndex()
+{
+    PROFILE_SCOPE("InkData::rebuildTimeIndex");
+
+    m_timeIndex.clear();
+    m_timeIndex.reserve(m_strokes.size());
+    for (int i = 0; i < m_strokes.size(); i++)
+    {
+        m_timeIndex.push_back(strokeSpan(i));
+    }
+
+    std::stable_sort(m_timeIndex.begin(), m_timeIndex.end(), [](const InkStrokeSpan& a, const InkStrokeSpan& b) {
+        return a.start < b.start;
+    });
+
+    m_timeIndexEnds.resize(m_timeIndex.size());
+    qint64 end = std::numeric_limits<qint64>::min();
+    for (int i = 0; i < m_timeIndex.size(); i++)
+    {
+        end = qMax(end, m_timeIndex.at(i).end);
+        m_timeIndexEnds[i] = end;
+    }
+
+    m_timeIndexValid = true;
+}
+
+const QVector<InkStrokeSpan>& InkData::timeIndex()
+{
+    if (!m_timeIndexValid)
+    {
+        rebuildTimeIndex();
+    }
+
+    return m_timeIndex;
+}
+
+int InkData::strokesStartedBy(qint64 time)
+{
+    const auto& index = timeIndex();
+    auto it = std::upper_bound(index.begin(), index.end(), time, [](qint64 t, const InkStrokeSpan& span) {
+        return t < span.start;
+    });
+    return static_cast<int>(it - index.begin());
+}
+
+int InkData::firstUnfinishedAt(qint64 time)
+{
+    timeIndex();
+    auto it = std::upper_bound(m_timeIndexEnds.begin(), m_timeIndexEnds.end(), time);
+    return static_cast<int>(it - m_timeIndexEnds.begin());
+}
@@ -15,8 +15,36 @@
 #include <QRect>
 
 
+#include "ink_snapshot.h"
 #include "ink_stroke.h"
 
+/*! \brief Capture time span of a stroke, see InkData::timeIndex().
+ */
+struct InkStrokeSpan
+{
+    qint64 start;
+    qint64 end;
+    // Index of the stroke in the InkData.
+    int stroke;
+};
+
+/*! \brief One step of an edit script from InkData::diff(). The index is in the document
+ *  as it is when the step is applied, after the steps before it.
+ */
+struct InkStrokeEdit
+{
+    enum Type
+    {
+        Insert,
+        Remove
+    };
+
+    Type type;
+    int index;
+    // The stroke inserted or removed.
+    QSharedPointer<InkStroke> stroke;
+};
+
 class InkData : public QObject
 {
     Q_OBJECT
@@ -55,7 +83,8 @@ public:
      */
     void clear();
 
-    /*! \brief Merge the InkData object's data
+    /*! \brief Merge the InkData object's data.
+     *  Strokes with the same content as one already here are skipped.
      */
     void merge(const InkData& inkData);
 
@@ -70,16 +99,60 @@ public:
 
     void clone(const InkData& inkData);
 
+    /*! \brief Same strokes in the same order, compared by InkStroke::contentHash().
+     */
     bool equal(const InkData& inkData);
 
+    /*! \brief Shortest script of stroke insertions and removals that turns this data into
+     *  target, matching strokes by content hash. O((n + m) d) for d edits, so about linear
+     *  when the documents mostly agree.
+     */
+    QVector<InkStrokeEdit> diff(const InkData& target) const;
+
+    /*! \brief Apply an edit script, e.g. from diff() or the eraser, as one change.
+     *  Listeners get a single strokesEdited() instead of a signal per step.
+     */
+    void applyEdits(const QVector<InkStrokeEdit>& edits, bool notify = true);
+
+    /*! \brief The committed strokes as they are now, O(1).
+     *  Safe to read on another thread, e.g. to save without blocking the GUI thread.
+     */
+    InkSnapshot snapshot() const;
+
+    /*! \brief Incremented by every change of the strokes or the canvas size.
+     */
+    quint64 revision() const { return m_revision; }
+
     void setSaveStroke(bool save) { m_needSave = save; }
+    bool saveStroke() const { return m_needSave; }
 
     QSharedPointer<InkStroke> currentStroke() const;
 
+    /*! \brief Store committed and loaded strokes compactly, see InkStroke::compact().
+     *  Strokes already here or inserted with insertStroke() are left as they are.
+     */
+    void setCompactStrokes(bool compact) { m_compactStrokes = compact; }
+    bool compactStrokes() const { return m_compactStrokes; }
+
     QSize canvasSize();
 
     void setCanvasSize(QSize newSize);
 
+    /*! \brief The strokes ordered by start time, for replay.
+     *  Strokes without timestamps come first and span no time. Appending a stroke keeps the
+     *  index up to date; after other changes it is rebuilt on the next call.
+     */
+    const QVector<InkStrokeSpan>& timeIndex();
+
+    /*! \brief Number of strokes in timeIndex() started at or before time. O(log n).
+     */
+    int strokesStartedBy(qint64 time);
+
+    /*! \brief Position in timeIndex() of the first stroke that may still be drawing at time.
+     *  All strokes before it have ended by then. O(log n).
+     */
+    int firstUnfinishedAt(qint64 time);
+
 signals:
 
     /*! \brief Emit this signal when a ink stroke has been added.
@@ -96,8 +169,22 @@ signals:
 
     void cleared();
 
+    /*! \brief Emit this signal when an edit script has been applied (applyEdits()).
+     *  Replaying the edits in order on the previous strokes gives the current ones.
+     */
+    void strokesEdited(const QVector<InkStrokeEdit>& edits);
+
+    /*! \brief Emit this signal when the strokes have been replaced in bulk
+     *  (fromJsonString, clone, merge). Listeners should reload all strokes.
+     */
+    void strokesReset();
+
     void canvasSizeChanged(QSize newSize);
 
+private:
+    InkStrokeSpan strokeSpan(int index) const;
+    void rebuildTimeIndex();
+
 private:
     QVector<QSharedPointer<InkStroke>> m_strokes;
     QSharedPointer<InkStroke> m_currentStroke;
@@ -107,6 +194,14 @@ private:
      *         but for CaptureWT it can be 1920x1080 for the front facing camera image.
      */
     QSize m_canvasSize;
+
+    QVector<InkStrokeSpan> m_timeIndex;
+    // Running maximum of the end times in m_timeIndex.
+    QVector<qint64> m_timeIndexEnds;
+    bool m_timeIndexValid;
+
+    quint64 m_revision;
+    bool m_compactStrokes;
 };
 
 #endif // INK_DATA_H
@@ -0,0 +1,450 @@
+#include <QLineF>
+#include <QtCore/qsimd.h>
+
+#include <cmath>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "ink_geometry.h"
+
+namespace
+{
+    const float EPSILON = 0.00001;
+
+    inline bool segmentHitsCircle(float px, float py, float qx, float qy, float cx, float cy, float radius2)
+    {
+        const float dx = qx - px;
+        const float dy = qy - py;
+        const float fx = cx - px;
+        const float fy = cy - py;
+        const float t = qBound(0.0f, (fx * dx + fy * dy) / qMax(dx * dx + dy * dy, EPSILON), 1.0f);
+        const float ex = fx - t * dx;
+        const float ey = fy - t * dy;
+        return ex * ex + ey * ey < radius2;
+    }
+
+    /*! \brief Part [enter, exit] of the segment p-q inside the circle, as parameters in [0, 1].
+     */
+    bool segmentInCircle(const QPointF& p, const QPointF& q, const QPointF& center, double radius,
+                         double& enter, double& exit)
+    {
+        const QPointF d = q - p;
+        const QPointF f = p - center;
+        const double a = QPointF::dotProduct(d, d);
+        const double b = 2 * QPointF::dotProduct(f, d);
+        const double c = QPointF::dotProduct(f, f) - radius * radius;
+
+        if (a == 0)
+        {
+            enter = 0;
+            exit = 1;
+            return c < 0;
+        }
+
+        const double discriminant = b * b - 4 * a * c;
+        if (discriminant <= 0)
+        {
+            return false;
+        }
+
+        const double root = std::sqrt(discriminant);
+        const double t1 = (-b - root) / (2 * a);
+        const double t2 = (-b + root) / (2 * a);
+        if (t2 <= 0 || t1 >= 1)
+        {
+            return false;
+        }
+
+        enter = qMax(t1, 0.0);
+        exit = qMin(t2, 1.0);
+        return true;
+    }
+}
+
+InkStrokeGeometry InkStrokeGeometry::fromStroke(const InkStroke& stroke)
+{
+    InkStrokeGeometry geometry;
+    geometry.color = stroke.color();
+    geometry.points = stroke.points();
+    return geometry;
+}
+
+QVector<QPointF> plot_line(QPointF a, QPointF b, float width)
+{
+    QVector<QPointF> ret;
+
+    int x0 = a.x();
+    int y0 = a.y();
+    int x1 = b.x();
+    int y1 = b.y();
+
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy, e2; /* error value e_xy */
+
+    for (;;) {  /* loop */
+        ret.push_back(QPointF(x0, y0));
+        if (x0 == x1 && y0 == y1) break;
+        e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
+        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+    }
+
+    return ret;
+}
+
+QVector<QPointF> interpolation(QPointF a, QPointF b, float width)
+{
+    //width = 2;
+    QVector<QPointF> ret;
+
+    int dx = b.x() - a.x();
+    int dy = b.y() - a.y();
+
+    if (abs(dx) < width && abs(dy) < width)
+    {
+        ret.push_back(a);
+        ret.push_back(b);
+        return ret;
+    }
+
+    QPointF temp;
+
+    bool xDirection = false;
+    bool yDirection = false;
+    float slop_x = 0.0f;
+    float slop_y = 0.0f;
+    if (abs(dy) < EPSILON)
+    {
+        slop_x = dx > 0 ? 1.0 : -1.0;
+        xDirection = true;
+    }
+    if (abs(dx) < EPSILON)
+    {
+        slop_y = dy > 0 ? 1.0 : -1.0;
+        yDirection = true;
+    }
+
+    if (!xDirection && !yDirection)
+    {
+        slop_x = dx > 0 ? 1.0 : -1.0;
+        slop_y = (dy > 0 ? 1.0 : -1.0) * fabs(1.0 * dy / dx);
+    }
+
+    int steps = xDirection ? dx : yDirection ? dy : dx;
+
+    for (int i = 0; i < abs(steps); i+= width)
+    {
+        QPointF c(a.x() + i*slop_x, a.y() + i*slop_y);
+        ret.push_back(c);
+    }
+    
+    return ret;
+}
+
+void appendStrokeMesh(const QVector<QPair<QPoint, int>>& points, const QColor& color,
+                      QVector<QVector3D>& vertices, QVector<QVector3D>& colors,
+                      QVector<quint32>& indices)
+{
+    int ptCount = points.size();
+    if (ptCount < 2) return;
+
+    const quint32 first = vertices.size();
+    const QVector3D rgb(color.redF(), color.greenF(), color.blueF());
+
+    vertices.reserve(vertices.size() + ptCount + 2);
+    colors.reserve(colors.size() + ptCount + 2);
+    indices.reserve(indices.size() + (ptCount - 1) * 4);
+
+    auto vertex = [&points](int i) {
+        return QVector3D(points.at(i).first.x(), points.at(i).first.y(), 0);
+    };
+
+    // first, add an adjacency vertex at the beginning
+    vertices.push_back(2.0f * vertex(0) - vertex(1));
+
+    // next, add all 2D points as 3D vertices
+    for (int i = 0; i < ptCount; i++)
+        vertices.push_back(vertex(i));
+
+    // next, add an adjacency vertex at the end
+    vertices.push_back(2.0f * vertex(ptCount - 1) - vertex(ptCount - 2));
+
+    for (int i = 0; i < ptCount + 2; i++)
+        colors.push_back(rgb);
+
+    // now that we have a list of vertices, create the index buffer
+    for (int i = 1; i < ptCount; ++i)
+    {
+        indices.push_back(first + i - 1);
+        indices.push_back(first + i);
+        indices.push_back(first + i + 1);
+        indices.push_back(first + i + 2);
+    }
+}
+
+bool strokeHitTest(const InkStroke& stroke, const QPoint& pos, int eraserSize)
+{
+    int ptCount = stroke.pointCount();
+    for (int j = 0; j < ptCount; j++)
+    {
+        if (QPoint(pos - stroke.getPoint(j).first).manhattanLength() < eraserSize)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int segmentsHitCircle(const float* xs, const float* ys, int count, float centerX, float centerY,
+                      float radius, quint8* hits)
+{
+    const float radius2 = radius * radius;
+    int hitCount = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128 cx = _mm_set1_ps(centerX);
+    const __m128 cy = _mm_set1_ps(centerY);
+    const __m128 r2 = _mm_set1_ps(radius2);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(EPSILON);
+
+    // Segments i..i+3 use points i..i+4.
+    for (; i + 4 < count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(xs + i);
+        const __m128 py = _mm_loadu_ps(ys + i);
+        const __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i + 1), px);
+        const __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i + 1), py);
+        const __m128 fx = _mm_sub_ps(cx, px);
+        const __m128 fy = _mm_sub_ps(cy, py);
+
+        // Closest point on each segment: t = clamp(f.d / d.d, 0, 1).
+        const __m128 dd = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), epsilon);
+        const __m128 fd = _mm_add_ps(_mm_mul_ps(fx, dx), _mm_mul_ps(fy, dy));
+        const __m128 t = _mm_min_ps(_mm_max_ps(_mm_div_ps(fd, dd), zero), one);
+
+        const __m128 ex = _mm_sub_ps(fx, _mm_mul_ps(t, dx));
+        const __m128 ey = _mm_sub_ps(fy, _mm_mul_ps(t, dy));
+        const __m128 distance2 = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey));
+
+        const int mask = _mm_movemask_ps(_mm_cmplt_ps(distance2, r2));
+        for (int lane = 0; lane < 4; lane++)
+        {
+            hits[i + lane] = (mask >> lane) & 1;
+        }
+        hitCount += ((mask >> 0) & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+#endif
+
+    for (; i + 1 < count; i++)
+    {
+        hits[i] = segmentHitsCircle(xs[i], ys[i], xs[i + 1], ys[i + 1], centerX, centerY, radius2);
+        hitCount += hits[i];
+    }
+
+    return hitCount;
+}
+
+bool eraseStrokePart(const InkStroke& stroke, const QPointF& center, double radius,
+                     QVector<QSharedPointer<InkStroke>>& pieces)
+{
+    pieces.clear();
+
+    const int count = stroke.pointCount();
+    if (count == 0)
+    {
+        return false;
+    }
+
+    // Most strokes on a page are away from the eraser, reject them on the cached bounds.
+    const double reach = radius + stroke.maxWidth() / 2;
+    const QRect bounds = stroke.pointBounds();
+    if (center.x() < bounds.left() - reach || center.x() > bounds.right() + reach ||
+        center.y() < bounds.top() - reach || center.y() > bounds.bottom() + reach)
+    {
+        return false;
+    }
+
+    if (count == 1)
+    {
+        const QPointF offset = QPointF(stroke.getPoint(0).first) - center;
+        return QPointF::dotProduct(offset, offset) < reach * reach;
+    }
+
+    QVector<float> xs(count);
+    QVector<float> ys(count);
+    for (int i = 0; i < count; i++)
+    {
+        const QPoint point = stroke.getPoint(i).first;
+        xs[i] = point.x();
+        ys[i] = point.y();
+    }
+
+    QVector<quint8> hits(count - 1);
+    if (segmentsHitCircle(xs.constData(), ys.constData(), count, center.x(), center.y(), reach, hits.data()) == 0)
+    {
+        return false;
+    }
+
+    // Walk the segments, closing the current piece where one enters the circle and starting
+    // a new one where it leaves.
+    const bool timed = stroke.hasTimestamps();
+    QSharedPointer<InkStroke> piece;
+    bool cut = false;
+
+    auto append = [&](const QPoint& point, double width, qint64 time) {
+        if (!piece)
+        {
+            piece = QSharedPointer<InkStroke>::create(stroke.color());
+            piece->setSmoothed(stroke.isSmoothed());
+        }
+        else if (piece->getPoint(piece->pointCount() - 1).first == point)
+        {
+            return;
+        }
+
+        if (timed)
+        {
+            piece->addPoint(point, width, time);
+        }
+        else
+        {
+            piece->addPoint(point, width);
+        }
+    };
+
+    auto close = [&]() {
+        if (piece && piece->pointCount() >= 2)
+        {
+            pieces.push_back(piece);
+        }
+        piece.reset();
+    };
+
+    InkPoint previous = stroke.point(0);
+    qint64 previousTime = timed ? stroke.timestamp(0) : 0;
+    const QPointF firstOffset = QPointF(previous.point) - center;
+    if (QPointF::dotProduct(firstOffset, firstOffset) >= reach * reach)
+    {
+        append(previous.point, previous.size, previousTime);
+    }
+
+    for (int i = 0; i + 1 < count; i++)
+    {
+        const InkPoint next = stroke.point(i + 1);
+        const qint64 nextTime = timed ? stroke.timestamp(i + 1) : 0;
+
+        auto interpolate = [&](double t) {
+            const QPointF point = QPointF(previous.point) + (QPointF(next.point) - QPointF(previous.point)) * t;
+            append(point.toPoint(), previous.size + (next.size - previous.size) * t,
+                   previousTime + qRound64((nextTime - previousTime) * t));
+        };
+
+        double enter = 1;
+        double exit = 0;
+        if (hits.at(i) && segmentInCircle(previous.point, next.point, center, reach, enter, exit))
+        {
+            cut = true;
+
+            if (piece && enter > 0)
+            {
+                interpolate(enter);
+            }
+            close();
+
+            if (exit < 1)
+            {
+                interpolate(exit);
+                append(next.point, next.size, nextTime);
+            }
+        }
+        else
+        {
+            append(next.point, next.size, nextTime);
+        }
+
+        previous = next;
+        previousTime = nextTime;
+    }
+
+    close();
+
+    if (!cut)
+    {
+        pieces.clear();
+    }
+    return cut;
+}
+
+bool strokeTouchesPolygon(const InkStroke& stroke, const QPolygonF& polygon)
+{
+    const int count = stroke.pointCount();
+    if (count == 0 || polygon.size() < 3)
+    {
+        return false;
+    }
+
+    const QRectF polygonBounds = polygon.boundingRect();
+
+    for (int i = 0; i < count; i++)
+    {
+        const QPointF point = stroke.getPoint(i).first;
+        if (polygonBounds.contains(point) && polygon.containsPoint(point, Qt::OddEvenFill))
+        {
+            return true;
+        }
+    }
+
+    // No point inside: a segment may still cross a thin part of the polygon.
+    for (int i = 0; i + 1 < count; i++)
+    {
+        const QLineF segment(stroke.getPoint(i).first, stroke.getPoint(i + 1).first);
+        if (!QRectF(segment.p1(), segment.p2()).normalized().adjusted(-1, -1, 1, 1).intersects(polygonBounds))
+        {
+            continue;
+        }
+
+        for (int j = 0; j < polygon.size(); j++)
+        {
+            const QLineF edge(polygon.at(j), polygon.at((j + 1) % polygon.size()));
+            if (segment.intersect(edge, nullptr) == QLineF::BoundedIntersection)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void drawStrokeGeometry(QPainter& painter, const InkStrokeGeometry& stroke)
+{
+    const auto& points = stroke.points;
+    if (points.isEmpty()) return;
+
+    QPen pen(stroke.color);
+    pen.setJoinStyle(Qt::RoundJoin);
+    pen.setCapStyle(Qt::RoundCap);
+
+    if (points.size() == 1)
+    {
+        pen.setWidth(points.first().second);
+        painter.setPen(pen);
+        painter.drawPoint(points.first().first);
+        return;
+    }
+
+    for (int i = 1; i < points.size(); i++)
+    {
+        pen.setWidth(points.at(i).second);
+        painter.setPen(pen);
+        painter.drawLine(points.at(i - 1).first, points.at(i).first);
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef INK_GEOMETRY_H
+#define INK_GEOMETRY_H
+
+#include <QColor>
+#include <QPainter>
+#include <QPair>
+#include <QPoint>
+#include <QPointF>
+#include <QPolygonF>
+#include <QSharedPointer>
+#include <QVector>
+#include <QVector3D>
+
+#include "ink_stroke.h"
+
+/*! \brief Value copy of the stroke data needed to render it, safe to hand to other threads.
+ */
+struct InkStrokeGeometry
+{
+    QColor color;
+    QVector<QPair<QPoint, int>> points;
+
+    static InkStrokeGeometry fromStroke(const InkStroke& stroke);
+};
+
+/*! \brief Rasterize the line a-b with Bresenham's algorithm.
+ */
+QVector<QPointF> plot_line(QPointF a, QPointF b, float width);
+
+/*! \brief Interpolate points from a to b with a step of width.
+ */
+QVector<QPointF> interpolation(QPointF a, QPointF b, float width);
+
+/*! \brief Append the lines-adjacency mesh of a stroke for the line geometry shader.
+ *  \param points Stroke points. Nothing is appended for less than 2 points.
+ *  \param color Vertex color of the stroke.
+ *  \param vertices, colors Vertex attributes, one adjacency vertex is added at each end.
+ *  \param indices GL_LINES_ADJACENCY indices of the stroke segments, relative to vertices.
+ */
+void appendStrokeMesh(const QVector<QPair<QPoint, int>>& points, const QColor& color,
+                      QVector<QVector3D>& vertices, QVector<QVector3D>& colors,
+                      QVector<quint32>& indices);
+
+/*! \brief Does the eraser at pos touch the stroke?
+ *  A point is touched when its manhattan distance to pos is less than eraserSize.
+ */
+bool strokeHitTest(const InkStroke& stroke, const QPoint& pos, int eraserSize);
+
+/*! \brief Which segments of a polyline come closer than radius to center.
+ *  Points are given as separate x and y arrays; 4 segments are tested per step with SSE2 where
+ *  available.
+ *  \param hits Receives count - 1 flags, 1 for each segment i-(i+1) that is hit.
+ *  \return Number of segments hit.
+ */
+int segmentsHitCircle(const float* xs, const float* ys, int count, float centerX, float centerY,
+                      float radius, quint8* hits);
+
+/*! \brief Cut the part the eraser circle touches out of the stroke.
+ *  The stroke is cut where its center line comes within radius plus half its widest point of
+ *  center, at the exact circle crossings. Strokes away from the eraser cost one bounds check.
+ *  \param pieces Receives the remaining pieces of at least 2 points, with interpolated widths
+ *  and timestamps at the cuts. Empty when the whole stroke is erased.
+ *  \return False when the eraser doesn't touch the stroke.
+ */
+bool eraseStrokePart(const InkStroke& stroke, const QPointF& center, double radius,
+                     QVector<QSharedPointer<InkStroke>>& pieces);
+
+/*! \brief Does any part of the stroke's center line lie inside the polygon?
+ *  True when a point is inside or a segment crosses the polygon's outline.
+ */
+bool strokeTouchesPolygon(const InkStroke& stroke, const QPolygonF& polygon);
+
+/*! \brief Draw the stroke as line segments with round caps, each as wide as its end point.
+ *  Unlike InkStroke::draw() this doesn't need the InkStroke object, so it works on any thread.
+ */
+void drawStrokeGeometry(QPainter& painter, const InkStrokeGeometry& stroke);
+
+#endif // INK_GEOMETRY_H
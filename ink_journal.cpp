@@ -0,0 +1,510 @@
+#include <QTimer>
+
+#include "binary_codec.h"
+#include "frame_profiler.h"
+#include "ink_data.h"
+#include "ink_journal.h"
+
+namespace
+{
+    const quint8 JOURNAL_VERSION = 1;
+
+    enum JournalOperation : quint8
+    {
+        // Color (QRgb), flags. Starts the stroke being drawn.
+        BeginStroke = 1,
+        // Count, points. Appended to the stroke being drawn.
+        AppendPoints = 2,
+        CommitStroke = 3,
+        // The source didn't keep the drawn stroke.
+        DiscardStroke = 4,
+        // Index, stroke.
+        InsertStroke = 5,
+        // Index.
+        RemoveStroke = 6,
+        Clear = 7,
+        // Canvas width, height, stroke count, strokes. Replaces the document.
+        Reset = 8,
+        // Width, height.
+        CanvasSize = 9
+    };
+
+    const quint8 STROKE_TIMED = 0x1;
+
+    // Fixed point scale of the pen width.
+    const double WIDTH_SCALE = 64.0;
+
+    void appendPoint(QByteArray& out, const QPoint& point, double width, QPoint& lastPoint)
+    {
+        appendZigzag(out, point.x() - lastPoint.x());
+        appendZigzag(out, point.y() - lastPoint.y());
+        appendVarint(out, static_cast<quint64>(qMax<qint64>(0, qRound64(width * WIDTH_SCALE))));
+        lastPoint = point;
+    }
+
+    void readPoint(BinaryReader& reader, QPoint& point, double& width)
+    {
+        point += QPoint(static_cast<int>(reader.readZigzag()), static_cast<int>(reader.readZigzag()));
+        width = reader.readVarint() / WIDTH_SCALE;
+    }
+
+    // Drop the stroke being drawn. Listeners see a stroke that wasn't kept.
+    void discardCurrentStroke(InkData& data)
+    {
+        const bool save = data.saveStroke();
+        data.setSaveStroke(false);
+        data.addCurrentStroke();
+        data.setSaveStroke(save);
+    }
+}
+
+InkJournal::InkJournal(QSharedPointer<InkData> source, QObject* parent)
+    : QObject(parent)
+    , m_source(source)
+    , m_lastTime(0)
+    , m_timed(false)
+    , m_sequence(0)
+{
+    m_batchTimer.setSingleShot(true);
+    m_batchTimer.setInterval(DEFAULT_BATCH_INTERVAL_MS);
+    connect(&m_batchTimer, &QTimer::timeout, this, &InkJournal::flush);
+
+    connect(m_source.data(), &InkData::strokeAdded, this, &InkJournal::onStrokeAdded);
+    connect(m_source.data(), &InkData::strokeRemoved, this, &InkJournal::onStrokeRemoved);
+    connect(m_source.data(), &InkData::strokeInserted, this, &InkJournal::onStrokeInserted);
+    connect(m_source.data(), &InkData::strokesEdited, this, &InkJournal::onStrokesEdited);
+    connect(m_source.data(), &InkData::cleared, this, &InkJournal::onCleared);
+    connect(m_source.data(), &InkData::strokesReset, this, &InkJournal::sendSnapshot);
+    connect(m_source.data(), &InkData::canvasSizeChanged, this, &InkJournal::onCanvasSizeChanged);
+
+    watchCurrentStroke(m_source->currentStroke());
+}
+
+void InkJournal::setBatchInterval(int milliseconds)
+{
+    m_batchTimer.setInterval(milliseconds);
+}
+
+void InkJournal::appendStroke(QByteArray& out, const InkStroke& stroke)
+{
+    const bool timed = stroke.hasTimestamps();
+    const int count = stroke.pointCount();
+
+    appendVarint(out, stroke.color().rgba());
+    out.append(static_cast<char>(timed ? STROKE_TIMED : 0));
+    appendVarint(out, count);
+
+    QPoint lastPoint;
+    qint64 lastTime = 0;
+    for (int i = 0; i < count; i++)
+    {
+        // point() has the exact width, getPoint() a truncated one.
+        const InkPoint point = stroke.point(i);
+        appendPoint(out, point.point, point.size, lastPoint);
+
+        if (timed)
+        {
+            const qint64 time = stroke.timestamp(i);
+            appendZigzag(out, time - lastTime);
+            lastTime = time;
+        }
+    }
+}
+
+QSharedPointer<InkStroke> InkJournal::readStroke(BinaryReader& reader)
+{
+    auto stroke = QSharedPointer<InkStroke>::create(QColor::fromRgba(static_cast<QRgb>(reader.readVarint())));
+    const bool timed = reader.readByte() & STROKE_TIMED;
+    const quint64 count = reader.readVarint();
+
+    QPoint point;
+    double width = 0;
+    qint64 time = 0;
+    for (quint64 i = 0; i < count && !reader.hasError(); i++)
+    {
+        readPoint(reader, point, width);
+        if (timed)
+        {
+            time += reader.readZigzag();
+            stroke->addPoint(point, width, time);
+        }
+        else
+        {
+            stroke->addPoint(point, width);
+        }
+    }
+
+    return stroke;
+}
+
+void InkJournal::watchCurrentStroke(QSharedPointer<InkStroke> stroke)
+{
+    disconnect(m_currentStrokeConnection);
+
+    m_currentStroke = stroke;
+    m_currentStrokeConnection = connect(stroke.data(), &InkStroke::pointAdded, this, &InkJournal::onPointAdded);
+}
+
+void InkJournal::onPointAdded(const QPoint& point, double width)
+{
+    if (m_currentStroke->pointCount() == 1)
+    {
+        appendPendingPoints();
+
+        m_timed = m_currentStroke->hasTimestamps();
+        m_lastPoint = QPoint();
+        m_lastTime = 0;
+
+        m_operations.append(static_cast<char>(BeginStroke));
+        appendVarint(m_operations, m_currentStroke->color().rgba());
+        m_operations.append(static_cast<char>(m_timed ? STROKE_TIMED : 0));
+    }
+
+    m_points.push_back(PendingPoint{ point, width, m_timed ? m_currentStroke->endTime() : 0 });
+    m_stats.points++;
+
+    // A point takes 3-5 bytes.
+    if (m_operations.size() + m_points.size() * 4 >= MAX_BATCH_BYTES)
+    {
+        flush();
+    }
+    else if (!m_batchTimer.isActive())
+    {
+        m_batchTimer.start();
+    }
+}
+
+void InkJournal::onStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke)
+{
+    appendPendingPoints();
+
+    const int count = m_source->strokeCount();
+    if (count > 0 && m_source->stroke(count - 1) == addedStroke)
+    {
+        m_operations.append(static_cast<char>(CommitStroke));
+        m_stats.strokes++;
+    }
+    else
+    {
+        m_operations.append(static_cast<char>(DiscardStroke));
+    }
+    send();
+
+    watchCurrentStroke(newStroke);
+}
+
+void InkJournal::onStrokeRemoved(int index)
+{
+    appendPendingPoints();
+    m_operations.append(static_cast<char>(RemoveStroke));
+    appendVarint(m_operations, index);
+    send();
+}
+
+void InkJournal::onStrokeInserted(int index, QSharedPointer<InkStroke> stroke)
+{
+    appendPendingPoints();
+    m_operations.append(static_cast<char>(InsertStroke));
+    appendVarint(m_operations, index);
+    appendStroke(m_operations, *stroke);
+    m_stats.strokes++;
+    send();
+}
+
+void InkJournal::onStrokesEdited(const QVector<InkStrokeEdit>& edits)
+{
+    // All in one message, mirrors never show half an edit.
+    appendPendingPoints();
+    for (const auto& edit : edits)
+    {
+        if (edit.type == InkStrokeEdit::Insert)
+        {
+            m_operations.append(static_cast<char>(InsertStroke));
+            appendVarint(m_operations, edit.index);
+            appendStroke(m_operations, *edit.stroke);
+            m_stats.strokes++;
+        }
+        else
+        {
+            m_operations.append(static_cast<char>(RemoveStroke));
+            appendVarint(m_operations, edit.index);
+        }
+    }
+    send();
+}
+
+void InkJournal::onCleared()
+{
+    appendPendingPoints();
+    m_operations.append(static_cast<char>(Clear));
+    send();
+}
+
+void InkJournal::onCanvasSizeChanged(QSize size)
+{
+    appendPendingPoints();
+    m_operations.append(static_cast<char>(CanvasSize));
+    appendVarint(m_operations, qMax(0, size.width()));
+    appendVarint(m_operations, qMax(0, size.height()));
+    send();
+}
+
+void InkJournal::sendSnapshot()
+{
+    PROFILE_SCOPE("InkJournal::sendSnapshot");
+
+    // The snapshot supersedes everything not sent yet.
+    m_operations.clear();
+    m_points.clear();
+
+    const QSize canvasSize = m_source->canvasSize();
+    const int count = m_source->strokeCount();
+
+    m_operations.append(static_cast<char>(Reset));
+    appendVarint(m_operations, qMax(0, canvasSize.width()));
+    appendVarint(m_operations, qMax(0, canvasSize.height()));
+    appendVarint(m_operations, count);
+    for (int i = 0; i < count; i++)
+    {
+        appendStroke(m_operations, *m_source->stroke(i));
+    }
+
+    // Then the stroke being drawn, so later appends continue it.
+    const InkStroke& current = *m_currentStroke;
+    m_timed = current.hasTimestamps();
+    m_lastPoint = QPoint();
+    m_lastTime = 0;
+
+    if (current.pointCount() > 0)
+    {
+        m_operations.append(static_cast<char>(BeginStroke));
+        appendVarint(m_operations, current.color().rgba());
+        m_operations.append(static_cast<char>(m_timed ? STROKE_TIMED : 0));
+
+        for (int i = 0; i < current.pointCount(); i++)
+        {
+            m_points.push_back(PendingPoint{ current.point(i).point, current.point(i).size,
+                                             m_timed ? current.timestamp(i) : 0 });
+        }
+        appendPendingPoints();
+    }
+
+    send();
+}
+
+void InkJournal::flush()
+{
+    appendPendingPoints();
+
+    if (!m_operations.isEmpty())
+    {
+        send();
+    }
+}
+
+void InkJournal::appendPendingPoints()
+{
+    if (m_points.isEmpty()) return;
+
+    m_operations.append(static_cast<char>(AppendPoints));
+    appendVarint(m_operations, m_points.size());
+
+    for (const auto& pending : m_points)
+    {
+        appendPoint(m_operations, pending.point, pending.width, m_lastPoint);
+
+        if (m_timed)
+        {
+            appendZigzag(m_operations, pending.timestamp - m_lastTime);
+            m_lastTime = pending.timestamp;
+        }
+    }
+
+    m_points.clear();
+}
+
+void InkJournal::send()
+{
+    QByteArray message;
+    message.reserve(m_operations.size() + 4);
+    message.append(static_cast<char>(JOURNAL_VERSION));
+    appendVarint(message, m_sequence++);
+    message.append(m_operations);
+
+    m_operations.clear();
+    m_batchTimer.stop();
+
+    m_stats.messages++;
+    m_stats.bytes += message.size();
+
+    emit messageReady(message);
+}
+
+InkJournalApplier::InkJournalApplier(QSharedPointer<InkData> target, QObject* parent)
+    : QObject(parent)
+    , m_target(target)
+    , m_nextSequence(0)
+    , m_synchronized(true)
+    , m_lastTime(0)
+    , m_timed(false)
+{ }
+
+bool InkJournalApplier::apply(const QByteArray& message)
+{
+    PROFILE_SCOPE("InkJournalApplier::apply");
+
+    BinaryReader reader(message);
+    if (reader.readByte() != JOURNAL_VERSION)
+    {
+        return false;
+    }
+
+    const quint64 sequence = reader.readVarint();
+    const bool snapshot = !reader.atEnd() && static_cast<quint8>(message.at(reader.position())) == Reset;
+
+    if (!snapshot && (!m_synchronized || sequence != m_nextSequence))
+    {
+        if (m_synchronized)
+        {
+            m_synchronized = false;
+            emit sequenceGap(m_nextSequence, sequence);
+        }
+        return false;
+    }
+
+    bool malformed = false;
+    while (!reader.atEnd() && !reader.hasError() && !malformed)
+    {
+        switch (reader.readByte())
+        {
+        case BeginStroke:
+        {
+            const QColor color = QColor::fromRgba(static_cast<QRgb>(reader.readVarint()));
+            m_timed = reader.readByte() & STROKE_TIMED;
+            m_lastPoint = QPoint();
+            m_lastTime = 0;
+            m_target->currentStroke()->setColor(color);
+            break;
+        }
+        case AppendPoints:
+        {
+            auto stroke = m_target->currentStroke();
+            const quint64 count = reader.readVarint();
+            double width = 0;
+
+            for (quint64 i = 0; i < count && !reader.hasError(); i++)
+            {
+                readPoint(reader, m_lastPoint, width);
+                if (m_timed)
+                {
+                    m_lastTime += reader.readZigzag();
+                    stroke->addPoint(m_lastPoint, width, m_lastTime);
+                }
+                else
+                {
+                    stroke->addPoint(m_lastPoint, width);
+                }
+            }
+            break;
+        }
+        case CommitStroke:
+            m_target->addCurrentStroke();
+            break;
+        case DiscardStroke:
+            discardCurrentStroke(*m_target);
+            break;
+        case InsertStroke:
+        {
+            const quint64 index = reader.readVarint();
+            auto stroke = InkJournal::readStroke(reader);
+            if (!reader.hasError() && index <= static_cast<quint64>(m_target->strokeCount()))
+            {
+                m_target->insertStroke(static_cast<int>(index), stroke, true);
+            }
+            break;
+        }
+        case RemoveStroke:
+        {
+            const quint64 index = reader.readVarint();
+            if (!reader.hasError() && index < static_cast<quint64>(m_target->strokeCount()))
+            {
+                m_target->removeStroke(static_cast<int>(index));
+            }
+            break;
+        }
+        case Clear:
+            m_target->clear();
+            break;
+        case Reset:
+        {
+            const int width = static_cast<int>(reader.readVarint());
+            const int height = static_cast<int>(reader.readVarint());
+            const quint64 count = reader.readVarint();
+
+            InkData data;
+            for (quint64 i = 0; i < count && !reader.hasError(); i++)
+            {
+                data.insertStroke(data.strokeCount(), InkJournal::readStroke(reader), false);
+            }
+
+            if (!reader.hasError())
+            {
+                discardCurrentStroke(*m_target);
+                m_target->setCanvasSize(QSize(width, height));
+                m_target->clone(data);
+            }
+            break;
+        }
+        case CanvasSize:
+        {
+            const int width = static_cast<int>(reader.readVarint());
+            const int height = static_cast<int>(reader.readVarint());
+            m_target->setCanvasSize(QSize(width, height));
+            break;
+        }
+        default:
+            malformed = true;
+            break;
+        }
+    }
+
+    if (reader.hasError() || malformed)
+    {
+        // Malformed, the mirror can't be trusted any more.
+        m_synchronized = false;
+        emit sequenceGap(m_nextSequence, sequence);
+        return false;
+    }
+
+    m_nextSequence = sequence + 1;
+    m_synchronized = true;
+    return true;
+}
+
+LoopbackTransport::LoopbackTransport(int latencyMs, QObject* parent)
+    : InkJournalTransport(parent)
+    , m_latencyMs(latencyMs)
+    , m_lossInterval(0)
+    , m_messages(0)
+    , m_bytesSent(0)
+{ }
+
+void LoopbackTransport::send(const QByteArray& message)
+{
+    m_messages++;
+    if (m_lossInterval > 0 && m_messages % m_lossInterval == 0)
+    {
+        return;
+    }
+
+    m_bytesSent += message.size();
+
+    if (m_latencyMs <= 0)
+    {
+        emit received(message);
+    }
+    else
+    {
+        QTimer::singleShot(m_latencyMs, this, [this, message]() { emit received(message); });
+    }
+}
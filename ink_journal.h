@@ -0,0 +1,183 @@
+#ifndef INK_JOURNAL_H
+#define INK_JOURNAL_H
+
+#include <QByteArray>
+#include <QMetaObject>
+#include <QObject>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QSize>
+#include <QTimer>
+#include <QVector>
+
+class BinaryReader;
+class InkData;
+class InkStroke;
+struct InkStrokeEdit;
+
+/*! \brief Turns the changes of an InkData into compact binary messages for mirroring it
+ *  on other stations with InkJournalApplier.
+ *
+ *  Message layout: a version byte, the varint sequence number, then operations. Each operation
+ *  is an opcode byte followed by varints. Points are zigzag deltas from the previous point of
+ *  the stroke, the width is in 1/64 px and timestamps are ms deltas. Points appended to the
+ *  stroke being drawn are batched for batchInterval ms; every other change flushes them and goes
+ *  out at once, in order. A typical drawn point takes 3-4 bytes.
+ */
+class InkJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        quint64 messages = 0;
+        quint64 bytes = 0;
+        quint64 points = 0;
+        // Strokes committed or inserted.
+        quint64 strokes = 0;
+    };
+
+    static const int DEFAULT_BATCH_INTERVAL_MS = 16;
+    // Flush the points early when the batch reaches this size (about one datagram).
+    static const int MAX_BATCH_BYTES = 1200;
+
+    explicit InkJournal(QSharedPointer<InkData> source, QObject* parent = nullptr);
+
+    void setBatchInterval(int milliseconds);
+
+    Stats stats() const { return m_stats; }
+
+    /*! \brief Encode or decode a whole stroke (color, flags, points), as in insert and reset operations.
+     */
+    static void appendStroke(QByteArray& out, const InkStroke& stroke);
+    static QSharedPointer<InkStroke> readStroke(BinaryReader& reader);
+
+public slots:
+    /*! \brief Send the whole document, e.g. to a station that joined or missed messages.
+     */
+    void sendSnapshot();
+
+    /*! \brief Send the batched points now.
+     */
+    void flush();
+
+signals:
+    void messageReady(const QByteArray& message);
+
+private slots:
+    void onStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke);
+    void onStrokeRemoved(int index);
+    void onStrokeInserted(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokesEdited(const QVector<InkStrokeEdit>& edits);
+    void onCleared();
+    void onCanvasSizeChanged(QSize size);
+    void onPointAdded(const QPoint& point, double width);
+
+private:
+    struct PendingPoint
+    {
+        QPoint point;
+        double width;
+        qint64 timestamp;
+    };
+
+    void watchCurrentStroke(QSharedPointer<InkStroke> stroke);
+    void appendPendingPoints();
+    void send();
+
+private:
+    QSharedPointer<InkData> m_source;
+    QSharedPointer<InkStroke> m_currentStroke;
+    QMetaObject::Connection m_currentStrokeConnection;
+
+    // Operations not sent yet.
+    QByteArray m_operations;
+    QVector<PendingPoint> m_points;
+    QTimer m_batchTimer;
+
+    // Last point and time already encoded for the current stroke.
+    QPoint m_lastPoint;
+    qint64 m_lastTime;
+    bool m_timed;
+
+    quint64 m_sequence;
+    Stats m_stats;
+};
+
+/*! \brief Applies InkJournal messages to a mirror InkData.
+ *
+ *  Messages must arrive in sequence. After a gap the applier drops messages until a snapshot
+ *  arrives and emits sequenceGap() so the sender can be asked for one (InkJournal::sendSnapshot()).
+ *  Mirrored widths are rounded to 1/64 px.
+ */
+class InkJournalApplier : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InkJournalApplier(QSharedPointer<InkData> target, QObject* parent = nullptr);
+
+    QSharedPointer<InkData> target() const { return m_target; }
+
+public slots:
+    /*! \return False when the message was dropped (gap, malformed).
+     */
+    bool apply(const QByteArray& message);
+
+signals:
+    void sequenceGap(quint64 expected, quint64 received);
+
+private:
+    QSharedPointer<InkData> m_target;
+    quint64 m_nextSequence;
+    bool m_synchronized;
+
+    // Decoder state of the stroke being drawn.
+    QPoint m_lastPoint;
+    qint64 m_lastTime;
+    bool m_timed;
+};
+
+/*! \brief Carries journal messages between stations.
+ */
+class InkJournalTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InkJournalTransport(QObject* parent = nullptr) : QObject(parent) { }
+
+public slots:
+    virtual void send(const QByteArray& message) = 0;
+
+signals:
+    void received(const QByteArray& message);
+};
+
+/*! \brief In-process transport for tests and benchmarks.
+ *  Delivers synchronously, or after a latency through the event loop. Can lose every n-th
+ *  message to exercise the gap handling.
+ */
+class LoopbackTransport : public InkJournalTransport
+{
+    Q_OBJECT
+
+public:
+    explicit LoopbackTransport(int latencyMs = 0, QObject* parent = nullptr);
+
+    void setLossInterval(int interval) { m_lossInterval = interval; }
+
+    quint64 bytesSent() const { return m_bytesSent; }
+
+public slots:
+    void send(const QByteArray& message) override;
+
+private:
+    int m_latencyMs;
+    int m_lossInterval;
+    quint64 m_messages;
+    quint64 m_bytesSent;
+};
+
+#endif // INK_JOURNAL_H
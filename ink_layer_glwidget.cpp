@@ -1,128 +1,26 @@
 ﻿#include "ink_layer_glwidget.h"
 
-#include <QOpenGLShaderProgram>
-#include <QOpenGLTexture>
 #include <QMouseEvent>
-#include <QTime>
+
+#include "frame_profiler.h"
+#include "ink_geometry.h"
 
 #define GL_GLEXT_PROTOTYPES
 
-const int PROGRAM_VERTEX_ATTRIBUTE = 0;
-const int PROGRAM_COLOR_ATTRIBUTE = 1;
 const int SMALL_PEN_SIZE = 10;
 const int ERASER_SIZE = 30;
-const int BASE_PRESSURE = (1024 / 2);
+// Pressure that draws with the base pen width.
+const float NOMINAL_PRESSURE = 0.5f;
+#ifdef Q_OS_WIN
+const float POINTER_MAX_PRESSURE = 1024.0f;
+#endif
 
 const int CIRCLE_POINTS_NUM = 100;
-const float EPSILON = 0.00001;
-const int VBO_SIZE = 1000000;
-
-QString loadProgram(QString fileLocation)
-{
-    QFile file(fileLocation);
-    file.open(QFile::ReadOnly);
-    return file.readAll();
-}
-
-QString vertexProgram()
-{
-    return loadProgram("./assets/shaders/lines.vert");
-}
-
-QString fragProgram()
-{
-    return loadProgram("./assets/shaders/lines.frag");
-}
-
-QString geomProgram()
-{
-    return loadProgram("./assets/shaders/lines1.geom");
-}
-
-QImage loadTexture()
-{
-    return QImage("./assets/textures/pattern1.png");
-}
-
-
-QVector<QPointF> plot_line(QPointF a, QPointF b, float width)
-{
-    QVector<QPointF> ret;
-
-    int x0 = a.x();
-    int y0 = a.y();
-    int x1 = b.x();
-    int y1 = b.y();
-
-    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
-    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
-    int err = dx + dy, e2; /* error value e_xy */
-
-    for (;;) {  /* loop */
-        ret.push_back(QPointF(x0, y0));
-        if (x0 == x1 && y0 == y1) break;
-        e2 = 2 * err;
-        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
-        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
-    }
-
-    return ret;
-}
-
-QVector<QPointF> interpolation(QPointF a, QPointF b, float width)
-{
-    //width = 2;
-    QVector<QPointF> ret;
-
-    int dx = b.x() - a.x();
-    int dy = b.y() - a.y();
-
-    if (abs(dx) < width && abs(dy) < width)
-    {
-        ret.push_back(a);
-        ret.push_back(b);
-        return ret;
-    }
-
-    QPointF temp;
-
-    bool xDirection = false;
-    bool yDirection = false;
-    float slop_x = 0.0f;
-    float slop_y = 0.0f;
-    if (abs(dy) < EPSILON)
-    {
-        slop_x = dx > 0 ? 1.0 : -1.0;
-        xDirection = true;
-    }
-    if (abs(dx) < EPSILON)
-    {
-        slop_y = dy > 0 ? 1.0 : -1.0;
-        yDirection = true;
-    }
-
-    if (!xDirection && !yDirection)
-    {
-        slop_x = dx > 0 ? 1.0 : -1.0;
-        slop_y = (dy > 0 ? 1.0 : -1.0) * fabs(1.0 * dy / dx);
-    }
-
-    int steps = xDirection ? dx : yDirection ? dy : dx;
-
-    for (int i = 0; i < abs(steps); i+= width)
-    {
-        QPointF c(a.x() + i*slop_x, a.y() + i*slop_y);
-        ret.push_back(c);
-    }
-    
-    return ret;
-}
 
 InkLayerGLWidget::InkLayerGLWidget(QWidget* mockParent, QWidget *parent)
     : QOpenGLWidget(parent),
     m_mockParent(mockParent),
     m_clearColor(Qt::black),
-    m_program(new QOpenGLShaderProgram),
     m_color(Qt::yellow)
     , m_basePenWidth(SMALL_PEN_SIZE)
     , m_eraserSize(ERASER_SIZE)
@@ -132,10 +30,13 @@ InkLayerGLWidget::InkLayerGLWidget(QWidget* mockParent, QWidget *parent)
     , m_penDrawing(false)
     , m_enablePen(true)
     , m_enableRemoveStroke(true)
+    , m_partialEraser(true)
+    , m_smoothing(true)
+    , m_strokeSmoothing(true)
     , m_mouseDrawing(false)
     , m_penPointColor(Qt::black)
     , m_strokes(new InkData())
-    , m_vertex_index(0)
+    , m_readback(new PixelReadback(this))
 {
     setWindowFlags(Qt::SubWindow);
     setAutoFillBackground(false);
@@ -151,26 +52,19 @@ InkLayerGLWidget::InkLayerGLWidget(QWidget* mockParent, QWidget *parent)
 
     m_mockParent = this;
 
-    // and get prepared to adapt if main window get resized
-    connect(m_mockParent, SIGNAL(penHoverEntered(const POINTER_PEN_INFO&)),
-        this, SLOT(onPenHoverEntered(const POINTER_PEN_INFO&)));
-    connect(m_mockParent, SIGNAL(penHoverExited(const POINTER_PEN_INFO&)),
-        this, SLOT(onPenHoverExited(const POINTER_PEN_INFO&)));
-    connect(m_mockParent, SIGNAL(penPressDown(const POINTER_PEN_INFO&)),
-        this, SLOT(onPenDown(const POINTER_PEN_INFO&)));
-    connect(m_mockParent, SIGNAL(penPressUp(const POINTER_PEN_INFO&)),
-        this, SLOT(onPenUp(const POINTER_PEN_INFO&)));
-    connect(m_mockParent, SIGNAL(penMove(const POINTER_PEN_INFO&)),
-        this, SLOT(onPenMove(const POINTER_PEN_INFO&)));
+    qRegisterMetaType<PenSample>();
+    m_guiPenInput = createPenInput();
 
     setInkData(m_strokes);
 }
 
 InkLayerGLWidget::~InkLayerGLWidget()
 {
+    stopRenderThread();
+
     makeCurrent();
-    m_color_vbo.destroy();
-    m_mesh_vbo.destroy();
+    m_readback->releaseResources();
+    m_blit.destroy();
     doneCurrent();
 }
 
@@ -184,151 +78,86 @@ void InkLayerGLWidget::initializeGL()
 {
     initializeOpenGLFunctions();
 
-    m_textures = QSharedPointer<QOpenGLTexture>::create(loadTexture());
+    m_blit.create();
+
+    // One started by startOffscreenRendering() doesn't share our context.
+    stopRenderThread();
+    startRenderThread();
+}
 
-    m_color_vbo.create();
-    m_color_vbo.setUsagePattern(QOpenGLBuffer::DynamicCopy);
-    m_color_vbo.bind();
-    m_vertColors.resize(VBO_SIZE);
-    for (int i = 0; i < VBO_SIZE; i++)
+void InkLayerGLWidget::startOffscreenRendering()
+{
+    if (!m_renderThread)
     {
-        m_vertColors[i] = { 1.0f, 1.0f,0.0f };
+        startRenderThread();
     }
-    m_color_vbo.allocate(m_vertColors.constData(), m_vertColors.count() * sizeof(QVector3D));
-
-    m_mesh_vbo.create();
-    m_mesh_vbo.setUsagePattern(QOpenGLBuffer::DynamicCopy);
-    m_mesh_vbo.bind();
-    m_vertices.resize(VBO_SIZE);
-    m_mesh_vbo.allocate(m_vertices.constData(), m_vertices.count() * sizeof(QVector3D));
-
-    glEnable(GL_DEPTH_TEST);
-
-    //glEnable(GL_LINE_SMOOTH);
-    ////glShadeModel(GL_FLAT);
-    //glEnable(GL_POINT_SMOOTH);
-    //glHint(GL_POINT_SMOOTH, GL_NICEST);
-    //glEnable(GL_POLYGON_SMOOTH);
-    //glHint(GL_POLYGON_SMOOTH_HINT, GL_NICEST);
-    //glEnable(GL_MULTISAMPLE);
-
-    //glDisable(GL_LIGHT0);
-    //glDisable(GL_LIGHTING);
-    //glDisable(GL_TEXTURE_2D);
-    //glDisable(GL_BLEND);
-
-    //glPolygonMode(GL_BACK, GL_FILL);
-
-    //glEnable(GL_BLEND);
-    //glBlendFunc(GL_DST_ALPHA, GL_ONE);
-    //glBlendFunc(GL_DST_ALPHA, GL_ONE);
-
-
-    //When you switch the Y-axis direction every front-face becomes a back-face, 
-    //so that means you need to either disable face-culling or change the winding of the front-face.
-    //glFrontFace(GL_BACK);
-    
-    //glDisable(GL_CULL_FACE);
-    //glEnable(GL_FRONT_FACE);
-
-    QOpenGLShader *vshader = new QOpenGLShader(QOpenGLShader::Vertex, this);
-    QString vsrc = vertexProgram();
-    vshader->compileSourceCode(vsrc);
-
-    QOpenGLShader *fshader = new QOpenGLShader(QOpenGLShader::Fragment, this);
-    QString fsrc = fragProgram();
-    fshader->compileSourceCode(fsrc);
-
-    QOpenGLShader *gshader = new QOpenGLShader(QOpenGLShader::Geometry, this);
-    QString gsrc = geomProgram();
-    gshader->compileSourceCode(gsrc);
-
-    m_program->addShader(vshader);
-    m_program->addShader(fshader);
-    m_program->addShader(gshader);
-
-    m_program->bindAttributeLocation("ciPosition", PROGRAM_VERTEX_ATTRIBUTE);
-    m_program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
-
-    m_program->bindAttributeLocation("ciColor", PROGRAM_COLOR_ATTRIBUTE);
-    m_program->enableAttributeArray(PROGRAM_COLOR_ATTRIBUTE);
-
-    m_program->enableAttributeArray(PROGRAM_COLOR_ATTRIBUTE);
-    m_program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
-
-    m_program->link();
-
-    m_win_scale = m_program->uniformLocation("WIN_SCALE");
-    m_miter_limit = m_program->uniformLocation("MITER_LIMIT");
-    m_thickness = m_program->uniformLocation("THICKNESS");
-    m_matrixUniform = m_program->uniformLocation("ciModelViewProjection");
-
-    m_program->bind();
-
-    QMatrix4x4 m;
-    //m.ortho(-0.5f, +0.5f, +0.5f, -0.5f, 4.0f, 15.0f);
-    m.ortho(0.0f, width(), height(), 0.0f, 4.0f, 15.0f);
-    m.translate(0.0f, 0.0f, -10.0f);
-
-    //OpenGl coordinates is inverse Y with the window coordinates.
-    //m.scale(1.0f, -1.0f, -1.0f);
+}
 
-    //glViewport(0, 0, width(), height());
+void InkLayerGLWidget::startRenderThread()
+{
+    m_renderThread = QSharedPointer<InkRenderThread>::create(this);
+    connect(m_renderThread.data(), &InkRenderThread::frameRendered, this, &InkLayerGLWidget::inkFrameRendered);
+    syncStrokes();
+    m_renderThread->start();
+}
 
-    m_program->setUniformValue(m_matrixUniform, m);
-    m_program->setUniformValue(m_win_scale, size());
-    m_program->setUniformValue(m_miter_limit, 0.75f);
-    m_program->setUniformValue(m_thickness, 50.0f);    
+void InkLayerGLWidget::stopRenderThread()
+{
+    if (m_renderThread)
+    {
+        m_renderThread->stop();
+        m_renderThread->wait();
+        m_renderThread.reset();
+    }
 }
 
 void InkLayerGLWidget::paintGL()
 {
     glClearColor(m_clearColor.redF(), m_clearColor.greenF(), m_clearColor.blueF(), m_clearColor.alphaF());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    QTime time;
-    time.start();
+    if (!m_renderThread) return;
 
-    if (m_strokes)
-    {
-        // Draw current stroke
-        auto currentStroke = m_strokes->currentStroke();
+    PROFILE_SCOPE("InkLayerGLWidget::paintGL");
 
-        if (currentStroke->pointCount() > 1)
-        {
-            m_vertex_index = 0;
-            render();
-        }
-        qInfo() << "Aden1: " << time.elapsed();
+    auto frame = m_renderThread->acquireFrame();
+    if (frame.ready)
+    {
+        // Queue the wait on the GPU, the GUI thread doesn't block.
+        glWaitSync(frame.ready, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(frame.ready);
     }
 
-    if (m_vertex_index >0)
+    if (frame.texture)
     {
-        time.restart();
-
-        m_color_vbo.bind();
-        m_color_vbo.write(0, &m_vertColors[0], m_vertColors.count() * sizeof(QVector3D));
-        m_program->setAttributeBuffer(PROGRAM_COLOR_ATTRIBUTE, GL_FLOAT, 0, 3);
+        // The texture holds premultiplied colors.
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
-        m_mesh_vbo.bind();
-        m_mesh_vbo.write(0, &m_vertices[0], m_vertices.count() * sizeof(QVector3D));
-        m_program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, 0, 3);
+        m_blit.draw(frame.texture);
 
-        glDrawElements(GL_LINES_ADJACENCY_EXT, m_indices.size() * sizeof(uint16_t), GL_UNSIGNED_SHORT, &m_indices[0]);
-
-        m_textures->bind();
+        glDisable(GL_BLEND);
+    }
 
-        //glMultiDrawArrays(GL_POLYGON, &plygons_starts[0], &eachPolygonCounts[0], plygonCount);
+    // Let the render thread reuse the texture once the blit has executed.
+    GLsync done = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
 
-        qInfo() << "Aden2: " << time.elapsed();
+    GLsync previous = m_renderThread->releaseFrame(done);
+    if (previous)
+    {
+        glDeleteSync(previous);
     }
 }
 
 void InkLayerGLWidget::resizeGL(int width, int height)
 {
-    int side = qMin(width, height);
-    //glViewport((width - side) / 2, (height - side) / 2, side, side);
     glViewport(0,0, width, height);
+
+    if (m_renderThread)
+    {
+        m_renderThread->resize(QSize(width, height), devicePixelRatioF());
+    }
 }
 
 void InkLayerGLWidget::setPenMode(bool penMode)
@@ -351,37 +180,155 @@ void InkLayerGLWidget::eraseStroke(const QPoint& pos)
         return;
     }
 
-    bool erased = false;
-    int strokeCount = m_strokes->strokeCount();
+    PROFILE_SCOPE("InkLayerGLWidget::eraseStroke");
+
+    // Back to front, so the edits of a stroke don't move the ones before it.
+    QVector<InkStrokeEdit> edits;
+    QVector<QSharedPointer<InkStroke>> pieces;
+    const int strokeCount = m_strokes->strokeCount();
 
     for (int i = strokeCount - 1; i >= 0; i--)
     {
         auto stroke = m_strokes->stroke(i);
-        int ptCount = stroke->pointCount();
-        for (int j = 0; j < ptCount; j++)
+
+        if (!m_partialEraser)
         {
-            auto inkPt = stroke->point(j);
-            if (QPoint(pos - inkPt.point).manhattanLength() < m_eraserSize)
+            if (strokeHitTest(*stroke, pos, m_eraserSize))
             {
-                m_strokes->removeStroke(i);
-                erased = true;
-                break;
+                edits.push_back(InkStrokeEdit{ InkStrokeEdit::Remove, i, stroke });
+            }
+            continue;
+        }
+
+        // The cursor is a circle of m_eraserSize diameter.
+        if (eraseStrokePart(*stroke, pos, m_eraserSize / 2.0, pieces))
+        {
+            edits.push_back(InkStrokeEdit{ InkStrokeEdit::Remove, i, stroke });
+            for (int j = 0; j < pieces.size(); j++)
+            {
+                if (m_strokes->compactStrokes())
+                {
+                    pieces.at(j)->compact();
+                }
+                edits.push_back(InkStrokeEdit{ InkStrokeEdit::Insert, i + j, pieces.at(j) });
             }
         }
     }
 
-    if (erased) update();
+    // One update for the data, its listeners and the renderer.
+    m_strokes->applyEdits(edits);
 
     emit inkDataErasing(pos);
 }
 
 void InkLayerGLWidget::setInkData(QSharedPointer<InkData> strokes)
 {
+    if (m_strokes)
+    {
+        disconnect(m_strokes.data(), nullptr, this, nullptr);
+    }
+
     m_strokes = strokes;
 
+    if (m_strokes)
+    {
+        connect(m_strokes.data(), &InkData::strokeAdded, this, &InkLayerGLWidget::onStrokeAdded);
+        connect(m_strokes.data(), &InkData::strokeRemoved, this, &InkLayerGLWidget::onStrokeRemoved);
+        connect(m_strokes.data(), &InkData::strokeInserted, this, &InkLayerGLWidget::onStrokeInserted);
+        connect(m_strokes.data(), &InkData::strokesEdited, this, &InkLayerGLWidget::onStrokesEdited);
+        connect(m_strokes.data(), &InkData::cleared, this, &InkLayerGLWidget::syncStrokes);
+        connect(m_strokes.data(), &InkData::strokesReset, this, &InkLayerGLWidget::syncStrokes);
+    }
+
+    syncStrokes();
+
     emit inkDataChanged(strokes);
 }
 
+void InkLayerGLWidget::onStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke)
+{
+    watchCurrentStroke(newStroke);
+
+    if (!m_renderThread) return;
+
+    int count = m_strokes->strokeCount();
+    if (count > 0 && m_strokes->stroke(count - 1) == addedStroke)
+    {
+        m_renderThread->commitCurrentStroke();
+    }
+    else
+    {
+        // The data doesn't keep the stroke (setSaveStroke(false)), just drop it.
+        m_renderThread->setCurrentStroke(InkStrokeGeometry());
+    }
+}
+
+void InkLayerGLWidget::onStrokeRemoved(int index, QSharedPointer<InkStroke> stroke)
+{
+    Q_UNUSED(stroke)
+
+    if (m_renderThread)
+    {
+        m_renderThread->removeStroke(index);
+    }
+}
+
+void InkLayerGLWidget::onStrokeInserted(int index, QSharedPointer<InkStroke> stroke)
+{
+    if (m_renderThread)
+    {
+        m_renderThread->insertStroke(index, InkStrokeGeometry::fromStroke(*stroke));
+    }
+}
+
+void InkLayerGLWidget::onStrokesEdited(const QVector<InkStrokeEdit>& edits)
+{
+    if (!m_renderThread) return;
+
+    QVector<InkRenderThread::StrokeEdit> renderEdits;
+    renderEdits.reserve(edits.size());
+    for (const auto& edit : edits)
+    {
+        const bool insert = edit.type == InkStrokeEdit::Insert;
+        renderEdits.push_back(InkRenderThread::StrokeEdit{
+            insert, edit.index, insert ? InkStrokeGeometry::fromStroke(*edit.stroke) : InkStrokeGeometry() });
+    }
+
+    m_renderThread->editStrokes(renderEdits);
+}
+
+void InkLayerGLWidget::syncStrokes()
+{
+    if (!m_renderThread || !m_strokes) return;
+
+    QVector<InkStrokeGeometry> strokes;
+    int count = m_strokes->strokeCount();
+    strokes.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        strokes.push_back(InkStrokeGeometry::fromStroke(*m_strokes->stroke(i)));
+    }
+
+    m_renderThread->setStrokes(strokes);
+    m_renderThread->setCurrentStroke(InkStrokeGeometry::fromStroke(*m_strokes->currentStroke()));
+    watchCurrentStroke(m_strokes->currentStroke());
+}
+
+void InkLayerGLWidget::watchCurrentStroke(QSharedPointer<InkStroke> stroke)
+{
+    disconnect(m_currentStrokeConnection);
+
+    // Points may come from this widget's pen or from elsewhere (a journal mirroring another station).
+    InkStroke* current = stroke.data();
+    m_currentStrokeConnection = connect(current, &InkStroke::pointAdded, this, [this, current](const QPoint& point, double width) {
+        if (m_renderThread)
+        {
+            // Points are stored truncated, pass the same value the stroke holds.
+            m_renderThread->appendCurrentPoint(point, static_cast<int>(width), current->color());
+        }
+    });
+}
+
 void InkLayerGLWidget::setColor(const QColor &c)
 {
     if (c.isValid())
@@ -407,18 +354,18 @@ QColor InkLayerGLWidget::color() const
     return m_color;
 }
 
-QString InkLayerGLWidget::penInfoStr(const POINTER_PEN_INFO& penInfo)
+QString InkLayerGLWidget::penSampleStr(const PenSample& sample)
 {
-    QPoint position(penInfo.pointerInfo.ptPixelLocation.x, penInfo.pointerInfo.ptPixelLocation.y);
-    QString result = QString("pressure: %1; Position [%2, %3]").arg(penInfo.pressure)
-        .arg(mapFromGlobal(position).x())
-        .arg(mapFromGlobal(position).y());
+    QPoint position(mapFromGlobal(sample.position.toPoint()));
+    QString result = QString("pressure: %1; Position [%2, %3]").arg(sample.pressure)
+        .arg(position.x())
+        .arg(position.y());
 
-    if ((penInfo.penFlags & PEN_FLAG_ERASER) || (penInfo.penFlags & PEN_FLAG_INVERTED))
+    if (sample.isEraser())
     {
         result += "; Eraser button has pressed";
     }
-    else if (penInfo.penFlags & PEN_FLAG_BARREL)
+    else if (sample.flags & PenSample::Barrel)
     {
         result += "Barrel button has pressed";
     }
@@ -426,16 +373,150 @@ QString InkLayerGLWidget::penInfoStr(const POINTER_PEN_INFO& penInfo)
     return result;
 }
 
+void InkLayerGLWidget::setSelection(InkSelection* selection)
+{
+    if (m_selection)
+    {
+        disconnect(m_selection.data(), nullptr, this, nullptr);
+    }
+
+    m_selection = selection;
+
+    if (m_selection)
+    {
+        connect(m_selection.data(), &InkSelection::selectionChanged, this, &InkLayerGLWidget::updateSelectionTransform);
+        connect(m_selection.data(), &InkSelection::transformChanged, this, &InkLayerGLWidget::updateSelectionTransform);
+    }
+
+    updateSelectionTransform();
+}
+
+void InkLayerGLWidget::updateSelectionTransform()
+{
+    if (!m_renderThread) return;
+
+    // Only a matrix for the render thread, the meshes are kept until the selection is committed.
+    if (m_selection)
+    {
+        m_renderThread->setSelectionTransform(m_selection->strokes(), m_selection->transform());
+    }
+    else
+    {
+        m_renderThread->setSelectionTransform(QVector<int>(), QTransform());
+    }
+}
+
+void InkLayerGLWidget::setPenRecorder(PenRecorder* recorder)
+{
+    m_penRecorder = recorder;
+}
+
+QSharedPointer<PenInputQueue> InkLayerGLWidget::createPenInput()
+{
+    auto queue = QSharedPointer<PenInputQueue>::create([this]() {
+        QMetaObject::invokeMethod(this, "drainPenInput", Qt::QueuedConnection);
+    });
+
+    m_penInputs.push_back(queue);
+    return queue;
+}
+
+void InkLayerGLWidget::pushPenSample(const PenSample& sample)
+{
+    m_guiPenInput->push(sample);
+}
+
+QFuture<QImage> InkLayerGLWidget::captureFrame()
+{
+    return m_readback->capture();
+}
+
+#ifdef Q_OS_WIN
+namespace
+{
+    PenSample penSampleFromPointer(PenSample::Type type, const POINTER_PEN_INFO& penInfo)
+    {
+        quint32 flags = PenSample::NoFlags;
+        if (penInfo.penFlags & PEN_FLAG_BARREL) flags |= PenSample::Barrel;
+        if (penInfo.penFlags & PEN_FLAG_INVERTED) flags |= PenSample::Inverted;
+        if (penInfo.penFlags & PEN_FLAG_ERASER) flags |= PenSample::Eraser;
+
+        return PenSample{ type,
+                          QPointF(penInfo.pointerInfo.ptPixelLocation.x, penInfo.pointerInfo.ptPixelLocation.y),
+                          penInfo.pressure / POINTER_MAX_PRESSURE,
+                          static_cast<float>(penInfo.tiltX),
+                          static_cast<float>(penInfo.tiltY),
+                          flags,
+                          penTimestamp() };
+    }
+}
+
 void InkLayerGLWidget::onPenDown(const POINTER_PEN_INFO& penInfo)
 {
-    //qDebug() << "Pen Down : " << penInfoStr(penInfo);
-    if (m_enablePen && penInfo.pressure > 0)
+    pushPenSample(penSampleFromPointer(PenSample::Down, penInfo));
+}
+
+void InkLayerGLWidget::onPenUp(const POINTER_PEN_INFO& penInfo)
+{
+    pushPenSample(penSampleFromPointer(PenSample::Up, penInfo));
+}
+
+void InkLayerGLWidget::onPenMove(const POINTER_PEN_INFO& penInfo)
+{
+    pushPenSample(penSampleFromPointer(PenSample::Move, penInfo));
+}
+#endif
+
+void InkLayerGLWidget::drainPenInput()
+{
+    PROFILE_SCOPE("InkLayerGLWidget::drainPenInput");
+
+    for (auto queue : m_penInputs)
+    {
+        queue->drain([this](const PenSample& sample) { processPenSample(sample); });
+    }
+}
+
+void InkLayerGLWidget::processPenSample(const PenSample& sample)
+{
+    if (m_penRecorder && m_penRecorder->isRecording())
+    {
+        // Record in ink layer coordinates so the trace doesn't depend on the window position.
+        PenSample local = sample;
+        local.position -= QPointF(mapToGlobal(QPoint(0, 0)));
+        m_penRecorder->record(local);
+    }
+
+    switch (sample.type)
     {
-        QPoint posInGlobal(penInfo.pointerInfo.ptPixelLocation.x, penInfo.pointerInfo.ptPixelLocation.y);
+    case PenSample::Down:
+        emit penPressDown(sample);
+        handlePenDown(sample);
+        break;
+    case PenSample::Move:
+        emit penMove(sample);
+        handlePenMove(sample);
+        break;
+    case PenSample::Up:
+        emit penPressUp(sample);
+        handlePenUp(sample);
+        break;
+    }
+}
+
+double InkLayerGLWidget::penWidth(const PenSample& sample) const
+{
+    return m_basePenWidth * sample.pressure / NOMINAL_PRESSURE;
+}
 
+void InkLayerGLWidget::handlePenDown(const PenSample& sample)
+{
+    //qDebug() << "Pen Down : " << penSampleStr(sample);
+    if (m_enablePen && sample.pressure > 0)
+    {
         m_penDrawing = true;
 
-        QPoint pt(mapFromGlobal(posInGlobal));
+        QPoint pt(mapFromGlobal(sample.position.toPoint()));
 
         // Drawing with mouse at this moment.
         if (m_strokes->currentStroke()->pointCount() > 0)
@@ -448,7 +529,7 @@ void InkLayerGLWidget::onPenDown(const POINTER_PEN_INFO& penInfo)
             // Erase line
             eraseStroke(pt);
         }
-        else if ((penInfo.penFlags & PEN_FLAG_ERASER) || (penInfo.penFlags & PEN_FLAG_INVERTED))
+        else if (sample.isEraser())
         {
             // Entering Pen Eraser Mode
             m_penEraserMode = true;
@@ -456,25 +537,26 @@ void InkLayerGLWidget::onPenDown(const POINTER_PEN_INFO& penInfo)
             // Erase line
             eraseStroke(pt);
         }
-        else if (penInfo.penFlags & PEN_FLAG_BARREL)
+        else if (sample.flags & PenSample::Barrel)
         {
             // Pen barrel button has been pressed.
         }
         else
         {
-            double width = m_basePenWidth * penInfo.pressure * 1.0 / BASE_PRESSURE;
-            addPoint(pt, width);
+            m_smoother.reset();
+            m_strokeSmoothing = m_smoothing;
+            addPoint(pt, penWidth(sample), sample.timestamp / 1000000);
         }
     }
 }
 
-void InkLayerGLWidget::onPenUp(const POINTER_PEN_INFO& penInfo)
+void InkLayerGLWidget::handlePenUp(const PenSample& sample)
 {
-    Q_UNUSED(penInfo)
+    Q_UNUSED(sample)
 
-        if (!m_penDrawing) return;
+    if (!m_penDrawing) return;
 
-    //qDebug() << "Pen Up" << penInfoStr(penInfo);
+    //qDebug() << "Pen Up" << penSampleStr(sample);
     if (m_penEraserMode)
     {
         m_penEraserMode = false;
@@ -487,15 +569,14 @@ void InkLayerGLWidget::onPenUp(const POINTER_PEN_INFO& penInfo)
     m_penDrawing = false;
 }
 
-void InkLayerGLWidget::onPenMove(const POINTER_PEN_INFO& penInfo)
+void InkLayerGLWidget::handlePenMove(const PenSample& sample)
 {
-    //qDebug() << "Pen move: "  << penInfoStr(penInfo);
-    if (m_enablePen && penInfo.pressure > 0)
+    //qDebug() << "Pen move: "  << penSampleStr(sample);
+    if (m_enablePen && sample.pressure > 0)
     {
         if (!m_penDrawing) return;
 
-        QPoint posInGlobal(penInfo.pointerInfo.ptPixelLocation.x, penInfo.pointerInfo.ptPixelLocation.y);
-        QPoint pt(mapFromGlobal(posInGlobal));
+        QPoint pt(mapFromGlobal(sample.position.toPoint()));
         if (m_penEraserMode || m_eraserMode)
         {
             // Erase line
@@ -503,27 +584,41 @@ void InkLayerGLWidget::onPenMove(const POINTER_PEN_INFO& penInfo)
         }
         else
         {
-            double width = m_basePenWidth * penInfo.pressure * 1.0 / BASE_PRESSURE;
-            addPoint(pt, width);
+            addPoint(pt, penWidth(sample), sample.timestamp / 1000000);
         }
     }
 }
 
-void InkLayerGLWidget::addPoint(const QPoint& point, double width)
+void InkLayerGLWidget::addPoint(const QPoint& point, double width, qint64 timestamp)
 {
     if (width > 0)
     {
-        auto currentStroke = m_strokes->currentStroke();
-        currentStroke->addPoint(point, width);
-        currentStroke->setColor(m_color);
-
-        update();
-        //update(currentStroke->boundRect());
+        if (!m_strokeSmoothing)
+        {
+            appendPoint(point, width, timestamp);
+            return;
+        }
 
-        emit inkPointAdded(point, width);
+        QVector<InkSmoother::Point> smoothed;
+        m_smoother.push(point, width, timestamp, smoothed);
+        for (const auto& smoothedPoint : smoothed)
+        {
+            appendPoint(smoothedPoint.position, smoothedPoint.width, smoothedPoint.timestamp);
+        }
     }
 }
 
+void InkLayerGLWidget::appendPoint(const QPoint& point, double width, qint64 timestamp)
+{
+    // The color first, listeners of pointAdded read it. The render thread is one of them.
+    auto currentStroke = m_strokes->currentStroke();
+    currentStroke->setColor(m_color);
+    currentStroke->setSmoothed(m_strokeSmoothing);
+    currentStroke->addPoint(point, width, timestamp);
+
+    emit inkPointAdded(point, width);
+}
+
 void InkLayerGLWidget::addStroke()
 {
     if (m_strokes.isNull())
@@ -532,6 +627,14 @@ void InkLayerGLWidget::addStroke()
         return;
     }
 
+    // The points the smoothing still holds back end the stroke.
+    QVector<InkSmoother::Point> smoothed;
+    m_smoother.finish(smoothed);
+    for (const auto& smoothedPoint : smoothed)
+    {
+        appendPoint(smoothedPoint.position, smoothedPoint.width, smoothedPoint.timestamp);
+    }
+
     if (m_strokes->currentStroke()->pointCount() > 0)
     {
         auto r = m_strokes->currentStroke()->boundRect();
@@ -615,95 +718,28 @@ void InkLayerGLWidget::showEvent(QShowEvent *event)
     return QOpenGLWidget::showEvent(event);
 }
 
+namespace
+{
+    PenSample penSampleFromMouse(PenSample::Type type, QMouseEvent *event)
+    {
+        return PenSample{ type, QPointF(event->globalPos()), NOMINAL_PRESSURE, 0.0f, 0.0f,
+                          PenSample::NoFlags, penTimestamp() };
+    }
+}
+
 void InkLayerGLWidget::mousePressEvent(QMouseEvent *event)
 {
     m_strokes->clear();
 
-    POINTER_PEN_INFO penInfo;
-    penInfo.pointerInfo.ptPixelLocation.x = event->globalX();
-    penInfo.pointerInfo.ptPixelLocation.y = event->globalY();
-    penInfo.pressure = BASE_PRESSURE * 1;
-
-    emit penPressDown(penInfo);
+    pushPenSample(penSampleFromMouse(PenSample::Down, event));
 }
 
 void InkLayerGLWidget::mouseReleaseEvent(QMouseEvent *event)
 {
-
-    POINTER_PEN_INFO penInfo;
-    penInfo.pointerInfo.ptPixelLocation.x = event->globalX();
-    penInfo.pointerInfo.ptPixelLocation.y = event->globalY();
-    penInfo.pressure = BASE_PRESSURE *1;
-    
-    emit penPressUp(penInfo);
+    pushPenSample(penSampleFromMouse(PenSample::Up, event));
 }
 
 void InkLayerGLWidget::mouseMoveEvent(QMouseEvent *event)
 {
-
-    POINTER_PEN_INFO penInfo;
-    penInfo.pointerInfo.ptPixelLocation.x = event->globalX();
-    penInfo.pointerInfo.ptPixelLocation.y = event->globalY();
-    penInfo.pressure = BASE_PRESSURE * 1;
-
-    emit penMove(penInfo);
-}
-
-void InkLayerGLWidget::render()
-{
-    QVector<QVector2D> m_points;
-
-    // Draw current stroke
-    auto currentStroke = m_strokes->currentStroke();
-
-    int ptCount = currentStroke->pointCount();
-    if (ptCount < 2) return;
-
-    float pen_width;
-    float scale = 1.0f;
-
-    for (int i = 1; i < ptCount; i++)
-    {
-        pen_width = currentStroke->getPoint(i).second*scale;
-
-        auto ptStart = QVector2D(currentStroke->getPoint(i - 1).first.x()*scale, currentStroke->getPoint(i - 1).first.y()*scale);
-        auto ptEnd = QVector2D(currentStroke->getPoint(i).first.x()*scale, currentStroke->getPoint(i).first.y()*scale);
-
-        m_points << ptStart << ptEnd;
-    }
-
-    // brute-force method: recreate mesh if anything changed
-
-    // create a new vector that can contain 3D vertices
-
-    // to improve performance, make room for the vertices + 2 adjacency vertices
-    //m_vertices.reserve(m_points.size() + 2);
-
-    // first, add an adjacency vertex at the beginning
-    m_vertices[m_vertex_index++] = (2.0f * QVector3D(m_points[0], 0) - QVector3D(m_points[1], 0));
-
-    // next, add all 2D points as 3D vertices
-    QVector<QVector2D>::iterator itr;
-    for (itr = m_points.begin(); itr != m_points.end(); ++itr)
-        m_vertices[m_vertex_index++] = (QVector3D(*itr, 0));
-
-    // next, add an adjacency vertex at the end
-    size_t n = m_points.size();
-    m_vertices[m_vertex_index++] = (2.0f * QVector3D(m_points[n - 1], 0) - QVector3D(m_points[n - 2], 0));
-
-    // now that we have a list of vertices, create the index buffer
-    n = m_vertex_index - 2;
-
-    m_indices.clear();
-    m_indices.reserve(n * 4);
-
-    for (size_t i = 1; i < n; ++i)
-    {
-        m_indices.push_back(i - 1);
-        m_indices.push_back(i);
-        m_indices.push_back(i + 1);
-        m_indices.push_back(i + 2);
-    }
-
-    // finally, create the mesh
+    pushPenSample(penSampleFromMouse(PenSample::Move, event));
 }
@@ -3,11 +3,16 @@
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions_4_0_Core>
 #include <QOpenGLBuffer>
+#include <QPointer>
 
+#include "blit_program.h"
 #include "ink_data.h"
-
-QT_FORWARD_DECLARE_CLASS(QOpenGLShaderProgram);
-QT_FORWARD_DECLARE_CLASS(QOpenGLTexture);
+#include "ink_render_thread.h"
+#include "ink_selection.h"
+#include "ink_smoothing.h"
+#include "pen_input_queue.h"
+#include "pen_recorder.h"
+#include "pixel_readback.h"
 
 class InkLayerGLWidget : public QOpenGLWidget, public QOpenGLFunctions_4_0_Core
 {
@@ -26,6 +31,7 @@ public:
     *  Important!! The ink data must be set. Otherwise it will lost the ink data.
     */
     void setInkData(QSharedPointer<InkData> strokes);
+    QSharedPointer<InkData> inkData() const { return m_strokes; }
 
     /*! \brief Reset the pen color
     */
@@ -55,20 +61,54 @@ public:
     */
     void enableRemoveStroke(bool enable);
 
+    /*! \brief Erase only the touched part of strokes (default) or whole strokes.
+    */
+    void setPartialEraser(bool partial) { m_partialEraser = partial; }
+
+    /*! \brief Smooth the pen input before it is stored (default), see InkSmoother.
+    *  Takes effect at the next stroke.
+    */
+    void setSmoothing(bool smoothing) { m_smoothing = smoothing; }
+    void setSmoothingSettings(const InkSmoother::Settings& settings) { m_smoother.setSettings(settings); }
+
+    /*! \brief Pen samples the smoothing holds back before they reach the stroke.
+    */
+    int smoothingLatencySamples() const { return m_smoothing ? m_smoother.latencySamples() : 0; }
+
     /*! \brief Enter drawing mode
     */
     void enterDrawMode();
 
-public slots:
+    /*! \brief Draw the selection's strokes with its transform while it is dragged.
+    *  The selection must be on this widget's ink data. Pass nullptr to stop.
+    */
+    void setSelection(InkSelection* selection);
 
-    /*! \brief Reset the pen size
+    /*! \brief Record the incoming pen samples with the recorder. Pass nullptr to stop.
     */
-    void penSizeChanged(int penSize);
+    void setPenRecorder(PenRecorder* recorder);
 
-    /*! \brief Reset the pen color
+    /*! \brief Create a queue for an input source that runs on its own thread.
+    *  Only one thread may push into the returned queue. Stop the source before deleting the widget.
     */
-    void colorChanged(const QColor& color);
+    QSharedPointer<PenInputQueue> createPenInput();
+
+    /*! \brief Queue a pen sample from the GUI thread (mouse, tablet events, replay).
+    */
+    void pushPenSample(const PenSample& sample);
+
+    /*! \brief Capture the ink layer as shown without stalling the GPU.
+    *  The image arrives a frame or two later through the future.
+    */
+    QFuture<QImage> captureFrame();
 
+    /*! \brief Render the ink even if the widget never gets a GL context, e.g. on the offscreen
+    *  platform. Frames are announced by inkFrameRendered() but not shown. Does nothing once
+    *  the widget renders on its own.
+    */
+    void startOffscreenRendering();
+
+#ifdef Q_OS_WIN
     /*! \brief Digitizer pen touch touchmat
     */
     void onPenDown(const POINTER_PEN_INFO& penInfo);
@@ -80,6 +120,17 @@ public slots:
     /*! \brief Digitizer pen move on touchmat
     */
     void onPenMove(const POINTER_PEN_INFO& penInfo);
+#endif
+
+public slots:
+
+    /*! \brief Reset the pen size
+    */
+    void penSizeChanged(int penSize);
+
+    /*! \brief Reset the pen color
+    */
+    void colorChanged(const QColor& color);
 
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
@@ -104,13 +155,27 @@ signals:
 
     void inkWidgetUpdated(const QRect& clip);
 
+    /*! \brief The render thread finished a frame. Unlike frameSwapped() also without a window system.
+    */
+    void inkFrameRendered();
+
 
 signals:
-    void penPressDown(const POINTER_PEN_INFO& penInfo);
-    void penPressUp(const POINTER_PEN_INFO& penInfo);
-    void penHoverEntered(const POINTER_PEN_INFO& penInfo);
-    void penHoverExited(const POINTER_PEN_INFO& penInfo);
-    void penMove(const POINTER_PEN_INFO& penInfo);
+    void penPressDown(const PenSample& sample);
+    void penPressUp(const PenSample& sample);
+    void penMove(const PenSample& sample);
+
+private slots:
+    // Process the samples queued by all the input sources.
+    void drainPenInput();
+
+    // Mirror the ink data changes into the render thread.
+    void onStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke);
+    void onStrokeRemoved(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokeInserted(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokesEdited(const QVector<InkStrokeEdit>& edits);
+    void updateSelectionTransform();
+    void syncStrokes();
 
 protected:
     void initializeGL() override;
@@ -130,7 +195,16 @@ protected:
 private:
 
     void changeCursor(int penSize);
-    QString penInfoStr(const POINTER_PEN_INFO& penInfo);
+    QString penSampleStr(const PenSample& sample);
+
+    // Run one pen sample through the ink pipeline.
+    void processPenSample(const PenSample& sample);
+    void handlePenDown(const PenSample& sample);
+    void handlePenUp(const PenSample& sample);
+    void handlePenMove(const PenSample& sample);
+
+    // Pen width for the sample pressure.
+    double penWidth(const PenSample& sample) const;
 
     // Erase the stroke that near the point
     void eraseStroke(const QPoint& pos);
@@ -138,13 +212,21 @@ private:
     // Update the pen color
     void updateColor(const QColor& color);
 
-    // Add point to current stroke.
-    void addPoint(const QPoint& point, double width);
+    // Add point to current stroke through the smoothing. timestamp is the capture time in ms
+    // (penTimestamp() clock).
+    void addPoint(const QPoint& point, double width, qint64 timestamp);
+
+    // Store a point in the current stroke.
+    void appendPoint(const QPoint& point, double width, qint64 timestamp);
 
     // Add current stroke to the list
     void addStroke();
 
-    void render();
+    void startRenderThread();
+    void stopRenderThread();
+
+    // Mirror the points added to the stroke being drawn into the render thread.
+    void watchCurrentStroke(QSharedPointer<InkStroke> stroke);
 
 private:
     QWidget* m_mockParent;
@@ -174,27 +256,38 @@ private:
     // Disable the remove feature
     bool m_enableRemoveStroke;
 
+    // Cut the touched part out of strokes instead of removing them.
+    bool m_partialEraser;
+
+    // Smooth the pen input, from the next stroke on.
+    bool m_smoothing;
+    // m_smoothing latched at pen down for the stroke being drawn.
+    bool m_strokeSmoothing;
+    InkSmoother m_smoother;
+
     QColor m_penPointColor;
 
-    // Ink data
-    QSharedPointer<InkData> m_strokes;
+    // Selection shown transformed by the render thread, may be null.
+    QPointer<InkSelection> m_selection;
 
-    GLuint m_matrixUniform;
+    // Records the pen samples for replay, may be null.
+    QPointer<PenRecorder> m_penRecorder;
 
-    GLuint	m_win_scale;		// the size of the viewport in pixels
-    GLuint	m_miter_limit;	// 1.0: always miter, -1.0: never miter, 0.75: default
-    GLuint	m_thickness;		// the thickness of the line in pixels
+    // One queue per input source. m_guiPenInput is fed from the GUI thread.
+    QVector<QSharedPointer<PenInputQueue>> m_penInputs;
+    QSharedPointer<PenInputQueue> m_guiPenInput;
+
+    // Ink data
+    QSharedPointer<InkData> m_strokes;
 
     QColor m_clearColor;
-    QSharedPointer<QOpenGLShaderProgram> m_program;
 
-    QOpenGLBuffer m_color_vbo;
-    QOpenGLBuffer m_mesh_vbo;
+    // Renders the strokes off the GUI thread, paintGL only blits its texture.
+    QSharedPointer<InkRenderThread> m_renderThread;
+
+    BlitProgram m_blit;
 
-    int m_vertex_index;
+    PixelReadback* m_readback;
 
-    QSharedPointer<QOpenGLTexture> m_textures;
-    QVector<QVector3D> m_vertices;
-    QVector<QVector3D> m_vertColors;
-    QVector<uint16_t> m_indices;
+    QMetaObject::Connection m_currentStrokeConnection;
 };
@@ -0,0 +1,685 @@
+#include <QDebug>
+#include <QMatrix4x4>
+#include <QMutexLocker>
+#include <QOpenGLWidget>
+#include <QSurfaceFormat>
+
+#include <algorithm>
+
+#include "blit_program.h"
+#include "frame_profiler.h"
+#include "ink_render_thread.h"
+
+namespace
+{
+    const int PROGRAM_VERTEX_ATTRIBUTE = 0;
+    const int PROGRAM_COLOR_ATTRIBUTE = 1;
+
+    // Initial vertex/index capacity of the mesh buffers. They grow by doubling.
+    const int INITIAL_VBO_SIZE = 64 * 1024;
+
+    QString vertexProgram()
+    {
+        return loadProgram("./assets/shaders/lines.vert");
+    }
+
+    QString fragProgram()
+    {
+        return loadProgram("./assets/shaders/lines.frag");
+    }
+
+    QString geomProgram()
+    {
+        return loadProgram("./assets/shaders/lines1.geom");
+    }
+
+    QImage loadTexture()
+    {
+        return QImage("./assets/textures/pattern1.png");
+    }
+}
+
+InkRenderThread::InkRenderThread(QOpenGLWidget* widget)
+    : m_widget(widget)
+    , m_surface(new QOffscreenSurface)
+    , m_size(widget->size())
+    , m_devicePixelRatio(widget->devicePixelRatioF())
+{
+    m_context = QSharedPointer<QOpenGLContext>::create();
+    QOpenGLContext* widgetContext = m_widget->context();
+    m_context->setShareContext(widgetContext ? widgetContext : QOpenGLContext::globalShareContext());
+    m_context->setFormat(widgetContext ? widgetContext->format() : QSurfaceFormat::defaultFormat());
+    m_context->create();
+    m_context->moveToThread(this);
+
+    m_surface->setFormat(m_context->format());
+    m_surface->create();
+
+    setObjectName("InkRenderThread");
+}
+
+InkRenderThread::~InkRenderThread()
+{ }
+
+void InkRenderThread::stop()
+{
+    QMutexLocker locker(&m_mutex);
+    m_exiting = true;
+    m_changed.wakeAll();
+}
+
+void InkRenderThread::wakeUp()
+{
+    m_dirty = true;
+    m_changed.wakeAll();
+}
+
+void InkRenderThread::resize(const QSize& size, qreal devicePixelRatio)
+{
+    QMutexLocker locker(&m_mutex);
+    m_size = size;
+    m_devicePixelRatio = devicePixelRatio;
+    wakeUp();
+}
+
+void InkRenderThread::setStrokes(const QVector<InkStrokeGeometry>& strokes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_strokes = strokes;
+    m_strokesReset = true;
+    m_selection.clear();
+    wakeUp();
+}
+
+void InkRenderThread::insertStroke(int index, const InkStrokeGeometry& stroke)
+{
+    QMutexLocker locker(&m_mutex);
+    insertStrokeLocked(index, stroke);
+    wakeUp();
+}
+
+void InkRenderThread::removeStroke(int index)
+{
+    QMutexLocker locker(&m_mutex);
+    removeStrokeLocked(index);
+    wakeUp();
+}
+
+void InkRenderThread::editStrokes(const QVector<StrokeEdit>& edits)
+{
+    QMutexLocker locker(&m_mutex);
+    for (int i = 0; i < edits.size(); i++)
+    {
+        const auto& edit = edits.at(i);
+        if (!edit.insert && i + 1 < edits.size() && edits.at(i + 1).insert && edits.at(i + 1).index == edit.index)
+        {
+            replaceStrokeLocked(edit.index, edits.at(i + 1).geometry);
+            i++;
+        }
+        else if (edit.insert)
+        {
+            insertStrokeLocked(edit.index, edit.geometry);
+        }
+        else
+        {
+            removeStrokeLocked(edit.index);
+        }
+    }
+    wakeUp();
+}
+
+void InkRenderThread::setSelectionTransform(const QVector<int>& strokes, const QTransform& transform)
+{
+    QMutexLocker locker(&m_mutex);
+    m_selection = strokes;
+    m_selectionTransform = transform;
+    wakeUp();
+}
+
+void InkRenderThread::insertStrokeLocked(int index, const InkStrokeGeometry& stroke)
+{
+    // An append keeps the selected indices, and InkSelection keeps its selection too.
+    if (index != m_strokes.size())
+    {
+        m_selection.clear();
+        m_strokesReset = true;
+    }
+    m_strokes.insert(index, stroke);
+}
+
+void InkRenderThread::removeStrokeLocked(int index)
+{
+    m_selection.clear();
+    if (!m_strokesReset && index == m_strokes.size() - 1)
+    {
+        m_truncateTo = m_truncateTo < 0 ? index : qMin(m_truncateTo, index);
+    }
+    else
+    {
+        m_strokesReset = true;
+    }
+    m_strokes.remove(index);
+}
+
+void InkRenderThread::replaceStrokeLocked(int index, const InkStrokeGeometry& stroke)
+{
+    // The indices stay, but a selection transform was baked into the stroke.
+    m_selection.clear();
+    m_strokes[index] = stroke;
+    if (!m_strokesReset)
+    {
+        m_replaced.push_back(index);
+    }
+}
+
+void InkRenderThread::setCurrentStroke(const InkStrokeGeometry& stroke)
+{
+    QMutexLocker locker(&m_mutex);
+    m_current = stroke;
+    m_currentGeneration++;
+    wakeUp();
+}
+
+void InkRenderThread::appendCurrentPoint(const QPoint& point, int width, const QColor& color)
+{
+    QMutexLocker locker(&m_mutex);
+    m_current.color = color;
+    m_current.points.push_back(qMakePair(point, width));
+    wakeUp();
+}
+
+void InkRenderThread::commitCurrentStroke()
+{
+    QMutexLocker locker(&m_mutex);
+    m_strokes.push_back(m_current);
+    m_current = InkStrokeGeometry();
+    m_currentGeneration++;
+    wakeUp();
+}
+
+InkRenderThread::Frame InkRenderThread::acquireFrame()
+{
+    QMutexLocker locker(&m_mutex);
+
+    Frame frame;
+    if (m_readyIndex >= 0)
+    {
+        m_displayIndex = m_readyIndex;
+        m_readyIndex = -1;
+
+        frame.ready = m_buffers[m_displayIndex].ready;
+        m_buffers[m_displayIndex].ready = nullptr;
+    }
+
+    if (m_displayIndex >= 0 && m_buffers[m_displayIndex].fbo)
+    {
+        frame.texture = m_buffers[m_displayIndex].fbo->texture();
+    }
+
+    return frame;
+}
+
+GLsync InkRenderThread::releaseFrame(GLsync done)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_displayIndex < 0)
+    {
+        return done;
+    }
+
+    GLsync previous = m_buffers[m_displayIndex].released;
+    m_buffers[m_displayIndex].released = done;
+    return previous;
+}
+
+void InkRenderThread::run()
+{
+    m_context->makeCurrent(m_surface.data());
+
+    m_gl = m_context->versionFunctions<QOpenGLFunctions_4_0_Core>();
+    if (!m_gl || !m_gl->initializeOpenGLFunctions())
+    {
+        qWarning() << "InkRenderThread: OpenGL 4.0 core functions are not available";
+        m_context->doneCurrent();
+        return;
+    }
+
+    initializeResources();
+
+    while (1)
+    {
+        {
+            // Sleep until the scene changes. The flag is checked under the mutex, so a change
+            // made while the previous frame was rendering is never missed.
+            QMutexLocker locker(&m_mutex);
+            while (!m_exiting && !m_dirty)
+            {
+                m_changed.wait(&m_mutex);
+            }
+
+            if (m_exiting)
+                break;
+
+            m_dirty = false;
+            pullChanges();
+        }
+
+        renderFrame();
+        emit frameRendered();
+
+        // Notify UI about new frame.
+        QMetaObject::invokeMethod(m_widget, "update", Qt::QueuedConnection);
+    }
+
+    releaseResources();
+    m_context->doneCurrent();
+}
+
+void InkRenderThread::initializeResources()
+{
+    m_program = QSharedPointer<QOpenGLShaderProgram>::create();
+    m_program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexProgram());
+    m_program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragProgram());
+    m_program->addShaderFromSourceCode(QOpenGLShader::Geometry, geomProgram());
+    m_program->bindAttributeLocation("ciPosition", PROGRAM_VERTEX_ATTRIBUTE);
+    m_program->bindAttributeLocation("ciColor", PROGRAM_COLOR_ATTRIBUTE);
+    if (!m_program->link())
+    {
+        qWarning() << "InkRenderThread: failed to link the line program" << m_program->log();
+    }
+
+    m_winScaleUniform = m_program->uniformLocation("WIN_SCALE");
+    m_miterLimitUniform = m_program->uniformLocation("MITER_LIMIT");
+    m_thicknessUniform = m_program->uniformLocation("THICKNESS");
+    m_matrixUniform = m_program->uniformLocation("ciModelViewProjection");
+
+    m_texture = QSharedPointer<QOpenGLTexture>::create(loadTexture());
+
+    m_vao = QSharedPointer<QOpenGLVertexArrayObject>::create();
+    m_vao->create();
+    m_vao->bind();
+
+    m_vboCapacity = INITIAL_VBO_SIZE;
+    m_indexCapacity = INITIAL_VBO_SIZE * 4;
+
+    m_meshVbo.create();
+    m_meshVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_meshVbo.bind();
+    m_meshVbo.allocate(m_vboCapacity * sizeof(QVector3D));
+    m_program->enableAttributeArray(PROGRAM_VERTEX_ATTRIBUTE);
+    m_program->setAttributeBuffer(PROGRAM_VERTEX_ATTRIBUTE, GL_FLOAT, 0, 3);
+
+    m_colorVbo.create();
+    m_colorVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_colorVbo.bind();
+    m_colorVbo.allocate(m_vboCapacity * sizeof(QVector3D));
+    m_program->enableAttributeArray(PROGRAM_COLOR_ATTRIBUTE);
+    m_program->setAttributeBuffer(PROGRAM_COLOR_ATTRIBUTE, GL_FLOAT, 0, 3);
+
+    // The element array binding is part of the VAO state.
+    m_indexBuffer.create();
+    m_indexBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_indexBuffer.bind();
+    m_indexBuffer.allocate(m_indexCapacity * sizeof(quint32));
+
+    m_vao->release();
+}
+
+void InkRenderThread::releaseResources()
+{
+    QMutexLocker locker(&m_mutex);
+
+    for (auto& buffer : m_buffers)
+    {
+        if (buffer.ready) m_gl->glDeleteSync(buffer.ready);
+        if (buffer.released) m_gl->glDeleteSync(buffer.released);
+        buffer = Buffer();
+    }
+    m_readyIndex = -1;
+    m_displayIndex = -1;
+
+    m_vao.reset();
+    m_meshVbo.destroy();
+    m_colorVbo.destroy();
+    m_indexBuffer.destroy();
+    m_texture.reset();
+    m_program.reset();
+}
+
+void InkRenderThread::pullChanges()
+{
+    m_renderSize = m_size;
+    m_renderDevicePixelRatio = m_devicePixelRatio;
+    m_renderSelection = m_selection;
+    m_renderSelectionTransform = m_selectionTransform;
+
+    if (m_strokesReset)
+    {
+        m_renderStrokes = m_strokes;
+        m_rebuildStrokes = true;
+        m_strokesReset = false;
+        m_truncateTo = -1;
+        m_replaced.clear();
+    }
+    else
+    {
+        if (m_truncateTo >= 0 && m_truncateTo < m_renderStrokes.size())
+        {
+            // Removed from the end: only their meshes are dropped, the rest is kept.
+            m_renderStrokes.resize(m_truncateTo);
+            m_tessellatedStrokes = qMin(m_tessellatedStrokes, m_truncateTo);
+        }
+        m_truncateTo = -1;
+
+        // Replacing keeps the indices. Strokes removed from the end since are gone, appended
+        // ones are copied below anyway.
+        for (int index : m_replaced)
+        {
+            if (index < m_renderStrokes.size())
+            {
+                m_renderStrokes[index] = m_strokes.at(index);
+                if (index < m_tessellatedStrokes)
+                {
+                    m_renderReplaced.push_back(index);
+                }
+            }
+        }
+        m_replaced.clear();
+
+        if (m_renderStrokes.size() < m_strokes.size())
+        {
+            // Only appended since the last frame. The copies share the point data.
+            m_renderStrokes += m_strokes.mid(m_renderStrokes.size());
+        }
+    }
+
+    if (m_renderCurrentGeneration != m_currentGeneration)
+    {
+        m_renderCurrent = m_current;
+        m_renderCurrentGeneration = m_currentGeneration;
+    }
+    else
+    {
+        // Copy the new points only, so a long stroke doesn't cost O(n) per point.
+        m_renderCurrent.color = m_current.color;
+        m_renderCurrent.points += m_current.points.mid(m_renderCurrent.points.size());
+    }
+}
+
+void InkRenderThread::tessellate()
+{
+    PROFILE_SCOPE("InkRenderThread::tessellate");
+
+    if (m_rebuildStrokes)
+    {
+        m_vertices.clear();
+        m_colors.clear();
+        m_indices.clear();
+        m_strokeMeshEnds.clear();
+        m_tessellatedStrokes = 0;
+        m_uploadedVertices = 0;
+        m_uploadedIndices = 0;
+        m_rebuildStrokes = false;
+        m_renderReplaced.clear();
+    }
+    else
+    {
+        // Drop the mesh of the current stroke, it is rebuilt below, and of strokes removed from the end.
+        m_strokeMeshEnds.resize(m_tessellatedStrokes);
+        m_committedVertices = m_strokeMeshEnds.isEmpty() ? 0 : m_strokeMeshEnds.last().first;
+        m_committedIndices = m_strokeMeshEnds.isEmpty() ? 0 : m_strokeMeshEnds.last().second;
+        m_uploadedVertices = qMin(m_uploadedVertices, m_committedVertices);
+        m_uploadedIndices = qMin(m_uploadedIndices, m_committedIndices);
+
+        m_vertices.resize(m_committedVertices);
+        m_colors.resize(m_committedVertices);
+        m_indices.resize(m_committedIndices);
+
+        for (int index : m_renderReplaced)
+        {
+            retessellateStroke(index);
+        }
+        m_renderReplaced.clear();
+    }
+
+    for (int i = m_tessellatedStrokes; i < m_renderStrokes.size(); i++)
+    {
+        const auto& stroke = m_renderStrokes.at(i);
+        appendStrokeMesh(stroke.points, stroke.color, m_vertices, m_colors, m_indices);
+        m_strokeMeshEnds.push_back(qMakePair(m_vertices.size(), m_indices.size()));
+    }
+    m_tessellatedStrokes = m_renderStrokes.size();
+    m_committedVertices = m_vertices.size();
+    m_committedIndices = m_indices.size();
+
+    appendStrokeMesh(m_renderCurrent.points, m_renderCurrent.color, m_vertices, m_colors, m_indices);
+}
+
+void InkRenderThread::retessellateStroke(int index)
+{
+    const QPair<int, int> start = index > 0 ? m_strokeMeshEnds.at(index - 1) : qMakePair(0, 0);
+    const QPair<int, int> end = m_strokeMeshEnds.at(index);
+
+    QVector<QVector3D> vertices;
+    QVector<QVector3D> colors;
+    QVector<quint32> indices;
+    const auto& stroke = m_renderStrokes.at(index);
+    appendStrokeMesh(stroke.points, stroke.color, vertices, colors, indices);
+    for (auto& i : indices)
+    {
+        i += start.first;
+    }
+
+    const int vertexDelta = vertices.size() - (end.first - start.first);
+    const int indexDelta = indices.size() - (end.second - start.second);
+
+    if (vertexDelta == 0 && indexDelta == 0)
+    {
+        // Same point count, e.g. moved or scaled: overwrite the mesh where it is.
+        std::copy(vertices.constBegin(), vertices.constEnd(), m_vertices.begin() + start.first);
+        std::copy(colors.constBegin(), colors.constEnd(), m_colors.begin() + start.first);
+        std::copy(indices.constBegin(), indices.constEnd(), m_indices.begin() + start.second);
+    }
+    else
+    {
+        m_vertices = m_vertices.mid(0, start.first) + vertices + m_vertices.mid(end.first);
+        m_colors = m_colors.mid(0, start.first) + colors + m_colors.mid(end.first);
+        m_indices = m_indices.mid(0, start.second) + indices + m_indices.mid(end.second);
+
+        // The meshes after it moved by the difference.
+        for (int i = start.second + indices.size(); i < m_indices.size(); i++)
+        {
+            m_indices[i] += vertexDelta;
+        }
+        for (int i = index; i < m_strokeMeshEnds.size(); i++)
+        {
+            m_strokeMeshEnds[i].first += vertexDelta;
+            m_strokeMeshEnds[i].second += indexDelta;
+        }
+    }
+
+    m_uploadedVertices = qMin(m_uploadedVertices, start.first);
+    m_uploadedIndices = qMin(m_uploadedIndices, start.second);
+}
+
+void InkRenderThread::upload()
+{
+    PROFILE_SCOPE("InkRenderThread::upload");
+
+    if (m_vertices.size() > m_vboCapacity || m_indices.size() > m_indexCapacity)
+    {
+        while (m_vboCapacity < m_vertices.size()) m_vboCapacity *= 2;
+        while (m_indexCapacity < m_indices.size()) m_indexCapacity *= 2;
+
+        m_meshVbo.bind();
+        m_meshVbo.allocate(m_vboCapacity * sizeof(QVector3D));
+        m_colorVbo.bind();
+        m_colorVbo.allocate(m_vboCapacity * sizeof(QVector3D));
+        m_vao->bind();
+        m_indexBuffer.allocate(m_indexCapacity * sizeof(quint32));
+        m_vao->release();
+
+        m_uploadedVertices = 0;
+        m_uploadedIndices = 0;
+    }
+
+    int vertexCount = m_vertices.size() - m_uploadedVertices;
+    if (vertexCount > 0)
+    {
+        m_meshVbo.bind();
+        m_meshVbo.write(m_uploadedVertices * sizeof(QVector3D), m_vertices.constData() + m_uploadedVertices,
+                        vertexCount * sizeof(QVector3D));
+        m_colorVbo.bind();
+        m_colorVbo.write(m_uploadedVertices * sizeof(QVector3D), m_colors.constData() + m_uploadedVertices,
+                         vertexCount * sizeof(QVector3D));
+    }
+
+    int indexCount = m_indices.size() - m_uploadedIndices;
+    if (indexCount > 0)
+    {
+        // Bind through the VAO so the element array binding it records is not disturbed.
+        m_vao->bind();
+        m_indexBuffer.write(m_uploadedIndices * sizeof(quint32), m_indices.constData() + m_uploadedIndices,
+                            indexCount * sizeof(quint32));
+        m_vao->release();
+    }
+
+    m_meshVbo.release();
+
+    m_uploadedVertices = m_committedVertices;
+    m_uploadedIndices = m_committedIndices;
+}
+
+int InkRenderThread::takeFreeBuffer()
+{
+    int index = 0;
+    GLsync released = nullptr;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        // Three buffers, at most one ready and one on display: one is always free.
+        while (index == m_readyIndex || index == m_displayIndex)
+        {
+            index++;
+        }
+
+        released = m_buffers[index].released;
+        m_buffers[index].released = nullptr;
+    }
+
+    if (released)
+    {
+        // Make the GPU finish the GUI's blit of this texture before we draw into it.
+        m_gl->glWaitSync(released, 0, GL_TIMEOUT_IGNORED);
+        m_gl->glDeleteSync(released);
+    }
+
+    return index;
+}
+
+void InkRenderThread::drawSelection(const QMatrix4x4& matrix)
+{
+    const QMatrix4x4 selectedMatrix = matrix * QMatrix4x4(m_renderSelectionTransform);
+
+    auto draw = [this, &matrix, &selectedMatrix](int first, int last, bool selected) {
+        if (last <= first) return;
+        m_program->setUniformValue(m_matrixUniform, selected ? selectedMatrix : matrix);
+        m_gl->glDrawElements(GL_LINES_ADJACENCY, last - first, GL_UNSIGNED_INT,
+                             reinterpret_cast<const void*>(first * sizeof(quint32)));
+    };
+
+    // Runs of consecutive selected or unselected strokes, drawn in stroke order.
+    int next = 0;
+    int runStart = 0;
+    bool runSelected = false;
+    for (int i = 0; i < m_strokeMeshEnds.size(); i++)
+    {
+        const bool selected = next < m_renderSelection.size() && m_renderSelection.at(next) == i;
+        if (selected) next++;
+
+        if (selected != runSelected)
+        {
+            const int start = i == 0 ? 0 : m_strokeMeshEnds.at(i - 1).second;
+            draw(runStart, start, runSelected);
+            runStart = start;
+            runSelected = selected;
+        }
+    }
+    draw(runStart, m_committedIndices, runSelected);
+
+    // The stroke being drawn.
+    draw(m_committedIndices, m_indices.size(), false);
+}
+
+void InkRenderThread::renderFrame()
+{
+    PROFILE_SCOPE("InkRenderThread::renderFrame");
+
+    tessellate();
+    upload();
+
+    const int index = takeFreeBuffer();
+    Buffer& buffer = m_buffers[index];
+
+    const QSize pixelSize = m_renderSize * m_renderDevicePixelRatio;
+    if (!buffer.fbo || buffer.fbo->size() != pixelSize)
+    {
+        buffer.fbo = QSharedPointer<QOpenGLFramebufferObject>::create(pixelSize);
+    }
+
+    buffer.fbo->bind();
+    m_gl->glViewport(0, 0, pixelSize.width(), pixelSize.height());
+    m_gl->glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    m_gl->glClear(GL_COLOR_BUFFER_BIT);
+
+    if (!m_indices.isEmpty())
+    {
+        // Keep the FBO premultiplied so the GUI can composite it with a single blend.
+        m_gl->glEnable(GL_BLEND);
+        m_gl->glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        QMatrix4x4 m;
+        m.ortho(0.0f, m_renderSize.width(), m_renderSize.height(), 0.0f, 4.0f, 15.0f);
+        m.translate(0.0f, 0.0f, -10.0f);
+
+        m_program->bind();
+        m_program->setUniformValue(m_matrixUniform, m);
+        m_program->setUniformValue(m_winScaleUniform, QSizeF(pixelSize));
+        m_program->setUniformValue(m_miterLimitUniform, 0.75f);
+        m_program->setUniformValue(m_thicknessUniform, 50.0f);
+
+        m_texture->bind(0);
+        m_vao->bind();
+        if (m_renderSelection.isEmpty() || m_renderSelectionTransform.isIdentity())
+        {
+            m_gl->glDrawElements(GL_LINES_ADJACENCY, m_indices.size(), GL_UNSIGNED_INT, nullptr);
+        }
+        else
+        {
+            drawSelection(m);
+        }
+        m_vao->release();
+        m_texture->release();
+        m_program->release();
+
+        m_gl->glDisable(GL_BLEND);
+    }
+
+    buffer.fbo->release();
+
+    // The GUI context waits on this before sampling. Flush so the fence reaches the GPU.
+    GLsync ready = m_gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_gl->glFlush();
+
+    QMutexLocker locker(&m_mutex);
+    if (m_readyIndex >= 0 && m_buffers[m_readyIndex].ready)
+    {
+        // The previous frame was never picked up, it is superseded.
+        m_gl->glDeleteSync(m_buffers[m_readyIndex].ready);
+        m_buffers[m_readyIndex].ready = nullptr;
+    }
+    buffer.ready = ready;
+    m_readyIndex = index;
+}
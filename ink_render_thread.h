@@ -0,0 +1,221 @@
+#ifndef INK_RENDER_THREAD_H
+#define INK_RENDER_THREAD_H
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QMutex>
+#include <QOpenGLBuffer>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLFunctions_4_0_Core>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <QOffscreenSurface>
+#include <QPair>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QThread>
+#include <QTransform>
+#include <QVector>
+#include <QVector3D>
+#include <QWaitCondition>
+
+#include "ink_geometry.h"
+
+class QOpenGLWidget;
+
+/*! \brief Tessellates and renders the ink into an FBO on its own thread.
+ *
+ *  The GUI thread only mirrors stroke changes into the thread (each call is O(1) or copies a
+ *  single stroke) and blits the finished texture. The thread renders into three FBOs in turn,
+ *  so it never touches the texture the GUI is sampling, and guards the handoff with GL fences
+ *  in both directions.
+ */
+class InkRenderThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /*! \brief A finished frame for the GUI thread.
+     */
+    struct Frame
+    {
+        GLuint texture = 0;
+        // Wait on this before sampling the texture (glWaitSync), then delete it. May be null.
+        GLsync ready = nullptr;
+    };
+
+    /*! \brief Create the thread with a context shared with the widget's.
+     *  Call on the GUI thread with the widget's context current. A widget without a context
+     *  (never shown, no window system) gets an unshared one: frames are rendered, not shown.
+     */
+    explicit InkRenderThread(QOpenGLWidget* widget);
+    ~InkRenderThread();
+
+    /*! \brief Ask the thread to exit. Follow with wait().
+     */
+    void stop();
+
+    // Scene updates, GUI thread only.
+
+    /*! \brief Resize the frames. Strokes are in logical coordinates of size.
+     */
+    void resize(const QSize& size, qreal devicePixelRatio);
+    void setStrokes(const QVector<InkStrokeGeometry>& strokes);
+    void insertStroke(int index, const InkStrokeGeometry& stroke);
+    void removeStroke(int index);
+
+    struct StrokeEdit
+    {
+        // Inserts geometry at index when true, removes the stroke at index when false.
+        bool insert;
+        int index;
+        InkStrokeGeometry geometry;
+    };
+
+    /*! \brief Apply the edits in order as one scene update, no frame shows only some of them.
+     *  A removal followed by an insertion at the same index (a stroke edited in place, e.g. by
+     *  InkSelection::commit()) replaces the stroke: only its mesh is rebuilt.
+     */
+    void editStrokes(const QVector<StrokeEdit>& edits);
+
+    /*! \brief Draw the given committed strokes (sorted indices) with transform applied, e.g.
+     *  while a selection is dragged. Only a matrix changes, the meshes are kept. Any change of
+     *  the strokes clears it, since it shifts the indices or bakes the transform.
+     */
+    void setSelectionTransform(const QVector<int>& strokes, const QTransform& transform);
+    void setCurrentStroke(const InkStrokeGeometry& stroke);
+    void appendCurrentPoint(const QPoint& point, int width, const QColor& color);
+
+    /*! \brief Append the current stroke to the strokes and start an empty one.
+     */
+    void commitCurrentStroke();
+
+    /*! \brief Take the newest finished frame, or keep showing the previous one.
+     *  Call releaseFrame() after the frame has been drawn.
+     */
+    Frame acquireFrame();
+
+    /*! \brief Tell the thread the GUI context is done issuing commands on the acquired frame.
+     *  \param done Flushed fence inserted after the blit. The thread takes ownership.
+     *  \return The fence this one replaces, to be deleted by the caller. May be null.
+     */
+    GLsync releaseFrame(GLsync done);
+
+signals:
+    /*! \brief A frame with the scene changes so far was rendered. Emitted on the render thread,
+     *  with or without a window system.
+     */
+    void frameRendered();
+
+protected:
+    void run() override;
+
+private:
+    struct Buffer
+    {
+        QSharedPointer<QOpenGLFramebufferObject> fbo;
+        // Set by the render thread once the frame is rendered.
+        GLsync ready = nullptr;
+        // Set by the GUI thread once it stops sampling the texture.
+        GLsync released = nullptr;
+    };
+
+    static const int BUFFER_COUNT = 3;
+
+    // Render thread helpers, called with the thread context current.
+    void initializeResources();
+    void releaseResources();
+    void pullChanges();
+    void tessellate();
+    void upload();
+    void renderFrame();
+    void drawSelection(const QMatrix4x4& matrix);
+    int takeFreeBuffer();
+
+    // Mark the scene dirty and wake the thread. Expects m_mutex locked.
+    void wakeUp();
+
+    // Scene updates with m_mutex held.
+    void insertStrokeLocked(int index, const InkStrokeGeometry& stroke);
+    void removeStrokeLocked(int index);
+    void replaceStrokeLocked(int index, const InkStrokeGeometry& stroke);
+
+    // Rebuild the mesh of a tessellated committed stroke in place, shifting the meshes after it.
+    void retessellateStroke(int index);
+
+private:
+    QOpenGLWidget* m_widget;
+    QSharedPointer<QOpenGLContext> m_context;
+    QSharedPointer<QOffscreenSurface> m_surface;
+    QOpenGLFunctions_4_0_Core* m_gl = nullptr;
+
+    // Guards everything down to m_buffers. Held only for short copies, never while rendering.
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+    bool m_exiting = false;
+    bool m_dirty = false;
+
+    // Scene shared with the GUI thread.
+    QSize m_size;
+    qreal m_devicePixelRatio = 1.0;
+    QVector<InkStrokeGeometry> m_strokes;
+    InkStrokeGeometry m_current;
+    // Bumped whenever m_current is replaced rather than appended to.
+    int m_currentGeneration = 0;
+    // Set when committed strokes were removed or inserted other than at the end.
+    bool m_strokesReset = true;
+    // Strokes from here on were removed from the end (replay scrubbing back), -1 if none.
+    int m_truncateTo = -1;
+    // Strokes replaced in place since the last frame, unused while m_strokesReset is set.
+    QVector<int> m_replaced;
+    QVector<int> m_selection;
+    QTransform m_selectionTransform;
+
+    // Frame handoff.
+    Buffer m_buffers[BUFFER_COUNT];
+    int m_readyIndex = -1;
+    int m_displayIndex = -1;
+
+    // Render thread state.
+    QVector<InkStrokeGeometry> m_renderStrokes;
+    InkStrokeGeometry m_renderCurrent;
+    QVector<int> m_renderSelection;
+    QTransform m_renderSelectionTransform;
+    int m_renderCurrentGeneration = -1;
+    int m_tessellatedStrokes = 0;
+    bool m_rebuildStrokes = true;
+    // Tessellated strokes whose mesh is out of date.
+    QVector<int> m_renderReplaced;
+    QSize m_renderSize;
+    qreal m_renderDevicePixelRatio = 1.0;
+
+    // Mesh of the committed strokes followed by the mesh of the current stroke.
+    QVector<QVector3D> m_vertices;
+    QVector<QVector3D> m_colors;
+    QVector<quint32> m_indices;
+    int m_committedVertices = 0;
+    int m_committedIndices = 0;
+    // Vertex and index count at the end of each committed stroke's mesh.
+    QVector<QPair<int, int>> m_strokeMeshEnds;
+    // Committed mesh already in the buffers, only the rest is uploaded each frame.
+    int m_uploadedVertices = 0;
+    int m_uploadedIndices = 0;
+
+    QSharedPointer<QOpenGLShaderProgram> m_program;
+    QSharedPointer<QOpenGLTexture> m_texture;
+    QSharedPointer<QOpenGLVertexArrayObject> m_vao;
+    QOpenGLBuffer m_meshVbo;
+    QOpenGLBuffer m_colorVbo;
+    QOpenGLBuffer m_indexBuffer { QOpenGLBuffer::IndexBuffer };
+    int m_vboCapacity = 0;
+    int m_indexCapacity = 0;
+
+    GLint m_matrixUniform = -1;
+    GLint m_winScaleUniform = -1;
+    GLint m_miterLimitUniform = -1;
+    GLint m_thicknessUniform = -1;
+};
+
+#endif // INK_RENDER_THREAD_H
@@ -0,0 +1,113 @@
+#include <limits>
+
+#include "frame_profiler.h"
+#include "ink_data.h"
+#include "ink_replay.h"
+
+InkReplay::InkReplay(QSharedPointer<InkData> source, QObject* parent)
+    : QObject(parent)
+    , m_source(source)
+    , m_output(QSharedPointer<InkData>::create())
+    , m_time(std::numeric_limits<qint64>::min())
+    , m_outdated(true)
+{
+    m_output->setCanvasSize(m_source->canvasSize());
+
+    connect(m_source.data(), &InkData::strokeAdded, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::strokeRemoved, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::strokeInserted, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::strokesEdited, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::cleared, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::strokesReset, this, &InkReplay::invalidate);
+    connect(m_source.data(), &InkData::canvasSizeChanged, m_output.data(), &InkData::setCanvasSize);
+}
+
+qint64 InkReplay::startTime()
+{
+    for (const auto& span : m_source->timeIndex())
+    {
+        if (span.start != std::numeric_limits<qint64>::min())
+        {
+            return span.start;
+        }
+    }
+
+    return 0;
+}
+
+qint64 InkReplay::endTime()
+{
+    qint64 end = 0;
+    for (const auto& span : m_source->timeIndex())
+    {
+        if (span.start != std::numeric_limits<qint64>::min())
+        {
+            end = qMax(end, span.end);
+        }
+    }
+
+    return end;
+}
+
+void InkReplay::seek(qint64 time)
+{
+    PROFILE_SCOPE("InkReplay::seek");
+
+    const auto& index = m_source->timeIndex();
+    const int count = m_source->strokesStartedBy(time);
+
+    int keep = 0;
+    if (m_outdated)
+    {
+        m_output->clear();
+        m_shown.clear();
+        m_outdated = false;
+    }
+    else
+    {
+        // Strokes finished by both times look the same at both. After them, keep the ones that
+        // happen to show the same points too, up to the first one that changes.
+        keep = qMin(m_source->firstUnfinishedAt(qMin(time, m_time)), qMin(count, m_shown.size()));
+        while (keep < qMin(count, m_shown.size()) &&
+               m_shown.at(keep) == m_source->stroke(index.at(keep).stroke)->pointCountAt(time))
+        {
+            keep++;
+        }
+    }
+
+    // Removing from the end keeps the renderers' meshes of the strokes before.
+    while (m_shown.size() > keep)
+    {
+        m_output->removeStroke(m_shown.size() - 1);
+        m_shown.removeLast();
+    }
+
+    for (int i = keep; i < count; i++)
+    {
+        appendStroke(i, time);
+    }
+
+    m_time = time;
+    emit timeChanged(time);
+}
+
+void InkReplay::appendStroke(int position, qint64 time)
+{
+    auto stroke = m_source->stroke(m_source->timeIndex().at(position).stroke);
+    const int points = stroke->pointCountAt(time);
+
+    // Finished strokes are shared with the source, only the one being drawn is copied.
+    m_output->insertStroke(m_output->strokeCount(),
+                           points == stroke->pointCount() ? stroke : stroke->left(points), true);
+    m_shown.push_back(points);
+}
+
+void InkReplay::invalidate()
+{
+    m_outdated = true;
+
+    if (m_time != std::numeric_limits<qint64>::min())
+    {
+        seek(m_time);
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef INK_REPLAY_H
+#define INK_REPLAY_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+class InkData;
+
+/*! \brief Shows the ink of a timed InkData as it was at a given time, e.g. in sync with a
+ *  recorded video.
+ *
+ *  The state is mirrored into output(), which a widget displays like any other ink data.
+ *  A seek only touches the strokes whose visible points differ between the old and the new
+ *  time: those are removed from the end of the output and appended again, and the strokes
+ *  before them stay as they are. Renderers see appends and removals from the end only, so they
+ *  never re-tessellate the unchanged strokes. Finding the strokes to change is O(log n).
+ */
+class InkReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InkReplay(QSharedPointer<InkData> source, QObject* parent = nullptr);
+
+    QSharedPointer<InkData> source() const { return m_source; }
+    QSharedPointer<InkData> output() const { return m_output; }
+
+    /*! \brief Time span of the timed strokes, in ms on the stroke clock. 0 if none.
+     */
+    qint64 startTime();
+    qint64 endTime();
+
+    qint64 time() const { return m_time; }
+
+public slots:
+    /*! \brief Show the ink as it was at time: the points captured at or before it.
+     *  Strokes without timestamps are always shown.
+     */
+    void seek(qint64 time);
+
+signals:
+    void timeChanged(qint64 time);
+
+private slots:
+    // The source changed in a way the replay can't follow incrementally.
+    void invalidate();
+
+private:
+    void appendStroke(int position, qint64 time);
+
+private:
+    QSharedPointer<InkData> m_source;
+    QSharedPointer<InkData> m_output;
+    qint64 m_time;
+
+    // Points shown of each output stroke; the output strokes are the source's timeIndex() order.
+    QVector<int> m_shown;
+    bool m_outdated;
+};
+
+#endif // INK_REPLAY_H
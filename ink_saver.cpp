@@ -0,0 +1,141 @@
+#include <QDebug>
+#include <QSaveFile>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include "frame_profiler.h"
+#include "ink_data.h"
+#include "ink_saver.h"
+
+InkSaver::InkSaver(QSharedPointer<InkData> data, QObject* parent)
+    : QObject(parent)
+    , m_data(data)
+    , m_savedRevision(0)
+{
+    connect(&m_watcher, &QFutureWatcher<Result>::finished, this, &InkSaver::onSaveFinished);
+}
+
+InkSaver::~InkSaver()
+{
+    waitForFinished();
+}
+
+bool InkSaver::isModified() const
+{
+    return m_data->revision() != m_savedRevision;
+}
+
+void InkSaver::save(const QString& fileName, InkSaver::Format format)
+{
+    PROFILE_SCOPE("InkSaver::save");
+
+    const qint64 start = FrameProfiler::now();
+
+    Job job{ m_data->snapshot(), fileName, format };
+
+    auto waiting = std::find_if(m_pending.begin(), m_pending.end(), [&fileName](const Job& pending) {
+        return pending.fileName == fileName;
+    });
+    if (waiting != m_pending.end())
+    {
+        *waiting = job;
+        m_stats.coalesced++;
+    }
+    else
+    {
+        m_pending.push_back(job);
+    }
+
+    if (!m_watcher.isRunning())
+    {
+        startNext();
+    }
+
+    m_stats.lastRequestNs = FrameProfiler::now() - start;
+    m_stats.maxRequestNs = qMax(m_stats.maxRequestNs, m_stats.lastRequestNs);
+}
+
+void InkSaver::waitForFinished()
+{
+    // The finished signal isn't delivered while blocked, run the queue here.
+    while (m_watcher.isRunning() || !m_pending.isEmpty())
+    {
+        if (m_watcher.isRunning())
+        {
+            m_watcher.waitForFinished();
+        }
+        onSaveFinished();
+    }
+}
+
+void InkSaver::startNext()
+{
+    if (m_pending.isEmpty())
+    {
+        return;
+    }
+
+    m_running = m_pending.takeFirst();
+    const Job job = m_running;
+    m_watcher.setFuture(QtConcurrent::run([job]() {
+        return write(job);
+    }));
+}
+
+void InkSaver::onSaveFinished()
+{
+    // Already handled by waitForFinished().
+    if (m_running.fileName.isEmpty())
+    {
+        if (!m_watcher.isRunning())
+        {
+            startNext();
+        }
+        return;
+    }
+
+    const Result result = m_watcher.result();
+    const Job job = m_running;
+    m_running = Job();
+
+    if (result.success)
+    {
+        m_stats.saves++;
+        m_savedRevision = job.snapshot.revision();
+    }
+    else
+    {
+        m_stats.failures++;
+    }
+    m_stats.lastSerializeNs = result.serializeNs;
+    m_stats.lastWriteNs = result.writeNs;
+
+    emit saved(job.fileName, job.snapshot.revision(), result.success);
+
+    startNext();
+}
+
+InkSaver::Result InkSaver::write(const Job& job)
+{
+    PROFILE_SCOPE("InkSaver::write");
+
+    Result result;
+
+    qint64 start = FrameProfiler::now();
+    const QByteArray data = job.format == Format::Json ? job.snapshot.toJsonString().toUtf8()
+                                                       : job.snapshot.toBinary();
+    result.serializeNs = FrameProfiler::now() - start;
+
+    start = FrameProfiler::now();
+    QSaveFile file(job.fileName);
+    result.success = file.open(QFile::WriteOnly) && file.write(data) == data.size() && file.commit();
+    result.writeNs = FrameProfiler::now() - start;
+
+    if (!result.success)
+    {
+        qWarning() << "InkSaver: failed to write" << job.fileName << file.errorString();
+    }
+
+    return result;
+}
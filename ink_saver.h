@@ -0,0 +1,109 @@
+#ifndef INK_SAVER_H
+#define INK_SAVER_H
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+
+#include "ink_snapshot.h"
+
+class InkData;
+
+/*! \brief Saves an InkData in the background.
+ *
+ *  save() only takes a snapshot of the data (microseconds); the serialization and the file
+ *  write run on a worker thread while the user keeps inking. Saves run one at a time in
+ *  request order. A save requested for a file that already has one waiting replaces it, so a
+ *  burst of requests writes the latest state once. Files are replaced atomically.
+ */
+class InkSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Format
+    {
+        // InkData::toJsonString(), readable with InkData::fromJsonString().
+        Json,
+        // InkSnapshot::toBinary().
+        Binary
+    };
+
+    struct Stats
+    {
+        quint64 saves = 0;
+        quint64 failures = 0;
+        // Requests replaced by a newer one before they started.
+        quint64 coalesced = 0;
+        // Time on the calling thread in save().
+        qint64 lastRequestNs = 0;
+        qint64 maxRequestNs = 0;
+        // Time on the worker.
+        qint64 lastSerializeNs = 0;
+        qint64 lastWriteNs = 0;
+    };
+
+    explicit InkSaver(QSharedPointer<InkData> data, QObject* parent = nullptr);
+
+    /*! \brief Finishes the running and waiting saves.
+     */
+    ~InkSaver();
+
+    bool isSaving() const { return m_watcher.isRunning() || !m_pending.isEmpty(); }
+
+    /*! \brief Revision of the last successfully saved snapshot, see InkData::revision().
+     */
+    quint64 savedRevision() const { return m_savedRevision; }
+
+    /*! \brief Whether the data changed since the last successful save.
+     */
+    bool isModified() const;
+
+    Stats stats() const { return m_stats; }
+
+    /*! \brief Block until every requested save has finished.
+     */
+    void waitForFinished();
+
+public slots:
+    void save(const QString& fileName, InkSaver::Format format = InkSaver::Format::Json);
+
+signals:
+    void saved(const QString& fileName, quint64 revision, bool success);
+
+private slots:
+    void onSaveFinished();
+
+private:
+    struct Job
+    {
+        InkSnapshot snapshot;
+        QString fileName;
+        Format format;
+    };
+
+    struct Result
+    {
+        bool success = false;
+        qint64 serializeNs = 0;
+        qint64 writeNs = 0;
+    };
+
+    void startNext();
+
+    static Result write(const Job& job);
+
+private:
+    QSharedPointer<InkData> m_data;
+
+    QFutureWatcher<Result> m_watcher;
+    Job m_running;
+    QVector<Job> m_pending;
+
+    quint64 m_savedRevision;
+    Stats m_stats;
+};
+
+#endif // INK_SAVER_H
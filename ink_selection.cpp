@@ -0,0 +1,113 @@
+#include "frame_profiler.h"
+#include "ink_data.h"
+#include "ink_geometry.h"
+#include "ink_selection.h"
+
+InkSelection::InkSelection(QSharedPointer<InkData> data, QObject* parent)
+    : QObject(parent)
+    , m_data(data)
+    , m_committing(false)
+{
+    // Appending keeps the indices, anything else may shift them.
+    connect(m_data.data(), &InkData::strokeRemoved, this, &InkSelection::onDataChanged);
+    connect(m_data.data(), &InkData::strokeInserted, this, &InkSelection::onDataChanged);
+    connect(m_data.data(), &InkData::strokesEdited, this, &InkSelection::onDataChanged);
+    connect(m_data.data(), &InkData::cleared, this, &InkSelection::onDataChanged);
+    connect(m_data.data(), &InkData::strokesReset, this, &InkSelection::onDataChanged);
+}
+
+int InkSelection::select(const QPolygonF& lasso)
+{
+    PROFILE_SCOPE("InkSelection::select");
+
+    m_strokes.clear();
+    m_bounds = QRect();
+    m_transform = QTransform();
+
+    const QRectF lassoBounds = lasso.boundingRect();
+    const int count = m_data->strokeCount();
+
+    for (int i = 0; i < count; i++)
+    {
+        const auto stroke = m_data->stroke(i);
+
+        // Broad phase on the cached bounds, narrow phase on the points and segments.
+        const QRectF strokeBounds = QRectF(stroke->pointBounds()).adjusted(0, 0, 1, 1);
+        if (stroke->pointCount() == 0 || !strokeBounds.intersects(lassoBounds))
+        {
+            continue;
+        }
+
+        if (strokeTouchesPolygon(*stroke, lasso))
+        {
+            m_strokes.push_back(i);
+            m_bounds |= stroke->pointBounds();
+        }
+    }
+
+    emit selectionChanged(m_strokes);
+    emit transformChanged(m_transform);
+    return m_strokes.size();
+}
+
+void InkSelection::setTransform(const QTransform& transform)
+{
+    if (m_transform == transform) return;
+
+    m_transform = transform;
+    emit transformChanged(m_transform);
+}
+
+void InkSelection::commit()
+{
+    if (m_strokes.isEmpty() || m_transform.isIdentity()) return;
+
+    PROFILE_SCOPE("InkSelection::commit");
+
+    // Replace each stroke in place, back to front so the indices stay valid.
+    QVector<InkStrokeEdit> edits;
+    edits.reserve(m_strokes.size() * 2);
+    QRect bounds;
+    for (int k = m_strokes.size() - 1; k >= 0; k--)
+    {
+        const int index = m_strokes.at(k);
+        const auto stroke = m_data->stroke(index);
+        auto moved = stroke->transformed(m_transform);
+        if (m_data->compactStrokes())
+        {
+            moved->compact();
+        }
+
+        edits.push_back(InkStrokeEdit{ InkStrokeEdit::Remove, index, stroke });
+        edits.push_back(InkStrokeEdit{ InkStrokeEdit::Insert, index, moved });
+        bounds |= moved->pointBounds();
+    }
+
+    m_committing = true;
+    m_data->applyEdits(edits);
+    m_committing = false;
+
+    m_bounds = bounds;
+    m_transform = QTransform();
+    emit transformChanged(m_transform);
+}
+
+void InkSelection::clear()
+{
+    if (m_strokes.isEmpty() && m_transform.isIdentity()) return;
+
+    m_strokes.clear();
+    m_bounds = QRect();
+    m_transform = QTransform();
+
+    emit selectionChanged(m_strokes);
+    emit transformChanged(m_transform);
+}
+
+void InkSelection::onDataChanged()
+{
+    if (!m_committing)
+    {
+        clear();
+    }
+}
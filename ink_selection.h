@@ -0,0 +1,74 @@
+#ifndef INK_SELECTION_H
+#define INK_SELECTION_H
+
+#include <QObject>
+#include <QPolygonF>
+#include <QRect>
+#include <QSharedPointer>
+#include <QTransform>
+#include <QVector>
+
+class InkData;
+
+/*! \brief Strokes of an InkData picked with a lasso, to be moved or scaled together.
+ *
+ *  select() tests the lasso against the cached bounds of every stroke first and looks at the
+ *  points and segments of the few that overlap only then. While dragging, setTransform() only
+ *  changes a matrix that renderers apply to the selected strokes (InkLayerGLWidget::setSelection),
+ *  the point data is untouched. commit() bakes the transform into new strokes once, as a single
+ *  InkData edit. Other changes of the data clear the selection, they may shift the indices.
+ */
+class InkSelection : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InkSelection(QSharedPointer<InkData> data, QObject* parent = nullptr);
+
+    QSharedPointer<InkData> data() const { return m_data; }
+
+    /*! \brief Select the strokes with any part of their center line inside the lasso.
+     *  \return Number of strokes selected.
+     */
+    int select(const QPolygonF& lasso);
+
+    /*! \brief Indices of the selected strokes, ascending.
+     */
+    const QVector<int>& strokes() const { return m_strokes; }
+
+    bool isEmpty() const { return m_strokes.isEmpty(); }
+
+    /*! \brief Bounding box of the selected points before the transform.
+     */
+    QRect bounds() const { return m_bounds; }
+
+    QTransform transform() const { return m_transform; }
+
+public slots:
+    /*! \brief Transform to show the selection with, relative to where the strokes are stored.
+     */
+    void setTransform(const QTransform& transform);
+
+    /*! \brief Replace the selected strokes by transformed ones and reset the transform.
+     *  The strokes stay selected.
+     */
+    void commit();
+
+    void clear();
+
+signals:
+    void selectionChanged(const QVector<int>& strokes);
+    void transformChanged(const QTransform& transform);
+
+private slots:
+    void onDataChanged();
+
+private:
+    QSharedPointer<InkData> m_data;
+    QVector<int> m_strokes;
+    QRect m_bounds;
+    QTransform m_transform;
+    bool m_committing;
+};
+
+#endif // INK_SELECTION_H
@@ -0,0 +1,198 @@
+#include "ink_smoothing.h"
+
+#include <QtMath>
+
+#include <cmath>
+
+namespace
+{
+    // Sample interval assumed when two samples carry the same time, a 250 Hz pen.
+    const double DEFAULT_INTERVAL = 1.0 / 250.0;
+
+    // Knot intervals shorter than this (repeated points) are replaced, see splinePoint().
+    const double MIN_KNOT_INTERVAL = 1e-4;
+
+    double length(const QPointF& vector)
+    {
+        return std::sqrt(QPointF::dotProduct(vector, vector));
+    }
+
+    // Smoothing factor of an exponential low pass with this cutoff, for samples dt s apart.
+    double lowPassAlpha(double cutoff, double dt)
+    {
+        const double tau = 1.0 / (2.0 * M_PI * cutoff);
+        return 1.0 / (1.0 + tau / dt);
+    }
+
+    // Point at u in [0, 1] on the centripetal Catmull-Rom segment p1-p2, written as a cubic
+    // Hermite segment. Centripetal knots keep the curve from looping or overshooting where the
+    // samples are unevenly spaced.
+    QPointF splinePoint(const QPointF& p0, const QPointF& p1, const QPointF& p2,
+                        const QPointF& p3, double u)
+    {
+        double dt0 = std::sqrt(length(p1 - p0));
+        double dt1 = std::sqrt(length(p2 - p1));
+        double dt2 = std::sqrt(length(p3 - p2));
+
+        if (dt1 < MIN_KNOT_INTERVAL)
+        {
+            dt1 = 1.0;
+        }
+        if (dt0 < MIN_KNOT_INTERVAL)
+        {
+            dt0 = dt1;
+        }
+        if (dt2 < MIN_KNOT_INTERVAL)
+        {
+            dt2 = dt1;
+        }
+
+        const QPointF tangent1 = ((p1 - p0) / dt0 - (p2 - p0) / (dt0 + dt1) + (p2 - p1) / dt1) * dt1;
+        const QPointF tangent2 = ((p2 - p1) / dt1 - (p3 - p1) / (dt1 + dt2) + (p3 - p2) / dt2) * dt1;
+
+        const double u2 = u * u;
+        const double u3 = u2 * u;
+        return p1 * (2 * u3 - 3 * u2 + 1) + tangent1 * (u3 - 2 * u2 + u) +
+               p2 * (-2 * u3 + 3 * u2) + tangent2 * (u3 - u2);
+    }
+}
+
+InkSmoother::InkSmoother()
+    : InkSmoother(Settings())
+{ }
+
+InkSmoother::InkSmoother(const Settings& settings)
+    : m_settings(settings)
+{
+    reset();
+}
+
+int InkSmoother::latencySamples() const
+{
+    return m_settings.catmullRom ? 1 : 0;
+}
+
+void InkSmoother::reset()
+{
+    m_filtering = false;
+    m_filtered = QPointF();
+    m_speed = QPointF();
+    m_lastTime = 0;
+    m_count = 0;
+    m_emitted = false;
+    m_lastEmitted = QPoint();
+}
+
+void InkSmoother::push(const QPoint& point, double width, qint64 timestamp, QVector<Point>& out)
+{
+    const Sample sample = filter(point, width, timestamp);
+
+    if (!m_settings.catmullRom)
+    {
+        emitPoint(sample.position, sample.width, sample.timestamp, out);
+        return;
+    }
+
+    if (m_count == 0)
+    {
+        // The first point is final, it starts the first segment with a repeated control point.
+        emitPoint(sample.position, sample.width, sample.timestamp, out);
+        m_window[0] = sample;
+        m_window[1] = sample;
+        m_count = 1;
+        return;
+    }
+
+    if (m_count == 1)
+    {
+        m_window[2] = sample;
+        m_count = 2;
+        return;
+    }
+
+    m_window[3] = sample;
+    emitSegment(out);
+
+    m_window[0] = m_window[1];
+    m_window[1] = m_window[2];
+    m_window[2] = m_window[3];
+}
+
+void InkSmoother::finish(QVector<Point>& out)
+{
+    if (m_settings.catmullRom && m_count == 2)
+    {
+        m_window[3] = m_window[2];
+        emitSegment(out);
+    }
+
+    reset();
+}
+
+InkSmoother::Sample InkSmoother::filter(const QPointF& point, double width, qint64 timestamp)
+{
+    if (!m_settings.oneEuro)
+    {
+        return Sample{point, width, timestamp};
+    }
+
+    if (!m_filtering)
+    {
+        m_filtering = true;
+        m_filtered = point;
+        m_speed = QPointF();
+        m_lastTime = timestamp;
+        return Sample{point, width, timestamp};
+    }
+
+    double dt = (timestamp - m_lastTime) / 1000.0;
+    if (dt <= 0)
+    {
+        dt = DEFAULT_INTERVAL;
+    }
+    m_lastTime = timestamp;
+
+    // Both axes share one cutoff from the speed, so the filter doesn't bend diagonal lines.
+    const QPointF rawSpeed = (point - m_filtered) / dt;
+    m_speed += (rawSpeed - m_speed) * lowPassAlpha(m_settings.derivativeCutoff, dt);
+
+    const double cutoff = m_settings.minCutoff + m_settings.beta * length(m_speed);
+    m_filtered += (point - m_filtered) * lowPassAlpha(cutoff, dt);
+
+    return Sample{m_filtered, width, timestamp};
+}
+
+void InkSmoother::emitSegment(QVector<Point>& out)
+{
+    const Sample& from = m_window[1];
+    const Sample& to = m_window[2];
+
+    const int steps = qBound(1, qCeil(length(to.position - from.position) / m_settings.spacing),
+                             qMax(1, m_settings.maxSubdivisions));
+
+    for (int i = 1; i < steps; i++)
+    {
+        const double u = static_cast<double>(i) / steps;
+        emitPoint(splinePoint(m_window[0].position, from.position, to.position,
+                              m_window[3].position, u),
+                  from.width + (to.width - from.width) * u,
+                  from.timestamp + qRound64((to.timestamp - from.timestamp) * u), out);
+    }
+
+    emitPoint(to.position, to.width, to.timestamp, out);
+}
+
+void InkSmoother::emitPoint(const QPointF& position, double width, qint64 timestamp,
+                            QVector<Point>& out)
+{
+    // Strokes store whole pixels, drop the points that round onto the previous one.
+    const QPoint rounded = position.toPoint();
+    if (m_emitted && rounded == m_lastEmitted)
+    {
+        return;
+    }
+
+    m_emitted = true;
+    m_lastEmitted = rounded;
+    out.append(Point{rounded, width, timestamp});
+}
@@ -0,0 +1,103 @@
+#ifndef INK_SMOOTHING_H
+#define INK_SMOOTHING_H
+
+#include <QPoint>
+#include <QPointF>
+#include <QVector>
+
+/*! \brief Streaming smoothing of pen input, between the pen samples and InkStroke::addPoint().
+ *
+ *  A one-euro filter removes the jitter: a low pass whose cutoff rises with the pen speed, so a
+ *  slow pen is smoothed hard and a fast one barely lags. A centripetal Catmull-Rom spline through
+ *  the filtered samples then adds points along curves, at most spacing px apart. The stroke stores
+ *  the result, so nothing is smoothed again when it is drawn.
+ *
+ *  The spline segment to a sample needs the sample after it, so with Catmull-Rom on the output
+ *  trails the input by latencySamples() samples until finish() is called at pen up.
+ */
+class InkSmoother
+{
+public:
+    struct Settings
+    {
+        bool oneEuro = true;
+        // Cutoff in Hz at rest. Lower removes more jitter from a slow pen.
+        double minCutoff = 2.0;
+        // Cutoff increase per px/s of pen speed. Higher lags less on a fast pen.
+        double beta = 0.05;
+        // Cutoff in Hz of the speed estimate.
+        double derivativeCutoff = 1.0;
+
+        bool catmullRom = true;
+        // Largest distance in px between the points added on a segment.
+        double spacing = 4.0;
+        int maxSubdivisions = 8;
+    };
+
+    struct Point
+    {
+        QPoint position;
+        double width;
+        // Capture time in ms, interpolated for the points added between samples.
+        qint64 timestamp;
+    };
+
+    InkSmoother();
+    explicit InkSmoother(const Settings& settings);
+
+    Settings settings() const { return m_settings; }
+
+    /*! \brief Takes effect at the next stroke.
+     */
+    void setSettings(const Settings& settings) { m_settings = settings; }
+
+    /*! \brief Samples a point is held back before it is output: 1 with Catmull-Rom, else 0.
+     *  The one-euro filter adds no samples of latency, only a speed dependent lag.
+     */
+    int latencySamples() const;
+
+    /*! \brief Start a new stroke.
+     */
+    void reset();
+
+    /*! \brief Filter a pen sample. timestamp is the capture time in ms.
+     *  \param out Receives the points that are final now, possibly none.
+     */
+    void push(const QPoint& point, double width, qint64 timestamp, QVector<Point>& out);
+
+    /*! \brief Output the points still held back at the end of the stroke, then reset().
+     */
+    void finish(QVector<Point>& out);
+
+private:
+    struct Sample
+    {
+        QPointF position;
+        double width;
+        qint64 timestamp;
+    };
+
+    Sample filter(const QPointF& point, double width, qint64 timestamp);
+
+    // Output the spline segment from m_window[1] to m_window[2].
+    void emitSegment(QVector<Point>& out);
+    void emitPoint(const QPointF& position, double width, qint64 timestamp, QVector<Point>& out);
+
+private:
+    Settings m_settings;
+
+    // One-euro filter state.
+    bool m_filtering;
+    QPointF m_filtered;
+    QPointF m_speed;
+    qint64 m_lastTime;
+
+    // The last 4 filtered samples, the spline control points. m_count of them are valid.
+    Sample m_window[4];
+    int m_count;
+
+    bool m_emitted;
+    QPoint m_lastEmitted;
+};
+
+#endif // INK_SMOOTHING_H
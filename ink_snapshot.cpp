@@ -0,0 +1,47 @@
+#include <QJsonArray>
+#include <QJsonDocument>
+
+#include "binary_codec.h"
+#include "frame_profiler.h"
+#include "ink_journal.h"
+#include "ink_snapshot.h"
+#include "ink_stroke.h"
+
+InkSnapshot::InkSnapshot()
+    : m_revision(0)
+{ }
+
+InkSnapshot::InkSnapshot(const QVector<QSharedPointer<InkStroke>>& strokes, QSize canvasSize, quint64 revision)
+    : m_strokes(strokes)
+    , m_canvasSize(canvasSize)
+    , m_revision(revision)
+{ }
+
+QString InkSnapshot::toJsonString() const
+{
+    PROFILE_SCOPE("InkSnapshot::toJsonString");
+
+    QJsonArray array;
+    for (const auto& stroke : m_strokes)
+    {
+        array.append(stroke->toJson());
+    }
+
+    return QString(QJsonDocument(array).toJson(QJsonDocument::Compact));
+}
+
+QByteArray InkSnapshot::toBinary() const
+{
+    PROFILE_SCOPE("InkSnapshot::toBinary");
+
+    QByteArray out;
+    appendVarint(out, qMax(0, m_canvasSize.width()));
+    appendVarint(out, qMax(0, m_canvasSize.height()));
+    appendVarint(out, m_strokes.size());
+    for (const auto& stroke : m_strokes)
+    {
+        InkJournal::appendStroke(out, *stroke);
+    }
+
+    return out;
+}
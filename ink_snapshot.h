@@ -0,0 +1,52 @@
+#ifndef INK_SNAPSHOT_H
+#define INK_SNAPSHOT_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+class InkStroke;
+
+/*! \brief Immutable view of the committed strokes of an InkData at one revision.
+ *
+ *  Taking one (InkData::snapshot()) copies an implicitly shared vector of stroke pointers, which
+ *  is O(1); the data detaches its own copy on its next change. Committed strokes are never
+ *  modified, so a snapshot can be read, e.g. serialized, on any thread while the data keeps
+ *  changing on the GUI thread. The stroke being drawn is not part of it.
+ */
+class InkSnapshot
+{
+public:
+    InkSnapshot();
+    InkSnapshot(const QVector<QSharedPointer<InkStroke>>& strokes, QSize canvasSize, quint64 revision);
+
+    int strokeCount() const { return m_strokes.size(); }
+    QSharedPointer<const InkStroke> stroke(int index) const { return m_strokes.at(index); }
+
+    QSize canvasSize() const { return m_canvasSize; }
+
+    /*! \brief InkData::revision() the snapshot was taken at.
+     */
+    quint64 revision() const { return m_revision; }
+
+    /*! \brief Same format as InkData::toJsonString().
+     */
+    QString toJsonString() const;
+
+    /*! \brief Canvas width and height, stroke count, then the strokes as in
+     *  InkJournal::appendStroke().
+     */
+    QByteArray toBinary() const;
+
+private:
+    QVector<QSharedPointer<InkStroke>> m_strokes;
+    QSize m_canvasSize;
+    quint64 m_revision;
+};
+
+Q_DECLARE_METATYPE(InkSnapshot)
+
+#endif // INK_SNAPSHOT_H
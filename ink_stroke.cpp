@@ -1,5 +1,64 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "binary_codec.h"
 #include "ink_stroke.h"
 
+namespace
+{
+    // Points between two timestamp checkpoints.
+    const int TIME_CHECKPOINT_INTERVAL = 32;
+
+    // Decode the next timestamp. The delta after the first point is taken as zero.
+    inline qint64 readTimestamp(BinaryReader& reader, int index, qint64& time, qint64& delta)
+    {
+        delta += reader.readZigzag();
+        time += delta;
+        if (index == 0)
+        {
+            delta = 0;
+        }
+        return time;
+    }
+
+    // MurmurHash3's 64-bit finalizer.
+    inline quint64 mixHash(quint64 value)
+    {
+        value ^= value >> 33;
+        value *= 0xff51afd7ed558ccdULL;
+        value ^= value >> 33;
+        value *= 0xc4ceb9fe1a85ec53ULL;
+        value ^= value >> 33;
+        return value;
+    }
+
+    inline quint64 combineHash(quint64 hash, quint64 value)
+    {
+        return mixHash(hash ^ mixHash(value));
+    }
+
+    inline QJsonObject jsonPoint(const QPoint& point, double width)
+    {
+        return QJsonObject{
+            {"x", point.x()},
+            {"y", point.y()},
+            {"w", width}
+        };
+    }
+
+    inline quint64 pointHash(quint64 hash, const QPoint& point, double width)
+    {
+        quint64 widthBits;
+        std::memcpy(&widthBits, &width, sizeof(widthBits));
+
+        hash = combineHash(hash, (static_cast<quint64>(static_cast<quint32>(point.x())) << 32) |
+                                 static_cast<quint32>(point.y()));
+        return combineHash(hash, widthBits);
+    }
+}
+
 InkStroke::InkStroke(QObject *parent)
     : InkStroke(QColor(), QJsonArray(), parent)
 { }
@@ -10,12 +69,24 @@ InkStroke::InkStroke(const QColor& color, QObject* parent)
 
 InkStroke::InkStroke(const QJsonObject& stroke, QObject* parent)
     : InkStroke(stroke["color"].toString(), stroke["points"].toArray(), parent)
-{ }
+{
+    if (stroke.contains("t"))
+    {
+        setTimestampData(QByteArray::fromBase64(stroke["t"].toString().toLatin1()));
+    }
+}
 
 InkStroke::InkStroke(const QColor& color, const QJsonArray points, QObject* parent)
     : QObject(parent)
     , m_color(color)
     , m_points(points)
+    , m_pointsHash(0)
+    , m_maxWidth(0)
+    , m_compact(false)
+    , m_smoothed(false)
+    , m_timedPoints(0)
+    , m_lastTime(0)
+    , m_lastDelta(0)
 { 
     int count = pointCount();
     m_allPoints.reserve(count);
@@ -23,9 +94,15 @@ InkStroke::InkStroke(const QColor& color, const QJsonArray points, QObject* pare
     {
         const InkPoint& ip = point(i);
         m_allPoints.push_back(qMakePair(ip.point, ip.size));
+        accumulatePoint(ip.point, ip.size);
     }
 }
 
+quint64 InkStroke::contentHash() const
+{
+    return combineHash(combineHash(m_pointsHash, m_color.rgba()), static_cast<quint64>(pointCount()));
+}
+
 QColor InkStroke::color() const
 {
     return m_color;
@@ -42,6 +119,13 @@ void InkStroke::setColor(QColor clr)
 
 InkPoint InkStroke::point(int index) const
 {
+    if (m_compact)
+    {
+        const CompactPoint& compactPoint = m_compactPoints.at(index);
+        return InkPoint{ m_origin + QPoint(compactPoint.dx, compactPoint.dy),
+                         compactPoint.width / double(COMPACT_WIDTH_SCALE) };
+    }
+
     QJsonObject jsonPt(m_points.at(index).toObject());
     InkPoint inkPt { QPoint(jsonPt.value("x").toInt(),
                    jsonPt.value("y").toInt()),
@@ -49,12 +133,45 @@ InkPoint InkStroke::point(int index) const
     return inkPt;
 }
 
+QVector<QPair<QPoint, int>> InkStroke::points() const
+{
+    if (!m_compact)
+    {
+        return m_allPoints;
+    }
+
+    QVector<QPair<QPoint, int>> result;
+    result.reserve(pointCount());
+    for (int i = 0; i < pointCount(); i++)
+    {
+        result.push_back(getPoint(i));
+    }
+    return result;
+}
+
 QJsonObject InkStroke::toJson() const
 {
-    return QJsonObject{
+    QJsonArray points = m_points;
+    if (m_compact)
+    {
+        for (int i = 0; i < pointCount(); i++)
+        {
+            const InkPoint inkPoint = point(i);
+            points.append(jsonPoint(inkPoint.point, inkPoint.size));
+        }
+    }
+
+    QJsonObject json{
         {"color", m_color.name()},
-        {"points", m_points}
+        {"points", points}
     };
+
+    if (hasTimestamps())
+    {
+        json["t"] = QString::fromLatin1(m_timeData.toBase64());
+    }
+
+    return json;
 }
 
 void InkStroke::drawSmoothStroke(QPainter& painter, const QPointF& previous,
@@ -110,6 +227,20 @@ void InkStroke::draw(QPainter& painter, bool mono, double scale) const
         painter.setPen(pen);
         painter.drawPoint(bound.center());
     }
+    else if (m_smoothed)
+    {
+        // Already smooth, each segment as wide as its end point.
+        QPointF previous = QPointF(getPoint(0).first) * scale;
+        for (int i = 1; i < ptCount; i++)
+        {
+            const auto pt = getPoint(i);
+            const QPointF current = QPointF(pt.first) * scale;
+            pen.setWidthF(pt.second * scale);
+            painter.setPen(pen);
+            painter.drawLine(previous, current);
+            previous = current;
+        }
+    }
     else
     {
         QPointF ptStart, ptEnd;
@@ -139,31 +270,298 @@ void InkStroke::draw(QPainter& painter, bool mono, double scale) const
 
 QRect InkStroke::boundRect() const
 {
-    QPolygon polygon;
-    int ptCount = pointCount();
-    if(ptCount == 0)
+    if(pointCount() == 0)
     {
         return QRect();
     }
 
-    for(int i = 0; i < ptCount; i++)
+    return m_pointBounds.adjusted(-30, -30, 30, 30);
+}
+
+void InkStroke::addPoint(const QPoint& point, double pen_width)
+{
+    // Keep a timed stroke timed.
+    if (m_timedPoints > 0 && hasTimestamps())
     {
-        polygon << this->getPoint(i).first;
+        appendTimestamp(m_lastTime);
     }
-    polygon << this->getPoint(0).first;
 
-    return polygon.boundingRect().adjusted(-30, -30, 30, 30);
+    appendPoint(point, pen_width);
 }
 
-void InkStroke::addPoint(const QPoint& point, double pen_width)
+void InkStroke::addPoint(const QPoint& point, double pen_width, qint64 timestamp)
 {
-    m_points.push_back(QJsonObject{
-                           {"x", point.x()},
-                           {"y", point.y()},
-                           {"w", pen_width}
-                       });
+    if (m_timedPoints == pointCount())
+    {
+        appendTimestamp(m_timedPoints > 0 ? qMax(timestamp, m_lastTime) : timestamp);
+    }
+
+    appendPoint(point, pen_width);
+}
+
+void InkStroke::appendPoint(const QPoint& point, double pen_width)
+{
+    if (m_compact)
+    {
+        expand();
+    }
+
+    m_points.push_back(jsonPoint(point, pen_width));
 
     m_allPoints.push_back(qMakePair(point,pen_width));
+    accumulatePoint(point, pen_width);
 
     emit pointAdded(point, pen_width);
 }
+
+bool InkStroke::hasTimestamps() const
+{
+    return m_timedPoints > 0 && m_timedPoints == pointCount();
+}
+
+void InkStroke::appendTimestamp(qint64 time)
+{
+    if (m_timedPoints % TIME_CHECKPOINT_INTERVAL == 0)
+    {
+        m_timeCheckpoints.push_back(TimeCheckpoint{ m_timeData.size(), m_lastTime, m_lastDelta });
+    }
+
+    const qint64 delta = time - m_lastTime;
+    appendZigzag(m_timeData, delta - m_lastDelta);
+
+    m_lastDelta = m_timedPoints == 0 ? 0 : delta;
+    m_lastTime = time;
+    m_timedPoints++;
+}
+
+void InkStroke::setTimestampData(const QByteArray& data)
+{
+    const int count = pointCount();
+    QVector<qint64> times;
+    times.reserve(count);
+
+    BinaryReader reader(data);
+    qint64 time = 0;
+    qint64 delta = 0;
+    for (int i = 0; i < count && !reader.atEnd(); i++)
+    {
+        times.push_back(readTimestamp(reader, i, time, delta));
+    }
+
+    if (reader.hasError() || times.size() != count)
+    {
+        return;
+    }
+
+    for (auto t : times)
+    {
+        appendTimestamp(t);
+    }
+}
+
+qint64 InkStroke::timestamp(int index) const
+{
+    const auto& checkpoint = m_timeCheckpoints.at(index / TIME_CHECKPOINT_INTERVAL);
+
+    BinaryReader reader(m_timeData, checkpoint.offset);
+    qint64 time = checkpoint.previousTime;
+    qint64 delta = checkpoint.previousDelta;
+
+    for (int i = index - index % TIME_CHECKPOINT_INTERVAL; i < index; i++)
+    {
+        readTimestamp(reader, i, time, delta);
+    }
+
+    return readTimestamp(reader, index, time, delta);
+}
+
+qint64 InkStroke::startTime() const
+{
+    return hasTimestamps() ? timestamp(0) : 0;
+}
+
+qint64 InkStroke::endTime() const
+{
+    return hasTimestamps() ? m_lastTime : 0;
+}
+
+int InkStroke::pointCountAt(qint64 time) const
+{
+    if (!hasTimestamps() || time >= m_lastTime)
+    {
+        return pointCount();
+    }
+
+    // Last checkpoint whose preceding point is not after time. The first one has no preceding point.
+    auto it = std::upper_bound(m_timeCheckpoints.begin() + 1, m_timeCheckpoints.end(), time,
+                               [](qint64 t, const TimeCheckpoint& checkpoint) {
+        return t < checkpoint.previousTime;
+    });
+    const int checkpointIndex = static_cast<int>(it - m_timeCheckpoints.begin()) - 1;
+    const auto& checkpoint = m_timeCheckpoints.at(checkpointIndex);
+
+    BinaryReader reader(m_timeData, checkpoint.offset);
+    qint64 pointTime = checkpoint.previousTime;
+    qint64 delta = checkpoint.previousDelta;
+
+    int index = checkpointIndex * TIME_CHECKPOINT_INTERVAL;
+    while (index < m_timedPoints && readTimestamp(reader, index, pointTime, delta) <= time)
+    {
+        index++;
+    }
+
+    return index;
+}
+
+QSharedPointer<InkStroke> InkStroke::left(int count) const
+{
+    count = qBound(0, count, pointCount());
+
+    auto stroke = QSharedPointer<InkStroke>::create(m_color);
+    if (m_compact)
+    {
+        stroke->m_compact = true;
+        stroke->m_origin = m_origin;
+        stroke->m_compactPoints = m_compactPoints.mid(0, count);
+    }
+    else
+    {
+        stroke->m_allPoints = m_allPoints.mid(0, count);
+        for (int i = 0; i < count; i++)
+        {
+            stroke->m_points.append(m_points.at(i));
+        }
+    }
+    stroke->rebuildPointCache();
+    stroke->m_smoothed = m_smoothed;
+
+    if (hasTimestamps())
+    {
+        BinaryReader reader(m_timeData);
+        qint64 time = 0;
+        qint64 delta = 0;
+        for (int i = 0; i < count; i++)
+        {
+            stroke->appendTimestamp(readTimestamp(reader, i, time, delta));
+        }
+    }
+
+    return stroke;
+}
+
+QSharedPointer<InkStroke> InkStroke::transformed(const QTransform& transform) const
+{
+    const double widthScale = std::sqrt(std::abs(transform.determinant()));
+    const bool timed = hasTimestamps();
+
+    auto stroke = QSharedPointer<InkStroke>::create(m_color);
+    stroke->m_smoothed = m_smoothed;
+    for (int i = 0; i < pointCount(); i++)
+    {
+        const InkPoint inkPoint = point(i);
+        const QPoint mapped = transform.map(QPointF(inkPoint.point)).toPoint();
+        if (timed)
+        {
+            stroke->addPoint(mapped, inkPoint.size * widthScale, timestamp(i));
+        }
+        else
+        {
+            stroke->addPoint(mapped, inkPoint.size * widthScale);
+        }
+    }
+
+    return stroke;
+}
+
+bool InkStroke::compact()
+{
+    if (m_compact)
+    {
+        return true;
+    }
+
+    const int count = pointCount();
+    const QPoint origin = count > 0 ? point(0).point : QPoint();
+
+    QVector<CompactPoint> compactPoints;
+    compactPoints.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        const InkPoint inkPoint = point(i);
+        const QPoint offset = inkPoint.point - origin;
+        const int width = qRound(inkPoint.size * COMPACT_WIDTH_SCALE);
+
+        if (offset.x() < std::numeric_limits<qint16>::min() || offset.x() > std::numeric_limits<qint16>::max() ||
+            offset.y() < std::numeric_limits<qint16>::min() || offset.y() > std::numeric_limits<qint16>::max() ||
+            width < 0 || width > std::numeric_limits<quint16>::max())
+        {
+            return false;
+        }
+
+        compactPoints.push_back(CompactPoint{ static_cast<qint16>(offset.x()), static_cast<qint16>(offset.y()),
+                                              static_cast<quint16>(width) });
+    }
+
+    m_compact = true;
+    m_origin = origin;
+    m_compactPoints = compactPoints;
+    m_points = QJsonArray();
+    m_allPoints = QVector<QPair<QPoint, int>>();
+    m_timeData.squeeze();
+    m_timeCheckpoints.squeeze();
+
+    // Widths may have been rounded.
+    rebuildPointCache();
+    return true;
+}
+
+void InkStroke::expand()
+{
+    const int count = pointCount();
+
+    QJsonArray points;
+    QVector<QPair<QPoint, int>> allPoints;
+    allPoints.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        const InkPoint inkPoint = point(i);
+        points.append(jsonPoint(inkPoint.point, inkPoint.size));
+        allPoints.push_back(qMakePair(inkPoint.point, static_cast<int>(inkPoint.size)));
+    }
+
+    m_compact = false;
+    m_compactPoints = QVector<CompactPoint>();
+    m_points = points;
+    m_allPoints = allPoints;
+}
+
+void InkStroke::accumulatePoint(const QPoint& point, double width)
+{
+    m_pointsHash = pointHash(m_pointsHash, point, width);
+    m_maxWidth = qMax(m_maxWidth, width);
+
+    if (m_pointBounds.isEmpty())
+    {
+        m_pointBounds = QRect(point, point);
+    }
+    else
+    {
+        m_pointBounds.setLeft(qMin(m_pointBounds.left(), point.x()));
+        m_pointBounds.setRight(qMax(m_pointBounds.right(), point.x()));
+        m_pointBounds.setTop(qMin(m_pointBounds.top(), point.y()));
+        m_pointBounds.setBottom(qMax(m_pointBounds.bottom(), point.y()));
+    }
+}
+
+void InkStroke::rebuildPointCache()
+{
+    m_pointsHash = 0;
+    m_pointBounds = QRect();
+    m_maxWidth = 0;
+
+    for (int i = 0; i < pointCount(); i++)
+    {
+        const InkPoint inkPoint = point(i);
+        accumulatePoint(inkPoint.point, inkPoint.size);
+    }
+}
@@ -5,6 +5,10 @@
 #include <QPainter>
 #include <QJsonArray>
 #include <QJsonObject>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QTransform>
+#include <QVector>
 
 #include "ink_point.h"
 
@@ -19,26 +23,114 @@ class InkStroke : public QObject {
   InkStroke(const QColor& color, const QJsonArray points, QObject* parent = nullptr);
 
   void addPoint(const QPoint& point, double pen_width);
+
+  /*! \brief Add a point with its capture time in milliseconds (penTimestamp() clock).
+   *  A stroke keeps timestamps only when every point has one. Times never go backwards.
+   */
+  void addPoint(const QPoint& point, double pen_width, qint64 timestamp);
+
+  bool hasTimestamps() const;
+
+  /*! \brief Capture time of a point. Decodes at most one checkpoint interval of timestamps.
+   */
+  qint64 timestamp(int index) const;
+  qint64 startTime() const;
+  qint64 endTime() const;
+
+  /*! \brief Number of points captured at or before time, O(log n).
+   *  All points when the stroke has no timestamps.
+   */
+  int pointCountAt(qint64 time) const;
+
+  /*! \brief New stroke with the first count points (and their timestamps) of this one.
+   */
+  QSharedPointer<InkStroke> left(int count) const;
+
+  /*! \brief New stroke with the points mapped through transform, widths scaled by its
+   *  area scale. Timestamps are kept.
+   */
+  QSharedPointer<InkStroke> transformed(const QTransform& transform) const;
+
+  /*! \brief Timestamps as stored: the first one, then per point the zigzag varint of
+   *  the difference between consecutive deltas. A steady pen rate takes one byte a point.
+   */
+  inline const QByteArray& timestampData() const
+  {
+      return m_timeData;
+  }
+
+  /*! \brief 64-bit hash of the color and the points (position and width), not the timestamps.
+   *  Kept up to date by addPoint(), so comparing strokes by content is O(1).
+   */
+  quint64 contentHash() const;
+
   QColor color() const;
   void setColor(QColor clr);
   inline int pointCount() const
   {
-      return m_points.size();
+      return m_compact ? m_compactPoints.size() : m_points.size();
   }
   void draw(QPainter& painter, bool mono = false, double scale = 1.0) const;
   InkPoint point(int index) const;
   QJsonObject toJson() const;
   QRect boundRect() const;
 
-  inline const QPair<QPoint, int>& getPoint(int index) const
+  /*! \brief Bounding box of the point positions (not the width), kept up to date by addPoint().
+   */
+  inline QRect pointBounds() const
+  {
+      return m_pointBounds;
+  }
+
+  /*! \brief Largest point width, kept up to date by addPoint().
+   */
+  inline double maxWidth() const
+  {
+      return m_maxWidth;
+  }
+
+  inline QPair<QPoint, int> getPoint(int index) const
   {
+      if (m_compact)
+      {
+          const CompactPoint& compactPoint = m_compactPoints.at(index);
+          return qMakePair(m_origin + QPoint(compactPoint.dx, compactPoint.dy),
+                           static_cast<int>(compactPoint.width / COMPACT_WIDTH_SCALE));
+      }
       return m_allPoints.at(index);
   }
 
+  /*! \brief All points. Shares the stored vector, decodes a compact stroke.
+   */
+  QVector<QPair<QPoint, int>> points() const;
+
+  /*! \brief Store the points in 6 bytes each: int16 offsets from the first point and the
+   *  width in 1/256 px, instead of a JSON object and a QPair per point. Widths are rounded to
+   *  that precision. Reading is transparent; adding a point expands the stroke again.
+   *  \return False, leaving the stroke as is, when an offset or width doesn't fit.
+   */
+  bool compact();
+
+  bool isCompact() const { return m_compact; }
+
+  /*! \brief The points were smoothed on input (InkSmoother), so draw() joins them with straight
+   *  segments instead of smoothing every repaint. Not saved: a loaded stroke is drawn smoothed.
+   */
+  void setSmoothed(bool smoothed) { m_smoothed = smoothed; }
+  bool isSmoothed() const { return m_smoothed; }
+
  signals:
   void pointAdded(const QPoint& point, const double pen_width);
 
  private:
+  void appendPoint(const QPoint& point, double pen_width);
+  void appendTimestamp(qint64 time);
+  void setTimestampData(const QByteArray& data);
+  void expand();
+  // Fold a new point into the hash, bounds and max width.
+  void accumulatePoint(const QPoint& point, double width);
+  void rebuildPointCache();
+
   void drawSmoothStroke(QPainter& painter, const QPointF& previous, const QPointF& point,
                         const QPointF& next) const;
 
@@ -47,6 +139,41 @@ private:
   QColor m_color;
   QJsonArray m_points;
   QVector<QPair<QPoint,int>> m_allPoints;
+  // Hash of the points so far, see contentHash().
+  quint64 m_pointsHash;
+  QRect m_pointBounds;
+  double m_maxWidth;
+
+  // Compact storage, see compact(). m_points and m_allPoints are empty then.
+  static const int COMPACT_WIDTH_SCALE = 256;
+
+  struct CompactPoint
+  {
+      qint16 dx;
+      qint16 dy;
+      // Width in 1/COMPACT_WIDTH_SCALE px.
+      quint16 width;
+  };
+
+  bool m_compact;
+  QPoint m_origin;
+  QVector<CompactPoint> m_compactPoints;
+
+  bool m_smoothed;
+
+  // Decoder state before every TIME_CHECKPOINT_INTERVAL-th timestamp, for random access.
+  struct TimeCheckpoint
+  {
+      int offset;
+      qint64 previousTime;
+      qint64 previousDelta;
+  };
+
+  QByteArray m_timeData;
+  QVector<TimeCheckpoint> m_timeCheckpoints;
+  int m_timedPoints;
+  qint64 m_lastTime;
+  qint64 m_lastDelta;
 };
 
 //bool SHAREDSHARED_EXPORT operator==(const InkStroke& stroke1, const InkStroke& stroke2);
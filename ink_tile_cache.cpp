@@ -0,0 +1,365 @@
+#include <QFutureWatcher>
+#include <QPainter>
+#include <QThread>
+#include <QtConcurrent>
+#include <QtMath>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "frame_profiler.h"
+#include "ink_geometry.h"
+#include "ink_stroke.h"
+#include "ink_tile_cache.h"
+
+namespace
+{
+    // Up to this much over a level's scale the level is stretched rather than the next one used.
+    const qreal LEVEL_STRETCH = 0.25;
+
+    qreal levelScale(int level)
+    {
+        return std::ldexp(1.0, level);
+    }
+
+    int imageCost(const QImage& image)
+    {
+        return image.bytesPerLine() * image.height();
+    }
+}
+
+// Bound by reference in qBound().
+const int InkTileCache::MIN_LEVEL;
+const int InkTileCache::MAX_LEVEL;
+
+InkTileCache::InkTileCache(QObject* parent)
+    : QObject(parent)
+    , m_cache(DEFAULT_MEMORY_BUDGET)
+    , m_memoryBudget(DEFAULT_MEMORY_BUDGET)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+InkTileCache::~InkTileCache()
+{
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void InkTileCache::setInkData(QSharedPointer<InkData> data)
+{
+    if (m_data)
+    {
+        disconnect(m_data.data(), nullptr, this, nullptr);
+    }
+
+    m_data = data;
+
+    if (m_data)
+    {
+        connect(m_data.data(), &InkData::strokeAdded, this, &InkTileCache::onStrokeAdded);
+        connect(m_data.data(), &InkData::strokeRemoved, this, &InkTileCache::onStrokeRemoved);
+        connect(m_data.data(), &InkData::strokeInserted, this, &InkTileCache::onStrokeInserted);
+        connect(m_data.data(), &InkData::strokesEdited, this, &InkTileCache::onStrokesEdited);
+        connect(m_data.data(), &InkData::cleared, this, &InkTileCache::invalidateAll);
+        connect(m_data.data(), &InkData::strokesReset, this, &InkTileCache::invalidateAll);
+    }
+
+    invalidateAll();
+}
+
+void InkTileCache::setMemoryBudget(int bytes)
+{
+    m_memoryBudget = bytes;
+    m_cache.setMaxCost(bytes);
+    m_dropped.clear();
+}
+
+int InkTileCache::levelForScale(qreal scale)
+{
+    if (scale <= 0)
+    {
+        return MIN_LEVEL;
+    }
+
+    return qBound(MIN_LEVEL, qCeil(std::log2(scale) - LEVEL_STRETCH), MAX_LEVEL);
+}
+
+QVector<InkTile> InkTileCache::tiles(const QRectF& visibleRect, qreal scale)
+{
+    PROFILE_SCOPE("InkTileCache::tiles");
+
+    QVector<InkTile> result;
+    m_queue.clear();
+
+    if (!m_data || visibleRect.isEmpty() || scale <= 0)
+    {
+        return result;
+    }
+
+    const int level = levelForScale(scale);
+    const qreal tileExtent = TILE_SIZE / levelScale(level);
+    const int left = qFloor(visibleRect.left() / tileExtent);
+    const int top = qFloor(visibleRect.top() / tileExtent);
+    const int right = qCeil(visibleRect.right() / tileExtent);
+    const int bottom = qCeil(visibleRect.bottom() / tileExtent);
+    const QRectF fullTile(0, 0, TILE_SIZE, TILE_SIZE);
+
+    for (int y = top; y < bottom; y++)
+    {
+        for (int x = left; x < right; x++)
+        {
+            const TileKey key{ level, x, y };
+            const QRectF rect = tileRect(key);
+
+            if (Tile* tile = m_cache.object(key))
+            {
+                m_stats.hits++;
+                result.push_back(InkTile{ tile->image, fullTile, rect });
+                if (tile->stale)
+                {
+                    m_queue.push_back(key);
+                }
+                continue;
+            }
+
+            m_stats.misses++;
+            if (!m_dropped.contains(key))
+            {
+                m_queue.push_back(key);
+            }
+
+            // Stretch the part of a coarser tile until this one is rendered.
+            for (int coarser = level - 1; coarser >= MIN_LEVEL; coarser--)
+            {
+                const int shift = level - coarser;
+                const TileKey parentKey{ coarser, x >> shift, y >> shift };
+                if (Tile* parent = m_cache.object(parentKey))
+                {
+                    const QRectF parentRect = tileRect(parentKey);
+                    const qreal parentScale = levelScale(coarser);
+                    const QRectF source((rect.topLeft() - parentRect.topLeft()) * parentScale,
+                                        rect.size() * parentScale);
+                    result.push_back(InkTile{ parent->image, source, rect });
+                    break;
+                }
+            }
+        }
+    }
+
+    // Never evict the view's own tiles to make room for each other: keep room for them and as
+    // many stand-ins. They were all just looked up, so anything trimmed is out of view.
+    const qint64 viewCost = 2LL * (right - left) * (bottom - top) * TILE_SIZE * TILE_SIZE * 4;
+    const int maxCost = static_cast<int>(qMin<qint64>(qMax<qint64>(m_memoryBudget, viewCost),
+                                                      std::numeric_limits<int>::max()));
+    if (maxCost != m_cache.maxCost())
+    {
+        m_cache.setMaxCost(maxCost);
+        m_dropped.clear();
+    }
+
+    // The middle of the view first.
+    const QPointF center = visibleRect.center();
+    std::sort(m_queue.begin(), m_queue.end(), [center](const TileKey& a, const TileKey& b) {
+        return (tileRect(a).center() - center).manhattanLength() <
+               (tileRect(b).center() - center).manhattanLength();
+    });
+
+    startRenders();
+
+    return result;
+}
+
+void InkTileCache::waitForFinished()
+{
+    m_pool.waitForDone();
+}
+
+void InkTileCache::onStrokeAdded(QSharedPointer<InkStroke> addedStroke)
+{
+    PROFILE_SCOPE("InkTileCache::onStrokeAdded");
+
+    // Not saved (InkData::saveStroke() off): the stroke was only shown while drawn.
+    const int count = m_data->strokeCount();
+    if (count == 0 || m_data->stroke(count - 1) != addedStroke)
+    {
+        return;
+    }
+
+    const QRectF bounds = addedStroke->boundRect();
+    const InkStrokeGeometry geometry = InkStrokeGeometry::fromStroke(*addedStroke);
+
+    // The stroke goes on top of the others, so drawing it into the cached tiles is exact.
+    for (const TileKey& key : m_cache.keys())
+    {
+        const QRectF rect = tileRect(key);
+        if (!rect.intersects(bounds)) continue;
+
+        Tile* tile = m_cache.object(key);
+        QPainter painter(&tile->image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.scale(levelScale(key.level), levelScale(key.level));
+        painter.translate(-rect.topLeft());
+        drawStrokeGeometry(painter, geometry);
+    }
+
+    // Renders running from a snapshot without the stroke.
+    for (const TileKey& key : m_rendering)
+    {
+        if (tileRect(key).intersects(bounds))
+        {
+            m_staleRenders.insert(key);
+        }
+    }
+
+    emit tilesChanged();
+}
+
+void InkTileCache::onStrokeRemoved(int index, QSharedPointer<InkStroke> stroke)
+{
+    Q_UNUSED(index)
+
+    invalidate(stroke->boundRect());
+    emit tilesChanged();
+}
+
+void InkTileCache::onStrokeInserted(int index, QSharedPointer<InkStroke> stroke)
+{
+    if (index == m_data->strokeCount() - 1)
+    {
+        onStrokeAdded(stroke);
+        return;
+    }
+
+    invalidate(stroke->boundRect());
+    emit tilesChanged();
+}
+
+void InkTileCache::onStrokesEdited(const QVector<InkStrokeEdit>& edits)
+{
+    for (const auto& edit : edits)
+    {
+        invalidate(edit.stroke->boundRect());
+    }
+
+    emit tilesChanged();
+}
+
+void InkTileCache::invalidateAll()
+{
+    m_cache.clear();
+    m_queue.clear();
+    m_dropped.clear();
+    m_staleRenders = m_rendering;
+
+    emit tilesChanged();
+}
+
+QRectF InkTileCache::tileRect(const TileKey& key)
+{
+    const qreal extent = TILE_SIZE / levelScale(key.level);
+    return QRectF(key.x * extent, key.y * extent, extent, extent);
+}
+
+void InkTileCache::invalidate(const QRectF& rect)
+{
+    for (const TileKey& key : m_cache.keys())
+    {
+        if (tileRect(key).intersects(rect))
+        {
+            m_cache.object(key)->stale = true;
+        }
+    }
+
+    for (const TileKey& key : m_rendering)
+    {
+        if (tileRect(key).intersects(rect))
+        {
+            m_staleRenders.insert(key);
+        }
+    }
+
+    m_dropped.clear();
+}
+
+void InkTileCache::startRenders()
+{
+    while (m_rendering.size() < m_pool.maxThreadCount() && !m_queue.isEmpty())
+    {
+        const TileKey key = m_queue.takeFirst();
+        if (m_rendering.contains(key)) continue;
+
+        m_rendering.insert(key);
+
+        auto watcher = new QFutureWatcher<RenderResult>(this);
+        connect(watcher, &QFutureWatcher<RenderResult>::finished, this, [this, watcher, key]() {
+            onTileRendered(key, watcher->result());
+            watcher->deleteLater();
+        });
+        watcher->setFuture(QtConcurrent::run(&m_pool, &InkTileCache::render, m_data->snapshot(), key));
+    }
+}
+
+void InkTileCache::onTileRendered(const TileKey& key, const RenderResult& result)
+{
+    m_rendering.remove(key);
+
+    if (m_staleRenders.remove(key))
+    {
+        m_stats.discarded++;
+    }
+    else
+    {
+        m_stats.rendered++;
+        m_stats.lastRenderNs = result.renderNs;
+        m_stats.maxRenderNs = qMax(m_stats.maxRenderNs, result.renderNs);
+
+        // Replaces a stale tile. One the cache refuses would only be rendered again.
+        Tile* tile = new Tile;
+        tile->image = result.image;
+        if (!m_cache.insert(key, tile, imageCost(result.image)))
+        {
+            m_dropped.insert(key);
+            startRenders();
+            return;
+        }
+    }
+
+    emit tilesChanged();
+
+    startRenders();
+}
+
+InkTileCache::RenderResult InkTileCache::render(const InkSnapshot& snapshot, const TileKey& key)
+{
+    PROFILE_SCOPE("InkTileCache::render");
+
+    const qint64 start = FrameProfiler::now();
+
+    RenderResult result;
+    result.image = QImage(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+    result.image.fill(Qt::transparent);
+
+    const QRectF rect = tileRect(key);
+    const QRect bounds = rect.toAlignedRect();
+
+    {
+        QPainter painter(&result.image);
+        painter.setRenderHint(QPainter::Antialiasing);
+        painter.scale(levelScale(key.level), levelScale(key.level));
+        painter.translate(-rect.topLeft());
+
+        for (int i = 0; i < snapshot.strokeCount(); i++)
+        {
+            const auto stroke = snapshot.stroke(i);
+            if (stroke->boundRect().intersects(bounds))
+            {
+                drawStrokeGeometry(painter, InkStrokeGeometry::fromStroke(*stroke));
+            }
+        }
+    }
+
+    result.renderNs = FrameProfiler::now() - start;
+    return result;
+}
@@ -0,0 +1,163 @@
+#ifndef INK_TILE_CACHE_H
+#define INK_TILE_CACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QRectF>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+
+#include "ink_data.h"
+#include "ink_snapshot.h"
+
+/*! \brief A rendered tile: image, the part of it to draw, and where it goes in canvas coordinates.
+ */
+struct InkTile
+{
+    QImage image;
+    QRectF source;
+    QRectF rect;
+};
+
+/*! \brief Map-style pyramid of rasterized ink, so viewing zoomed and panned ink costs tile blits.
+ *
+ *  Level l holds TILE_SIZE px square tiles of the committed strokes drawn at scale 2^l. tiles()
+ *  returns the tiles covering a view at the level matching its scale and queues the missing
+ *  ones; worker threads render them from an InkSnapshot and tilesChanged() asks for another
+ *  look. Until a tile is ready, the cached tile of a coarser level stands in for it.
+ *
+ *  An added stroke is painted straight into the cached tiles it touches. A removed or inserted
+ *  stroke marks the tiles under its bounds stale: they keep being shown until rendered again.
+ *  The tiles are evicted least recently used beyond the memory budget.
+ */
+class InkTileCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    static const int TILE_SIZE = 256;
+    static const int MIN_LEVEL = -4;
+    static const int MAX_LEVEL = 2;
+    static const int DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+    struct Stats
+    {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 rendered = 0;
+        // Renders thrown away because the strokes under the tile changed meanwhile.
+        quint64 discarded = 0;
+        qint64 lastRenderNs = 0;
+        qint64 maxRenderNs = 0;
+    };
+
+    explicit InkTileCache(QObject* parent = nullptr);
+
+    /*! \brief Waits for the running renders.
+     */
+    ~InkTileCache();
+
+    void setInkData(QSharedPointer<InkData> data);
+
+    /*! \brief Bytes of tile images to keep. Evicts right away when lowered.
+     *  The cache grows past it to hold the tiles of the current view (and their stand-ins).
+     */
+    void setMemoryBudget(int bytes);
+    int memoryBudget() const { return m_memoryBudget; }
+    int memoryUsed() const { return m_cache.totalCost(); }
+
+    /*! \brief Pyramid level for a view showing canvas px at scale device px.
+     */
+    static int levelForScale(qreal scale);
+
+    /*! \brief Tiles covering the visible canvas rect, drawn at scale, for a painter mapping
+     *  canvas coordinates. Queues the tiles that are missing or stale, nearest the center first.
+     */
+    QVector<InkTile> tiles(const QRectF& visibleRect, qreal scale);
+
+    Stats stats() const { return m_stats; }
+
+    /*! \brief Block until the running renders have finished. Their tiles are cached after the
+     *  next return to the event loop.
+     */
+    void waitForFinished();
+
+signals:
+    /*! \brief Rendered tiles arrived or cached ones turned stale: call tiles() again.
+     */
+    void tilesChanged();
+
+private slots:
+    void onStrokeAdded(QSharedPointer<InkStroke> addedStroke);
+    void onStrokeRemoved(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokeInserted(int index, QSharedPointer<InkStroke> stroke);
+    void onStrokesEdited(const QVector<InkStrokeEdit>& edits);
+    void invalidateAll();
+
+private:
+    struct TileKey
+    {
+        int level;
+        int x;
+        int y;
+
+        bool operator==(const TileKey& other) const
+        {
+            return level == other.level && x == other.x && y == other.y;
+        }
+
+        friend uint qHash(const TileKey& key, uint seed = 0)
+        {
+            return ::qHash((static_cast<quint64>(static_cast<quint32>(key.x)) << 32) |
+                           (static_cast<quint32>(key.y) << 4) | static_cast<quint32>(key.level - MIN_LEVEL),
+                           seed);
+        }
+    };
+
+    struct Tile
+    {
+        QImage image;
+        // The strokes under it changed since it was rendered.
+        bool stale = false;
+    };
+
+    struct RenderResult
+    {
+        QImage image;
+        qint64 renderNs = 0;
+    };
+
+    static QRectF tileRect(const TileKey& key);
+
+    // Mark the cached and rendering tiles under the canvas rect as stale.
+    void invalidate(const QRectF& rect);
+
+    void startRenders();
+    void onTileRendered(const TileKey& key, const RenderResult& result);
+
+    static RenderResult render(const InkSnapshot& snapshot, const TileKey& key);
+
+private:
+    QSharedPointer<InkData> m_data;
+
+    QCache<TileKey, Tile> m_cache;
+    int m_memoryBudget;
+
+    // Tiles wanted by the last tiles() call, in render order.
+    QVector<TileKey> m_queue;
+    QSet<TileKey> m_rendering;
+    // Rendering tiles whose result is out of date before it arrives.
+    QSet<TileKey> m_staleRenders;
+    // Rendered tiles the cache refused, not queued again until the budget or the strokes change.
+    QSet<TileKey> m_dropped;
+
+    QThreadPool m_pool;
+
+    Stats m_stats;
+};
+
+#endif // INK_TILE_CACHE_H
@@ -1,18 +1,162 @@
 // main.cpp
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
 #include <QDesktopWidget>
+#include <QFile>
+#include <QJsonDocument>
+#include <QScopedPointer>
+#include <QSurfaceFormat>
+#include <QTimer>
 
 #include "window.h"
+#include "frame_profiler.h"
+#include "ink_autosave.h"
+#include "ink_layer_glwidget.h"
+#include "pen_recorder.h"
+#include "pen_replayer.h"
+#ifdef HAVE_FFMPEG
+#include "video_recorder.h"
+#endif
 
 int main(int argc, char *argv[])
 {
+    // The ink layer and the video widget only use core-profile GL (VAOs, shaders, no
+    // immediate mode). Must be set before the first context is created.
+    QSurfaceFormat format;
+    format.setVersion(4, 0);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    QSurfaceFormat::setDefaultFormat(format);
+
     QApplication app(argc, argv);
+
+    // MYOPENGL_TRACE=<file> records profiler spans and writes them as Chrome trace JSON on exit.
+    const QString traceFile = QString::fromLocal8Bit(qgetenv("MYOPENGL_TRACE"));
+    if (!traceFile.isEmpty())
+    {
+        FrameProfiler::setEnabled(true);
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [traceFile]() {
+            FrameProfiler::instance().saveChromeTrace(traceFile);
+        });
+    }
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption recordOption("record", "Record the pen samples to <file> until exit.", "file");
+    QCommandLineOption replayOption("replay", "Replay the pen samples from <file>, print metrics and exit. Runs on the offscreen platform too.", "file");
+    QCommandLineOption maxSpeedOption("max-speed", "Replay as fast as possible instead of the recorded timing.");
+    QCommandLineOption metricsOption("metrics", "Write the replay metrics JSON to <file> instead of stdout.", "file");
+    QCommandLineOption autosaveOption("autosave", "Autosave the ink to <path>.snapshot and <path>.journal.*, recovering it on start.", "path");
+    QCommandLineOption compactOption("compact-strokes", "Keep committed strokes in the compact point encoding.");
+    QCommandLineOption noSmoothingOption("no-smoothing", "Store the pen input as captured, without smoothing.");
+    parser.addOptions({ recordOption, replayOption, maxSpeedOption, metricsOption, autosaveOption,
+                        compactOption, noSmoothingOption });
+#ifdef HAVE_FFMPEG
+    QCommandLineOption recordVideoOption("record-video", "Record the ink layer as shown to the video <file> until exit.", "file");
+    parser.addOption(recordVideoOption);
+#endif
+    parser.process(app);
+
     Window window;
     window.setWindowTitle("OpenGL with Qt");
 
     window.show();
     //window.showMaximized();
 
+    PenRecorder recorder;
+    if (parser.isSet(recordOption))
+    {
+        const QString recordFile = parser.value(recordOption);
+        window.inkLayer()->setPenRecorder(&recorder);
+        recorder.start();
+
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [&recorder, recordFile]() {
+            recorder.stop();
+            if (!recorder.save(recordFile))
+            {
+                qWarning() << "Failed to save the pen recording to" << recordFile;
+            }
+        });
+    }
+
+#ifdef HAVE_FFMPEG
+    VideoRecorder videoRecorder;
+    if (parser.isSet(recordVideoOption))
+    {
+        InkLayerGLWidget* inkLayer = window.inkLayer();
+
+        VideoRecorder::Settings settings;
+        settings.fileName = parser.value(recordVideoOption);
+        settings.size = inkLayer->size() * inkLayer->devicePixelRatioF();
+
+        if (!videoRecorder.start(settings))
+        {
+            qCritical() << "Failed to start the video recording" << settings.fileName;
+            return 1;
+        }
+
+        // Capture each presented frame. Captures are asynchronous, the encoding is off the GUI thread.
+        QObject::connect(inkLayer, &QOpenGLWidget::frameSwapped, &videoRecorder, [&videoRecorder, inkLayer]() {
+            videoRecorder.record(inkLayer->captureFrame(), FrameProfiler::now());
+        });
+
+        QObject::connect(&app, &QCoreApplication::aboutToQuit, [&videoRecorder]() {
+            videoRecorder.stop();
+            videoRecorder.wait();
+        });
+    }
+#endif
+
+    window.inkLayer()->inkData()->setCompactStrokes(parser.isSet(compactOption));
+    window.inkLayer()->setSmoothing(!parser.isSet(noSmoothingOption));
+
+    QScopedPointer<InkAutosave> autosave;
+    if (parser.isSet(autosaveOption))
+    {
+        autosave.reset(new InkAutosave(window.inkLayer()->inkData(), parser.value(autosaveOption)));
+        if (!autosave->recover() && !autosave->start())
+        {
+            qWarning() << "Failed to start the autosave" << parser.value(autosaveOption);
+        }
+    }
+
+    PenReplayer replayer(window.inkLayer());
+    if (parser.isSet(replayOption))
+    {
+        if (!replayer.load(parser.value(replayOption)))
+        {
+            qCritical() << "Failed to load the pen recording" << parser.value(replayOption);
+            return 1;
+        }
+
+        const QString metricsFile = parser.value(metricsOption);
+        QObject::connect(&replayer, &PenReplayer::finished, [&replayer, metricsFile]() {
+            const QByteArray json = QJsonDocument(replayer.metrics().toJson()).toJson();
+
+            QFile file(metricsFile);
+            bool opened = false;
+            if (metricsFile.isEmpty())
+            {
+                opened = file.open(stdout, QFile::WriteOnly);
+            }
+            else
+            {
+                opened = file.open(QFile::WriteOnly | QFile::Truncate);
+            }
+
+            if (opened)
+            {
+                file.write(json);
+            }
+
+            QCoreApplication::quit();
+        });
+
+        const auto speed = parser.isSet(maxSpeedOption) ? PenReplayer::Speed::Maximum
+                                                        : PenReplayer::Speed::Recorded;
+        QTimer::singleShot(0, &replayer, [&replayer, speed]() { replayer.start(speed); });
+    }
+
     return app.exec();
 }
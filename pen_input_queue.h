@@ -0,0 +1,135 @@
+#ifndef PEN_INPUT_QUEUE_H
+#define PEN_INPUT_QUEUE_H
+
+#include <atomic>
+#include <functional>
+
+#include "pen_sample.h"
+
+/*! \brief Bounded single-producer/single-consumer lock-free ring.
+ *  push() may only be called from one thread and pop() from one (other) thread.
+ *  Capacity must be a power of two.
+ */
+template <typename T, int Capacity>
+class SpscRing
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscRing() : m_head(0), m_tail(0) { }
+
+    /*! \brief Append an item. Returns false when the ring is full.
+     */
+    bool push(const T& item)
+    {
+        const quint32 tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) >= quint32(Capacity))
+        {
+            return false;
+        }
+
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*! \brief Take the oldest item. Returns false when the ring is empty.
+     */
+    bool pop(T& item)
+    {
+        const quint32 head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    // Padding keeps the indices on separate cache lines so producer and consumer don't false share.
+    // (Padding rather than alignas, heap allocations are not over-aligned before C++17.)
+    std::atomic<quint32> m_head;
+    char m_headPadding[64 - sizeof(std::atomic<quint32>)];
+    std::atomic<quint32> m_tail;
+    char m_tailPadding[64 - sizeof(std::atomic<quint32>)];
+    T m_items[Capacity];
+};
+
+/*! \brief Pen samples from one input source to the ink pipeline.
+ *
+ *  The source pushes from its own thread, the ink layer drains on the GUI thread. The consumer
+ *  is woken up once per batch: the wake up callback only runs when no drain is pending.
+ */
+class PenInputQueue
+{
+public:
+    static const int CAPACITY = 1024;
+
+    explicit PenInputQueue(std::function<void()> wakeUp)
+        : m_wakeUpPending(false)
+        , m_dropped(0)
+        , m_wakeUp(wakeUp)
+    { }
+
+    /*! \brief Producer side. Drops the sample when the consumer is CAPACITY samples behind.
+     */
+    bool push(const PenSample& sample)
+    {
+        if (!m_ring.push(sample))
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        // Pairs with the fence in drain(): either the consumer sees the sample or we see the
+        // cleared flag and wake it up. Without it the flag read could pass the ring write.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_wakeUpPending.exchange(true, std::memory_order_seq_cst))
+        {
+            m_wakeUp();
+        }
+        return true;
+    }
+
+    /*! \brief Consumer side. Calls consume for every queued sample, returns the count.
+     */
+    template <typename Consumer>
+    int drain(Consumer consume)
+    {
+        // Clear first: a sample pushed from now on triggers another wake up.
+        m_wakeUpPending.store(false, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        int count = 0;
+        PenSample sample;
+        while (m_ring.pop(sample))
+        {
+            consume(sample);
+            count++;
+        }
+        return count;
+    }
+
+    /*! \brief Number of samples lost because the queue was full.
+     */
+    quint64 dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    SpscRing<PenSample, CAPACITY> m_ring;
+    std::atomic<bool> m_wakeUpPending;
+    std::atomic<quint64> m_dropped;
+    std::function<void()> m_wakeUp;
+};
+
+#endif // PEN_INPUT_QUEUE_H
@@ -0,0 +1,147 @@
+#include <QFile>
+
+#include "binary_codec.h"
+#include "pen_recorder.h"
+
+namespace
+{
+    const char PEN_RECORD_MAGIC[] = "PENR";
+    const int PEN_RECORD_MAGIC_SIZE = 4;
+    const quint8 PEN_RECORD_VERSION = 2;
+
+    // Fixed point scales of the file format.
+    const float POSITION_SCALE = 4.0f;
+    const float PRESSURE_SCALE = 1024.0f;
+}
+
+PenRecorder::PenRecorder(QObject* parent)
+    : QObject(parent)
+    , m_recording(false)
+    , m_startTime(0)
+{ }
+
+void PenRecorder::start()
+{
+    m_samples.clear();
+    m_startTime = penTimestamp();
+    m_recording = true;
+}
+
+void PenRecorder::stop()
+{
+    m_recording = false;
+}
+
+void PenRecorder::record(const PenSample& sample)
+{
+    if (!m_recording) return;
+
+    PenSample rebased = sample;
+    rebased.timestamp = qMax<qint64>(0, sample.timestamp - m_startTime);
+    m_samples.push_back(rebased);
+}
+
+bool PenRecorder::save(const QString& fileName) const
+{
+    return save(fileName, m_samples);
+}
+
+QByteArray PenRecorder::encode(const QVector<PenSample>& samples)
+{
+    QByteArray data;
+    data.reserve(PEN_RECORD_MAGIC_SIZE + 1 + samples.size() * 9);
+    data.append(PEN_RECORD_MAGIC, PEN_RECORD_MAGIC_SIZE);
+    data.append(static_cast<char>(PEN_RECORD_VERSION));
+
+    qint64 previousTime = 0;
+    qint64 previousX = 0;
+    qint64 previousY = 0;
+
+    for (const auto& sample : samples)
+    {
+        qint64 time = sample.timestamp / 1000;
+        qint64 x = qRound64(sample.position.x() * POSITION_SCALE);
+        qint64 y = qRound64(sample.position.y() * POSITION_SCALE);
+
+        data.append(static_cast<char>(sample.type));
+        appendVarint(data, static_cast<quint64>(qMax<qint64>(0, time - previousTime)));
+        appendZigzag(data, x - previousX);
+        appendZigzag(data, y - previousY);
+        appendVarint(data, static_cast<quint64>(qMax(0, qRound(sample.pressure * PRESSURE_SCALE))));
+        appendZigzag(data, qRound(sample.tiltX));
+        appendZigzag(data, qRound(sample.tiltY));
+        appendVarint(data, sample.flags);
+
+        previousTime = time;
+        previousX = x;
+        previousY = y;
+    }
+
+    return data;
+}
+
+bool PenRecorder::decode(const QByteArray& data, QVector<PenSample>& samples)
+{
+    samples.clear();
+
+    if (!data.startsWith(QByteArray(PEN_RECORD_MAGIC, PEN_RECORD_MAGIC_SIZE)))
+    {
+        return false;
+    }
+
+    BinaryReader reader(data, PEN_RECORD_MAGIC_SIZE);
+    if (reader.readByte() != PEN_RECORD_VERSION)
+    {
+        return false;
+    }
+
+    qint64 time = 0;
+    qint64 x = 0;
+    qint64 y = 0;
+
+    while (!reader.atEnd())
+    {
+        quint8 type = reader.readByte();
+        time += static_cast<qint64>(reader.readVarint());
+        x += reader.readZigzag();
+        y += reader.readZigzag();
+        float pressure = reader.readVarint() / PRESSURE_SCALE;
+        float tiltX = reader.readZigzag();
+        float tiltY = reader.readZigzag();
+        quint32 flags = static_cast<quint32>(reader.readVarint());
+
+        if (reader.hasError() || type > PenSample::Up)
+        {
+            samples.clear();
+            return false;
+        }
+
+        samples.push_back(PenSample{ static_cast<PenSample::Type>(type),
+                                     QPointF(x / POSITION_SCALE, y / POSITION_SCALE),
+                                     pressure, tiltX, tiltY, flags, time * 1000 });
+    }
+
+    return true;
+}
+
+bool PenRecorder::save(const QString& fileName, const QVector<PenSample>& samples)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        return false;
+    }
+
+    return file.write(encode(samples)) >= 0;
+}
+
+bool PenRecorder::load(const QString& fileName, QVector<PenSample>& samples)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly))
+    {
+        return false;
+    }
+
+    return decode(file.readAll(), samples);
+}
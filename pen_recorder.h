@@ -0,0 +1,57 @@
+#ifndef PEN_RECORDER_H
+#define PEN_RECORDER_H
+
+#include <QObject>
+#include <QVector>
+
+#include "pen_sample.h"
+
+/*! \brief Records the pen samples fed to the ink layer and stores them in a compact file.
+ *
+ *  The samples are expected in ink layer coordinates, so a trace replays the same wherever the
+ *  window is. Timestamps are rebased to the start of the recording.
+ *
+ *  File layout: "PENR", a version byte, then per sample the type byte followed by varints for
+ *  the timestamp delta (us), the zigzag position delta (1/4 px), the pressure (1/1024),
+ *  the zigzag tilt (degrees) and the flags. A typical move sample takes 7-9 bytes.
+ */
+class PenRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PenRecorder(QObject* parent = nullptr);
+
+    /*! \brief Drop the previous samples and start recording.
+     */
+    void start();
+
+    /*! \brief Stop recording. The samples are kept until the next start().
+     */
+    void stop();
+
+    bool isRecording() const { return m_recording; }
+
+    /*! \brief Append a sample if recording.
+     */
+    void record(const PenSample& sample);
+
+    const QVector<PenSample>& samples() const { return m_samples; }
+
+    /*! \brief Write the recorded samples to a file.
+     */
+    bool save(const QString& fileName) const;
+
+    static QByteArray encode(const QVector<PenSample>& samples);
+    static bool decode(const QByteArray& data, QVector<PenSample>& samples);
+
+    static bool save(const QString& fileName, const QVector<PenSample>& samples);
+    static bool load(const QString& fileName, QVector<PenSample>& samples);
+
+private:
+    bool m_recording;
+    qint64 m_startTime;
+    QVector<PenSample> m_samples;
+};
+
+#endif // PEN_RECORDER_H
@@ -0,0 +1,140 @@
+#include "ink_layer_glwidget.h"
+#include "pen_replayer.h"
+
+namespace
+{
+    // Give the last samples this long to be rendered before the replay ends.
+    const int DRAIN_TIMEOUT_MS = 500;
+}
+
+QJsonObject PenReplayMetrics::toJson() const
+{
+    const double durationMs = durationNs / 1e6;
+
+    return QJsonObject{
+        {"samples", samples},
+        {"frames", frames},
+        {"durationMs", durationMs},
+        {"fps", durationMs > 0 ? frames * 1000.0 / durationMs : 0.0},
+        {"meanLatencyMs", presentedSamples > 0 ? totalLatencyNs / 1e6 / presentedSamples : 0.0},
+        {"maxLatencyMs", maxLatencyNs / 1e6},
+        {"smoothingLatencySamples", smoothingLatencySamples}
+    };
+}
+
+PenReplayer::PenReplayer(InkLayerGLWidget* inkLayer, QObject* parent)
+    : QObject(parent)
+    , m_inkLayer(inkLayer)
+    , m_next(0)
+    , m_speed(Speed::Recorded)
+    , m_running(false)
+    , m_draining(false)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &PenReplayer::dispatchNext);
+
+    connect(inkLayer, &InkLayerGLWidget::inkFrameRendered, this, &PenReplayer::onFrameRendered);
+}
+
+bool PenReplayer::load(const QString& fileName)
+{
+    QVector<PenSample> samples;
+    if (!PenRecorder::load(fileName, samples))
+    {
+        return false;
+    }
+
+    setSamples(samples);
+    return true;
+}
+
+void PenReplayer::setSamples(const QVector<PenSample>& samples)
+{
+    m_samples = samples;
+}
+
+void PenReplayer::start(Speed speed)
+{
+    m_speed = speed;
+    m_next = 0;
+    m_running = true;
+    m_draining = false;
+    m_pending.clear();
+    m_metrics = PenReplayMetrics();
+    m_metrics.smoothingLatencySamples = m_inkLayer->smoothingLatencySamples();
+    m_inkLayer->startOffscreenRendering();
+    m_clock.start();
+
+    scheduleNext();
+}
+
+void PenReplayer::scheduleNext()
+{
+    if (m_next >= m_samples.size())
+    {
+        // Wait for the last samples to be rendered.
+        m_draining = true;
+        QTimer::singleShot(DRAIN_TIMEOUT_MS, this, &PenReplayer::finish);
+        return;
+    }
+
+    int delayMs = 0;
+    if (m_speed == Speed::Recorded)
+    {
+        qint64 due = m_samples[m_next].timestamp - m_samples.first().timestamp;
+        delayMs = static_cast<int>(qMax<qint64>(0, due - m_clock.nsecsElapsed()) / 1000000);
+    }
+
+    m_timer.start(delayMs);
+}
+
+void PenReplayer::dispatchNext()
+{
+    if (!m_running || !m_inkLayer) return;
+
+    // Samples are stored in ink layer coordinates, the pipeline takes global ones.
+    PenSample sample = m_samples[m_next++];
+    sample.position += QPointF(m_inkLayer->mapToGlobal(QPoint(0, 0)));
+    sample.timestamp = penTimestamp();
+
+    m_pending.push_back(m_clock.nsecsElapsed());
+    m_metrics.samples++;
+
+    m_inkLayer->pushPenSample(sample);
+
+    scheduleNext();
+}
+
+void PenReplayer::onFrameRendered()
+{
+    if (!m_running) return;
+
+    const qint64 now = m_clock.nsecsElapsed();
+
+    m_metrics.frames++;
+    for (qint64 dispatched : m_pending)
+    {
+        qint64 latency = now - dispatched;
+        m_metrics.totalLatencyNs += latency;
+        m_metrics.maxLatencyNs = qMax(m_metrics.maxLatencyNs, latency);
+        m_metrics.presentedSamples++;
+    }
+    m_pending.clear();
+
+    if (m_draining)
+    {
+        finish();
+    }
+}
+
+void PenReplayer::finish()
+{
+    if (!m_running) return;
+
+    m_running = false;
+    m_timer.stop();
+    m_metrics.durationNs = m_clock.nsecsElapsed();
+
+    emit finished();
+}
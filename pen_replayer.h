@@ -0,0 +1,90 @@
+#ifndef PEN_REPLAYER_H
+#define PEN_REPLAYER_H
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QVector>
+
+#include "pen_recorder.h"
+
+class InkLayerGLWidget;
+
+/*! \brief Frame and latency figures collected during a replay.
+ */
+struct PenReplayMetrics
+{
+    int samples = 0;
+    int frames = 0;
+    qint64 durationNs = 0;
+
+    // Latency from feeding a sample to the ink layer until the next frame was rendered.
+    int presentedSamples = 0;
+    qint64 totalLatencyNs = 0;
+    qint64 maxLatencyNs = 0;
+
+    // Pen samples the input smoothing holds back, on top of the latency above.
+    int smoothingLatencySamples = 0;
+
+    QJsonObject toJson() const;
+};
+
+/*! \brief Feeds a recorded pen trace back through the ink layer's pen input queue.
+ *  Frames and latency are counted on the ink render thread's frames, so it runs headless too
+ *  (start() makes the ink layer render offscreen if it has no context of its own).
+ */
+class PenReplayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Speed
+    {
+        // Keep the recorded timing between samples.
+        Recorded,
+        // Feed one sample per event loop iteration.
+        Maximum
+    };
+
+    explicit PenReplayer(InkLayerGLWidget* inkLayer, QObject* parent = nullptr);
+
+    bool load(const QString& fileName);
+    void setSamples(const QVector<PenSample>& samples);
+
+    void start(Speed speed = Speed::Recorded);
+
+    bool isRunning() const { return m_running; }
+
+    PenReplayMetrics metrics() const { return m_metrics; }
+
+signals:
+    void finished();
+
+private slots:
+    void dispatchNext();
+    void onFrameRendered();
+
+private:
+    void scheduleNext();
+    void finish();
+
+private:
+    QPointer<InkLayerGLWidget> m_inkLayer;
+    QVector<PenSample> m_samples;
+    int m_next;
+    Speed m_speed;
+    bool m_running;
+    bool m_draining;
+
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+
+    // Dispatch times of the samples not rendered yet.
+    QVector<qint64> m_pending;
+
+    PenReplayMetrics m_metrics;
+};
+
+#endif // PEN_REPLAYER_H
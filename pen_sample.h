@@ -0,0 +1,63 @@
+#ifndef PEN_SAMPLE_H
+#define PEN_SAMPLE_H
+
+#include <QMetaType>
+#include <QPointF>
+
+#include <chrono>
+
+/*! \brief Platform neutral pen input sample.
+ *  Windows pointer, Qt tablet, mouse and replayed input are all converted to this.
+ */
+struct PenSample
+{
+    enum Type : quint8
+    {
+        Down = 0,
+        Move = 1,
+        Up = 2
+    };
+
+    enum Flag : quint32
+    {
+        NoFlags = 0x0,
+        Barrel = 0x1,
+        Inverted = 0x2,
+        Eraser = 0x4
+    };
+
+    Type type;
+
+    // Global screen position in pixels.
+    QPointF position;
+
+    // Normalized pressure in [0, 1]. 0.5 is the nominal pen width.
+    float pressure;
+
+    // Tilt in degrees, [-90, 90].
+    float tiltX;
+    float tiltY;
+
+    // Flag bits
+    quint32 flags;
+
+    // Nanoseconds on the penTimestamp() clock.
+    qint64 timestamp;
+
+    bool isEraser() const
+    {
+        return (flags & Eraser) || (flags & Inverted);
+    }
+};
+
+Q_DECLARE_METATYPE(PenSample)
+
+/*! \brief Monotonic clock shared by all pen input sources, in nanoseconds.
+ */
+inline qint64 penTimestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+#endif // PEN_SAMPLE_H
@@ -0,0 +1,198 @@
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLWidget>
+#include <QtConcurrent>
+
+#include <cstring>
+
+#include "frame_profiler.h"
+#include "pixel_readback.h"
+
+namespace
+{
+    // Poll interval while captures are in flight and the widget doesn't repaint.
+    const int POLL_INTERVAL_MS = 8;
+}
+
+PixelReadback::PixelReadback(QOpenGLWidget* widget, int ringSize)
+    : QObject(widget)
+    , m_widget(widget)
+    , m_slots(ringSize)
+{
+    m_pollTimer.setInterval(POLL_INTERVAL_MS);
+    connect(&m_pollTimer, &QTimer::timeout, this, &PixelReadback::poll);
+    connect(widget, &QOpenGLWidget::frameSwapped, this, &PixelReadback::poll);
+}
+
+PixelReadback::~PixelReadback()
+{
+    for (auto& slot : m_slots)
+    {
+        if (slot.pending)
+        {
+            slot.result.reportCanceled();
+            slot.result.reportFinished();
+        }
+    }
+}
+
+QFuture<QImage> PixelReadback::capture()
+{
+    PROFILE_SCOPE("PixelReadback::capture");
+
+    m_stats.requested++;
+
+    Slot* slot = nullptr;
+    for (auto& candidate : m_slots)
+    {
+        if (!candidate.pending)
+        {
+            slot = &candidate;
+            break;
+        }
+    }
+
+    if (!slot || !m_widget->isValid())
+    {
+        m_stats.busy++;
+
+        QFutureInterface<QImage> refused;
+        refused.reportStarted();
+        refused.reportCanceled();
+        refused.reportFinished();
+        return refused.future();
+    }
+
+    m_widget->makeCurrent();
+    auto f = QOpenGLContext::currentContext()->extraFunctions();
+
+    const QSize size = m_widget->size() * m_widget->devicePixelRatioF();
+    const int bytes = size.width() * size.height() * 4;
+
+    if (!slot->pbo.isCreated())
+    {
+        slot->pbo.create();
+        slot->pbo.setUsagePattern(QOpenGLBuffer::StreamRead);
+    }
+
+    slot->pbo.bind();
+    if (slot->pbo.size() != bytes)
+    {
+        slot->pbo.allocate(bytes);
+    }
+
+    // With a pixel pack buffer bound glReadPixels only queues the copy.
+    f->glBindFramebuffer(GL_READ_FRAMEBUFFER, m_widget->defaultFramebufferObject());
+    f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    slot->pbo.release();
+
+    slot->fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    f->glFlush();
+
+    m_widget->doneCurrent();
+
+    slot->size = size;
+    slot->pending = true;
+    slot->result = QFutureInterface<QImage>();
+    slot->result.reportStarted();
+
+    if (!m_pollTimer.isActive())
+    {
+        m_pollTimer.start();
+    }
+
+    return slot->result.future();
+}
+
+void PixelReadback::poll()
+{
+    bool inFlight = false;
+    bool current = false;
+
+    for (auto& slot : m_slots)
+    {
+        if (!slot.pending) continue;
+
+        if (!current)
+        {
+            m_widget->makeCurrent();
+            current = true;
+        }
+
+        // Zero timeout: only asks whether the copy is done.
+        auto f = QOpenGLContext::currentContext()->extraFunctions();
+        GLenum status = f->glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            deliver(slot);
+        }
+        else
+        {
+            inFlight = true;
+        }
+    }
+
+    if (current)
+    {
+        m_widget->doneCurrent();
+    }
+
+    if (!inFlight)
+    {
+        m_pollTimer.stop();
+    }
+}
+
+void PixelReadback::deliver(Slot& slot)
+{
+    PROFILE_SCOPE("PixelReadback::deliver");
+
+    auto f = QOpenGLContext::currentContext()->extraFunctions();
+    f->glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    const int bytes = slot.size.width() * slot.size.height() * 4;
+    QImage image(slot.size, QImage::Format_RGBA8888_Premultiplied);
+
+    slot.pbo.bind();
+    if (void* data = f->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT))
+    {
+        memcpy(image.bits(), data, bytes);
+        f->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    slot.pbo.release();
+
+    slot.pending = false;
+    m_stats.delivered++;
+
+    // GL rows are bottom-up. Flip off the GUI thread, then complete the future.
+    QFutureInterface<QImage> result = slot.result;
+    QtConcurrent::run([result, image]() mutable {
+        result.reportResult(image.mirrored());
+        result.reportFinished();
+    });
+}
+
+void PixelReadback::releaseResources()
+{
+    auto context = QOpenGLContext::currentContext();
+
+    for (auto& slot : m_slots)
+    {
+        if (slot.fence && context)
+        {
+            context->extraFunctions()->glDeleteSync(slot.fence);
+        }
+        slot.fence = nullptr;
+        slot.pbo.destroy();
+
+        if (slot.pending)
+        {
+            slot.result.reportCanceled();
+            slot.result.reportFinished();
+            slot.pending = false;
+        }
+    }
+
+    m_pollTimer.stop();
+}
@@ -0,0 +1,73 @@
+#ifndef PIXEL_READBACK_H
+#define PIXEL_READBACK_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QImage>
+#include <QObject>
+#include <QOpenGLBuffer>
+#include <QTimer>
+#include <QVector>
+
+class QOpenGLWidget;
+
+/*! \brief Asynchronous framebuffer capture of a QOpenGLWidget.
+ *
+ *  capture() only queues a glReadPixels into a pixel buffer object and a fence, then returns.
+ *  The PBOs are checked once per frame without waiting; a finished one is mapped and its image
+ *  delivered through the future, typically one or two frames later. The GPU never stalls on the
+ *  read and the GUI thread never blocks on it.
+ */
+class PixelReadback : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Stats
+    {
+        quint64 requested = 0;
+        quint64 delivered = 0;
+        // Captures refused because all PBOs were still in flight.
+        quint64 busy = 0;
+    };
+
+    /*! \param ringSize Number of captures that can be in flight at once.
+     */
+    explicit PixelReadback(QOpenGLWidget* widget, int ringSize = 3);
+    ~PixelReadback();
+
+    /*! \brief Capture what the widget shows now.
+     *  \return Future of the image, canceled when no PBO is free or the resources are released.
+     */
+    QFuture<QImage> capture();
+
+    /*! \brief Release the PBOs and fences. Call with the widget's context current.
+     */
+    void releaseResources();
+
+    Stats stats() const { return m_stats; }
+
+private slots:
+    // Deliver the finished captures. Doesn't wait for the unfinished ones.
+    void poll();
+
+private:
+    struct Slot
+    {
+        QOpenGLBuffer pbo { QOpenGLBuffer::PixelPackBuffer };
+        GLsync fence = nullptr;
+        QSize size;
+        QFutureInterface<QImage> result;
+        bool pending = false;
+    };
+
+    void deliver(Slot& slot);
+
+private:
+    QOpenGLWidget* m_widget;
+    QVector<Slot> m_slots;
+    QTimer m_pollTimer;
+    Stats m_stats;
+};
+
+#endif // PIXEL_READBACK_H
@@ -0,0 +1,422 @@
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/frame.h>
+}
+
+#include "frame_profiler.h"
+#include "video_recorder.h"
+
+namespace
+{
+    // BT.601 video range in 8 bit fixed point.
+    inline uint8_t luma(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+    }
+
+    inline uint8_t chromaBlue(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+    }
+
+    inline uint8_t chromaRed(int r, int g, int b)
+    {
+        return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+}
+
+VideoRecorder::VideoRecorder(QObject* parent)
+    : QThread(parent)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    stop();
+    wait();
+    m_pool.waitForDone();
+
+    for (auto frame : m_converted)
+    {
+        av_frame_free(&frame);
+    }
+
+    closeEncoder();
+}
+
+bool VideoRecorder::start(const Settings& settings)
+{
+    if (isRunning()) return false;
+
+    m_settings = settings;
+    m_settings.size = QSize(settings.size.width() & ~1, settings.size.height() & ~1);
+    m_settings.framesPerSecond = qMax(1, settings.framesPerSecond);
+    m_settings.queueCapacity = qMax(1, settings.queueCapacity);
+
+    if (m_settings.size.isEmpty() || !openEncoder())
+    {
+        closeEncoder();
+        return false;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_recording = true;
+    m_stopping = false;
+    m_nextSequence = 0;
+    m_encodeSequence = 0;
+    m_startTimestamp = -1;
+    m_lastPts = -1;
+    m_stats = Stats();
+    lock.unlock();
+
+    QThread::start();
+    return true;
+}
+
+void VideoRecorder::stop()
+{
+    QMutexLocker lock(&m_mutex);
+    m_stopping = true;
+    m_frameReady.wakeOne();
+}
+
+bool VideoRecorder::isRecording() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_recording && !m_stopping;
+}
+
+bool VideoRecorder::submit(const QImage& frame, qint64 timestampNs)
+{
+    PROFILE_SCOPE("VideoRecorder::submit");
+
+    QMutexLocker lock(&m_mutex);
+    if (!m_recording || m_stopping || frame.isNull()) return false;
+
+    m_stats.submitted++;
+
+    if (m_startTimestamp < 0)
+    {
+        m_startTimestamp = timestampNs;
+    }
+
+    // Time base is one frame, so frames arriving faster than the frame rate share a pts.
+    const qint64 pts = qRound64((timestampNs - m_startTimestamp) * 1e-9 * m_settings.framesPerSecond);
+    if (pts <= m_lastPts)
+    {
+        m_stats.skipped++;
+        return false;
+    }
+
+    if (m_converting + m_queued >= m_settings.queueCapacity)
+    {
+        m_stats.dropped++;
+
+        if (m_settings.dropPolicy == DropPolicy::DropNewest || m_queued == 0)
+        {
+            return false;
+        }
+
+        for (auto it = m_converted.begin(); it != m_converted.end(); ++it)
+        {
+            if (it.value())
+            {
+                // Keep the entry so the encoder still advances past its sequence number.
+                av_frame_free(&it.value());
+                m_queued--;
+                break;
+            }
+        }
+    }
+
+    m_lastPts = pts;
+    const quint64 sequence = m_nextSequence++;
+    m_converting++;
+    lock.unlock();
+
+    QtConcurrent::run(&m_pool, [this, frame, sequence, pts]() {
+        convert(frame, sequence, pts);
+    });
+
+    return true;
+}
+
+void VideoRecorder::record(QFuture<QImage> frame, qint64 timestampNs)
+{
+    auto watcher = new QFutureWatcher<QImage>(this);
+
+    connect(watcher, &QFutureWatcher<QImage>::finished, this, [this, watcher, timestampNs]() {
+        const QFuture<QImage> future = watcher->future();
+        if (future.isCanceled() || future.resultCount() == 0)
+        {
+            QMutexLocker lock(&m_mutex);
+            if (m_recording && !m_stopping)
+            {
+                m_stats.submitted++;
+                m_stats.dropped++;
+            }
+        }
+        else
+        {
+            submit(future.result(), timestampNs);
+        }
+
+        watcher->deleteLater();
+    });
+
+    watcher->setFuture(frame);
+}
+
+VideoRecorder::Stats VideoRecorder::stats() const
+{
+    QMutexLocker lock(&m_mutex);
+    return m_stats;
+}
+
+void VideoRecorder::convert(QImage image, quint64 sequence, qint64 pts)
+{
+    PROFILE_SCOPE("VideoRecorder::convert");
+
+    const qint64 start = FrameProfiler::now();
+
+    if (image.size() != m_settings.size)
+    {
+        image = image.scaled(m_settings.size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    frame->format = AV_PIX_FMT_YUV420P;
+    frame->width = m_settings.size.width();
+    frame->height = m_settings.size.height();
+
+    if (av_frame_get_buffer(frame, 0) < 0)
+    {
+        av_frame_free(&frame);
+    }
+    else
+    {
+        convertToYuv420(image, frame);
+        frame->pts = pts;
+    }
+
+    QMutexLocker lock(&m_mutex);
+    m_converted.insert(sequence, frame);
+    m_converting--;
+    if (frame)
+    {
+        m_queued++;
+    }
+    m_stats.convertNs += FrameProfiler::now() - start;
+    m_frameReady.wakeOne();
+}
+
+void VideoRecorder::convertToYuv420(const QImage& image, AVFrame* frame)
+{
+    QImage rgba = image;
+    if (rgba.format() != QImage::Format_RGBA8888 &&
+        rgba.format() != QImage::Format_RGBA8888_Premultiplied &&
+        rgba.format() != QImage::Format_RGBX8888)
+    {
+        rgba = rgba.convertToFormat(QImage::Format_RGBX8888);
+    }
+
+    const int width = qMin(rgba.width(), frame->width) & ~1;
+    const int height = qMin(rgba.height(), frame->height) & ~1;
+
+    // One chroma sample per 2x2 block, from the block's average color.
+    for (int y = 0; y < height; y += 2)
+    {
+        const uchar* rows[2] = { rgba.constScanLine(y), rgba.constScanLine(y + 1) };
+        uint8_t* lumaRows[2] = { frame->data[0] + y * frame->linesize[0],
+                                 frame->data[0] + (y + 1) * frame->linesize[0] };
+        uint8_t* u = frame->data[1] + (y / 2) * frame->linesize[1];
+        uint8_t* v = frame->data[2] + (y / 2) * frame->linesize[2];
+
+        for (int x = 0; x < width; x += 2)
+        {
+            int r = 0, g = 0, b = 0;
+
+            for (int row = 0; row < 2; row++)
+            {
+                for (int column = 0; column < 2; column++)
+                {
+                    const uchar* pixel = rows[row] + (x + column) * 4;
+                    lumaRows[row][x + column] = luma(pixel[0], pixel[1], pixel[2]);
+                    r += pixel[0];
+                    g += pixel[1];
+                    b += pixel[2];
+                }
+            }
+
+            r = (r + 2) >> 2;
+            g = (g + 2) >> 2;
+            b = (b + 2) >> 2;
+            u[x / 2] = chromaBlue(r, g, b);
+            v[x / 2] = chromaRed(r, g, b);
+        }
+    }
+}
+
+void VideoRecorder::run()
+{
+    for (;;)
+    {
+        AVFrame* frame = nullptr;
+
+        {
+            QMutexLocker lock(&m_mutex);
+            while (!m_converted.contains(m_encodeSequence) && !(m_stopping && m_converting == 0))
+            {
+                m_frameReady.wait(&m_mutex);
+            }
+
+            if (!m_converted.contains(m_encodeSequence))
+            {
+                break;
+            }
+
+            frame = m_converted.take(m_encodeSequence++);
+            if (!frame)
+            {
+                // Dropped after conversion.
+                continue;
+            }
+            m_queued--;
+        }
+
+        encode(frame);
+        av_frame_free(&frame);
+    }
+
+    // Drain the encoder's delayed frames, then finish the file.
+    encode(nullptr);
+    closeEncoder();
+
+    QMutexLocker lock(&m_mutex);
+    m_recording = false;
+}
+
+bool VideoRecorder::openEncoder()
+{
+    const QByteArray fileName = m_settings.fileName.toLocal8Bit();
+
+    avformat_alloc_output_context2(&m_format, nullptr, nullptr, fileName.constData());
+    if (!m_format)
+    {
+        qWarning() << "VideoRecorder: unknown file format" << m_settings.fileName;
+        return false;
+    }
+
+    const AVCodec* codec = nullptr;
+    if (!m_settings.codec.isEmpty())
+    {
+        codec = avcodec_find_encoder_by_name(m_settings.codec.toLatin1().constData());
+    }
+    if (!codec)
+    {
+        codec = avcodec_find_encoder(m_format->oformat->video_codec);
+    }
+    if (!codec)
+    {
+        qWarning() << "VideoRecorder: no video encoder for" << m_settings.fileName;
+        return false;
+    }
+
+    m_stream = avformat_new_stream(m_format, nullptr);
+    m_codec = avcodec_alloc_context3(codec);
+    if (!m_stream || !m_codec) return false;
+
+    m_codec->width = m_settings.size.width();
+    m_codec->height = m_settings.size.height();
+    m_codec->pix_fmt = AV_PIX_FMT_YUV420P;
+    m_codec->time_base = AVRational{ 1, m_settings.framesPerSecond };
+    m_codec->framerate = AVRational{ m_settings.framesPerSecond, 1 };
+    m_codec->bit_rate = m_settings.bitRate;
+    m_codec->gop_size = m_settings.framesPerSecond * 2;
+    // No B-frames: packets come out as soon as their frame is encoded.
+    m_codec->max_b_frames = 0;
+    m_codec->thread_count = 0;
+
+    if (m_format->oformat->flags & AVFMT_GLOBALHEADER)
+    {
+        m_codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    }
+
+    if (avcodec_open2(m_codec, codec, nullptr) < 0)
+    {
+        qWarning() << "VideoRecorder: failed to open the encoder" << codec->name;
+        return false;
+    }
+
+    avcodec_parameters_from_context(m_stream->codecpar, m_codec);
+    m_stream->time_base = m_codec->time_base;
+
+    if (!(m_format->oformat->flags & AVFMT_NOFILE) &&
+        avio_open(&m_format->pb, fileName.constData(), AVIO_FLAG_WRITE) < 0)
+    {
+        qWarning() << "VideoRecorder: failed to create" << m_settings.fileName;
+        return false;
+    }
+
+    if (avformat_write_header(m_format, nullptr) < 0)
+    {
+        qWarning() << "VideoRecorder: failed to write the header of" << m_settings.fileName;
+        avio_closep(&m_format->pb);
+        return false;
+    }
+
+    return true;
+}
+
+void VideoRecorder::closeEncoder()
+{
+    if (m_format && m_format->pb)
+    {
+        av_write_trailer(m_format);
+        avio_closep(&m_format->pb);
+    }
+
+    avcodec_free_context(&m_codec);
+    avformat_free_context(m_format);
+    m_format = nullptr;
+    m_stream = nullptr;
+}
+
+void VideoRecorder::encode(AVFrame* frame)
+{
+    PROFILE_SCOPE("VideoRecorder::encode");
+
+    const qint64 start = FrameProfiler::now();
+    quint64 bytes = 0;
+
+    if (avcodec_send_frame(m_codec, frame) >= 0)
+    {
+        AVPacket* packet = av_packet_alloc();
+
+        while (avcodec_receive_packet(m_codec, packet) >= 0)
+        {
+            av_packet_rescale_ts(packet, m_codec->time_base, m_stream->time_base);
+            packet->stream_index = m_stream->index;
+            bytes += packet->size;
+
+            // Takes over the packet's data and resets it.
+            av_interleaved_write_frame(m_format, packet);
+        }
+
+        av_packet_free(&packet);
+    }
+
+    QMutexLocker lock(&m_mutex);
+    if (frame)
+    {
+        m_stats.encoded++;
+    }
+    m_stats.bytes += bytes;
+    m_stats.encodeNs += FrameProfiler::now() - start;
+}
@@ -0,0 +1,136 @@
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <QFuture>
+#include <QImage>
+#include <QMap>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+struct AVCodecContext;
+struct AVFormatContext;
+struct AVFrame;
+struct AVStream;
+
+/*! \brief Encodes captured frames to a video file with FFmpeg (libavcodec/libavformat).
+ *
+ *  submit() never blocks: it hands the frame to a worker pool that converts it to YUV 4:2:0,
+ *  and the converted frames are encoded in order on this thread. At most queueCapacity frames
+ *  are converting or waiting for the encoder; beyond that the drop policy decides which frame
+ *  is lost. Frames come from PixelReadback captures (record()) or any QImage (submit()).
+ */
+class VideoRecorder : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum class DropPolicy
+    {
+        // Refuse the new frame, the queued ones are encoded.
+        DropNewest,
+        // Drop the oldest frame waiting for the encoder to make room for the new one.
+        // If all queued frames are still converting the new one is refused.
+        DropOldest
+    };
+
+    struct Settings
+    {
+        QString fileName;
+        // Rounded down to even sizes. Frames of another size are scaled.
+        QSize size;
+        int framesPerSecond = 30;
+        int bitRate = 8000000;
+        // FFmpeg encoder name. Empty or unknown: the default encoder of the file format.
+        QString codec = "libx264";
+        int queueCapacity = 8;
+        DropPolicy dropPolicy = DropPolicy::DropOldest;
+    };
+
+    struct Stats
+    {
+        quint64 submitted = 0;
+        // Refused by submit() or replaced in the queue, see DropPolicy.
+        quint64 dropped = 0;
+        // Less than one frame interval after the previous frame.
+        quint64 skipped = 0;
+        quint64 encoded = 0;
+        quint64 bytes = 0;
+        qint64 convertNs = 0;
+        qint64 encodeNs = 0;
+    };
+
+    explicit VideoRecorder(QObject* parent = nullptr);
+    ~VideoRecorder();
+
+    /*! \brief Create the file, open the encoder and start the encoder thread.
+     *  \return False when the file or the encoder can't be opened.
+     */
+    bool start(const Settings& settings);
+
+    /*! \brief Stop accepting frames. The thread encodes the queued ones, finishes the file and
+     *  exits; finished() is emitted then. wait() to block until the file is complete.
+     */
+    void stop();
+
+    bool isRecording() const;
+
+    /*! \brief Queue a frame for encoding. Never blocks on the conversion or the encoder.
+     *  \param timestampNs FrameProfiler::now() clock. Sets the frame's position in the video.
+     *  \return False when the frame is dropped or skipped, or the recorder isn't recording.
+     */
+    bool submit(const QImage& frame, qint64 timestampNs);
+
+    /*! \brief Submit a pending capture once it is delivered. Canceled captures count as dropped.
+     *  Call on the recorder's thread affinity (the GUI thread).
+     */
+    void record(QFuture<QImage> frame, qint64 timestampNs);
+
+    Stats stats() const;
+
+    /*! \brief Convert RGBA/RGBX pixels to the planes of a YUV 4:2:0 frame (BT.601, video range).
+     */
+    static void convertToYuv420(const QImage& image, AVFrame* frame);
+
+protected:
+    void run() override;
+
+private:
+    bool openEncoder();
+    void closeEncoder();
+    void convert(QImage image, quint64 sequence, qint64 pts);
+    void encode(AVFrame* frame);
+
+private:
+    Settings m_settings;
+
+    AVFormatContext* m_format = nullptr;
+    AVCodecContext* m_codec = nullptr;
+    AVStream* m_stream = nullptr;
+
+    // Conversion workers, separate from the global pool so captures don't starve them.
+    QThreadPool m_pool;
+
+    // Guards everything below.
+    mutable QMutex m_mutex;
+    QWaitCondition m_frameReady;
+    bool m_recording = false;
+    bool m_stopping = false;
+
+    // Converted frames by submit order. Null entries are frames dropped after conversion.
+    QMap<quint64, AVFrame*> m_converted;
+    quint64 m_nextSequence = 0;
+    quint64 m_encodeSequence = 0;
+    int m_converting = 0;
+    int m_queued = 0;
+
+    qint64 m_startTimestamp = -1;
+    qint64 m_lastPts = -1;
+
+    Stats m_stats;
+};
+
+#endif // VIDEO_RECORDER_H
@@ -1,20 +1,249 @@
 #include <QApplication>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLPaintDevice>
+#include <QScreen>
+#include <QSemaphore>
+#include <QWindow>
+
+#include <atomic>
+#include <cmath>
 
 #include "video_widget.h"
 #include "common/utilities.h"
+#include "frame_profiler.h"
+#include "framebuffer_pool.h"
+#include "ink_data.h"
+#ifdef HAVE_FFMPEG
+#include "video_recorder.h"
+#endif
+
+namespace
+{
+    // Upper bound of the stream render workers, each one holds a context and an FBO.
+    const int MAX_STREAM_WORKERS = 4;
 
-static const GLfloat Vertex[4][2][2] =
+    // Don't let a lost context stall the video forever.
+    const GLuint64 STREAM_TIMEOUT_NS = 100000000;
+
+    /*! \brief Copy of mappings with only the index-th stream left.
+     */
+    LiveVideoStreamCompositor::VideoStreamMappings singleStreamMapping(
+            const LiveVideoStreamCompositor::VideoStreamMappings& mappings, int index)
+    {
+        auto single = mappings;
+        int i = 0;
+        for (auto it = single.begin(); it != single.end(); )
+        {
+            if (i++ != index)
+                it = single.erase(it);
+            else
+                ++it;
+        }
+        return single;
+    }
+
+    /*! \brief Keep the compositor to the frame in the bottom-left corner of a pooled FBO, which is
+     *  rounded up to a size class: the viewport bounds its draws, the scissor its blits.
+     *  Undo with glDisable(GL_SCISSOR_TEST).
+     */
+    void limitToFrame(QOpenGLFunctions* f, const QSize& frameSize)
+    {
+        f->glViewport(0, 0, frameSize.width(), frameSize.height());
+        f->glScissor(0, 0, frameSize.width(), frameSize.height());
+        f->glEnable(GL_SCISSOR_TEST);
+    }
+}
+
+/*! \brief Renders the mapping of one video stream into its own FBO on its own context.
+ *
+ *  Driven by RenderingThread: post() a job, wait for the shared semaphore, then composite
+ *  framebuffer() after waiting on takeReadyFence(). The FBO is not touched again until the
+ *  next post(), which carries the fence of the composite that read it.
+ */
+class StreamRenderWorker : public QThread
 {
-    { { -1.0f, -1.0f },{ 0.0f, 0.0f } },
-    { { 1.0f, -1.0f },{ 1.0f, 0.0f } },
-    { { 1.0f, 1.0f },{ 1.0f, 1.0f } },
-    { { -1.0f, 1.0f },{ 0.0f, 1.0f } },
+public:
+    StreamRenderWorker(QOpenGLContext* shareContext, QSemaphore* done, int index)
+        : m_surface(new QOffscreenSurface)
+        , m_done(done)
+    {
+        m_context = QSharedPointer<QOpenGLContext>::create();
+        m_context->setShareContext(shareContext);
+        m_context->setFormat(shareContext->format());
+        m_context->create();
+        m_context->moveToThread(this);
+
+        m_surface->setFormat(m_context->format());
+        m_surface->create();
+        m_surface->moveToThread(this);
+
+        setObjectName(QString("VideoStreamWorker%1").arg(index));
+    }
+
+    void stop()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_exiting = true;
+        m_jobReady.wakeAll();
+    }
+
+    /*! \brief Render mapping into the worker FBO, sized like the frame.
+     *  \param released Fence after the last composite that read the FBO, may be null. Taken over.
+     */
+    void post(QSharedPointer<LiveVideoStreamCompositor> compositor,
+              const LiveVideoStreamCompositor::VideoStreamMappings& mapping,
+              const QSize& size, GLsync released)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_compositor = compositor;
+        m_mapping = mapping;
+        m_size = size;
+        m_released = released;
+        m_hasJob = true;
+        m_jobReady.wakeAll();
+    }
+
+    // Results of the last job, valid after the done semaphore was acquired for it.
+
+    QOpenGLFramebufferObject* framebuffer() const { return m_fbo.data(); }
+
+    GLsync takeReadyFence()
+    {
+        GLsync ready = m_ready;
+        m_ready = nullptr;
+        return ready;
+    }
+
+    /*! \brief Time from the start of the job until the GPU finished the stream.
+     */
+    qint64 elapsedNs() const { return m_elapsedNs; }
+
+protected:
+    void run()
+    {
+        m_context->makeCurrent(m_surface.data());
+
+        while (1)
+        {
+            {
+                QMutexLocker locker(&m_mutex);
+                while (!m_exiting && !m_hasJob)
+                {
+                    m_jobReady.wait(&m_mutex);
+                }
+
+                if (m_exiting)
+                    break;
+
+                m_hasJob = false;
+            }
+
+            renderJob();
+            m_done->release();
+        }
+
+        auto f = m_context->extraFunctions();
+        if (m_ready) f->glDeleteSync(m_ready);
+        if (m_released) f->glDeleteSync(m_released);
+        m_pool.release(m_fbo);
+        m_fbo.reset();
+        m_pool.clear();
+        m_compositor.reset();
+
+        m_context->doneCurrent();
+    }
+
+private:
+    void renderJob()
+    {
+        PROFILE_SCOPE("StreamRenderWorker::render");
+
+        const qint64 start = FrameProfiler::now();
+        auto f = m_context->extraFunctions();
+
+        if (m_released)
+        {
+            f->glWaitSync(m_released, 0, GL_TIMEOUT_IGNORED);
+            f->glDeleteSync(m_released);
+            m_released = nullptr;
+        }
+
+        if (!m_fbo || m_fboSize != m_size)
+        {
+            QOpenGLFramebufferObjectFormat framebufferFormat;
+            framebufferFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+
+            m_pool.release(m_fbo);
+            m_fbo = m_pool.acquire(m_size, framebufferFormat);
+            m_fboSize = m_size;
+        }
+
+        limitToFrame(f, m_size);
+        m_compositor->blitFramebuffer(m_fbo.data(), m_mapping);
+        f->glDisable(GL_SCISSOR_TEST);
+
+        if (m_ready)
+        {
+            f->glDeleteSync(m_ready);
+        }
+        m_ready = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        // Wait here so the timing covers the GPU work of this stream, not just its submission.
+        f->glClientWaitSync(m_ready, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_TIMEOUT_NS);
+
+        m_elapsedNs = FrameProfiler::now() - start;
+    }
+
+private:
+    QSharedPointer<QOpenGLContext> m_context;
+    QSharedPointer<QOffscreenSurface> m_surface;
+    QSemaphore* m_done;
+
+    QMutex m_mutex;
+    QWaitCondition m_jobReady;
+    bool m_exiting = false;
+    bool m_hasJob = false;
+
+    // Job
+    QSharedPointer<LiveVideoStreamCompositor> m_compositor;
+    LiveVideoStreamCompositor::VideoStreamMappings m_mapping;
+    QSize m_size;
+    GLsync m_released = nullptr;
+
+    // Result
+    FramebufferPool m_pool;
+    QSharedPointer<QOpenGLFramebufferObject> m_fbo;
+    QSize m_fboSize;
+    GLsync m_ready = nullptr;
+    qint64 m_elapsedNs = 0;
 };
 
+/*! \brief Renders the compositor output into FBOs on its own context.
+ *
+ *  Three FBOs rotate between the roles "render" (owned by this thread), "ready" (the newest
+ *  finished frame) and "display" (owned by the UI thread). Swapping roles is a single atomic
+ *  exchange, so the UI never waits for a frame in progress and always samples the newest one.
+ *
+ *  The GPU side is ordered with fences: each frame carries a fence the UI context waits on
+ *  before sampling, and the UI leaves a fence behind that this thread waits on before it
+ *  renders into the buffer again.
+ *
+ *  Compositor updates only bump a counter. In LatestWins pacing the thread renders at most once
+ *  per display interval and folds all the updates received meanwhile into that frame.
+ *
+ *  With stream workers, each selected stream is rendered on its own worker context in parallel
+ *  and the results are copied into the frame in a final composite pass.
+ *
+ *  Optionally the ink is painted into the frame after the video, so no separate ink window has
+ *  to be composited over the video and the ink follows zoom and pan.
+ */
 class RenderingThread : public QThread
 {
 public:
-    RenderingThread(VideoWidget* widget)
+    /*! \brief Call on the UI thread with the widget's context current.
+     *  \param streamWorkers Number of worker contexts for parallel stream rendering, 0 renders serially.
+     */
+    RenderingThread(VideoWidget* widget, int streamWorkers)
         : m_surface(new QOffscreenSurface)
         , m_widget(widget)
         , m_framebufferSize(widget->width(), widget->height())
@@ -30,6 +259,94 @@ public:
         m_surface->moveToThread(this);
 
         connect(widget, &VideoWidget::geometryChanged, this, &RenderingThread::updateFrameBuffer);
+
+        // Pace to the screen the widget is shown on.
+        QScreen* screen = QGuiApplication::primaryScreen();
+        if (auto window = widget->window()->windowHandle())
+        {
+            screen = window->screen();
+        }
+        if (screen && screen->refreshRate() > 0)
+        {
+            m_frameIntervalNs = static_cast<qint64>(1e9 / screen->refreshRate());
+        }
+
+        // Surfaces have to be created on the UI thread, so the workers are created here.
+        for (int i = 0; i < streamWorkers; i++)
+        {
+            m_streamWorkers.push_back(QSharedPointer<StreamRenderWorker>::create(m_widget->context(),
+                                                                               &m_streamWorkersDone, i));
+        }
+
+        setObjectName("VideoRenderingThread");
+    }
+
+    /*! \brief Texture of a finished frame and the part of it covered by the frame.
+     */
+    struct Frame
+    {
+        GLuint texture = 0;
+        QRectF source;
+    };
+
+    FramebufferPool::Stats framebufferPoolStats() const
+    {
+        return m_framebufferPool.stats();
+    }
+
+    QVector<VideoStreamTiming> streamTimings() const
+    {
+        QMutexLocker locker(&m_streamTimingsMutex);
+        return m_streamTimings;
+    }
+
+    /*! \brief Ink to draw over the video.
+     *  \param tiles Committed strokes, see InkTileCache::tiles().
+     *  \param transform Maps ink canvas coordinates to widget coordinates with OpenGL Y-up.
+     */
+    void setInk(bool enabled, const QVector<InkTile>& tiles, const InkStrokeGeometry& current,
+                const QTransform& transform)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_ink.enabled = enabled;
+            m_ink.tiles = tiles;
+            m_ink.current = current;
+            m_ink.transform = transform;
+        }
+
+        update();
+    }
+
+    /*! \brief Extend the stroke being drawn by a point, leaving the rest of the ink as it is.
+     */
+    void appendInkPoint(const QColor& color, const QPoint& point, int width)
+    {
+        {
+            QMutexLocker locker(&m_mutex);
+            if (!m_ink.enabled) return;
+
+            m_ink.current.color = color;
+            m_ink.current.points.push_back(qMakePair(point, width));
+        }
+
+        update();
+    }
+
+    void setPacing(VideoFramePacing pacing)
+    {
+        m_pacing = pacing;
+    }
+
+    VideoFramePacingStats pacingStats() const
+    {
+        VideoFramePacingStats stats;
+        stats.updates = m_pacingStats.updates;
+        stats.coalesced = m_pacingStats.coalesced;
+        stats.produced = m_pacingStats.produced;
+        stats.presented = m_pacingStats.presented;
+        stats.dropped = m_pacingStats.dropped;
+        return stats;
     }
     
     void initialize()
@@ -39,68 +356,229 @@ public:
 
     void stop()
     {
-        m_mutex.lock();
         m_exiting = true;
-        m_mutex.unlock();
+
+        QMutexLocker locker(&m_mutex);
+        m_waitForFrameReady.wakeAll();
     }
 
-    void lock()
+    void renderFrame()
     {
-        m_mutex.lock();
+        PROFILE_SCOPE("RenderingThread::renderFrame");
+
+        auto compositor = m_widget->getCompositor();
+        auto renderMapping = m_widget->getRenderMapping();
+        if (compositor && !renderMapping.empty())
+        {
+            Buffer& buffer = m_buffers[m_renderIndex];
+            const QRect destination = renderMapping.begin()->destination;
+
+            QSize framebufferSize;
+            InkOverlay ink;
+            {
+                QMutexLocker locker(&m_mutex);
+                framebufferSize = m_framebufferSize;
+                ink = m_ink;
+            }
+
+            waitForRelease(buffer);
+
+            // Buffers are resized lazily, only while this thread owns them. The pool hands out
+            // FBOs by size class, so most resize steps get the same FBO back.
+            if (!buffer.fbo || buffer.size != framebufferSize)
+            {
+                QOpenGLFramebufferObjectFormat framebufferFormat;
+                framebufferFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+
+                m_framebufferPool.release(buffer.fbo);
+                buffer.fbo = m_framebufferPool.acquire(framebufferSize, framebufferFormat);
+                buffer.texture = buffer.fbo->texture();
+                buffer.size = framebufferSize;
+                buffer.destination = QRect();
+            }
+
+            if (buffer.destination != destination || ink.enabled)
+            {
+                // Reused FBOs keep their old content, don't let it show around the new destination.
+                // Ink may be drawn outside the video, so it needs a clear every frame.
+                buffer.fbo->bind();
+                auto f = m_context->functions();
+                f->glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+                f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+                buffer.fbo->release();
+
+                buffer.destination = destination;
+            }
+
+            if (m_streamWorkers.size() > 1 && renderMapping.count() > 1)
+            {
+                renderStreams(buffer, compositor, renderMapping, framebufferSize);
+            }
+            else
+            {
+                auto f = m_context->functions();
+                limitToFrame(f, framebufferSize);
+                compositor->blitFramebuffer(buffer.fbo.data(), renderMapping);
+                f->glDisable(GL_SCISSOR_TEST);
+            }
+
+            if (ink.enabled)
+            {
+                drawInk(buffer, ink);
+            }
+
+            // Submit before publishing, the UI context waits on the fence next.
+            auto f = m_context->extraFunctions();
+            if (buffer.ready)
+            {
+                // Never waited on by the UI, the frame was superseded.
+                f->glDeleteSync(buffer.ready);
+            }
+            buffer.ready = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            f->glFlush();
+
+            publishFrame();
+            m_pacingStats.produced++;
+        }
     }
 
-    void unlock()
+    /*! \brief paintGL is running, the next finished frame needs a new update(). UI thread only.
+     */
+    void beginPaint()
     {
-        m_mutex.unlock();
+        m_updatePosted = false;
     }
 
-    void renderFrame()
+    /*! \brief Take the newest finished frame, or keep the one on display. UI thread only.
+     *  Queues a GPU wait for the frame's fence in the current context, the CPU doesn't block.
+     *  \return Texture to draw, 0 if no frame has been rendered yet.
+     */
+    Frame acquireFrame()
     {
-        auto compositor = m_widget->getCompositor();
-        auto renderMapping = m_widget->getRenderMapping();
-        if (compositor && !renderMapping.empty())
+        if (m_readyState.load(std::memory_order_relaxed) & FRESH_FRAME)
         {
-            if (!m_renderFbo || m_destination != renderMapping.begin()->destination)
+            int previous = m_readyState.exchange(m_displayIndex, std::memory_order_acq_rel);
+            m_displayIndex = previous & BUFFER_INDEX_MASK;
+            m_pacingStats.presented++;
+        }
+
+        Buffer& buffer = m_buffers[m_displayIndex];
+        if (buffer.ready)
+        {
+            auto f = QOpenGLContext::currentContext()->extraFunctions();
+
+            // A fence still pending here means the UI would have sampled an unfinished frame.
+            GLint status = GL_SIGNALED;
+            f->glGetSynciv(buffer.ready, GL_SYNC_STATUS, 1, nullptr, &status);
+            if (status != GL_SIGNALED)
             {
-                updateFrameBuffer();
-                m_destination = renderMapping.begin()->destination;
+                m_stats.uiPendingFences++;
             }
-            compositor->blitFramebuffer(m_renderFbo.data(), renderMapping);
-            m_textureId = m_renderFbo->texture();
+
+            f->glWaitSync(buffer.ready, 0, GL_TIMEOUT_IGNORED);
+            f->glDeleteSync(buffer.ready);
+            buffer.ready = nullptr;
+
+            m_stats.uiFenceWaits++;
         }
+
+        Frame frame;
+        frame.texture = buffer.texture;
+        if (buffer.fbo)
+        {
+            // The frame fills the bottom-left corner of the pooled FBO.
+            frame.source = QRectF(0, 0,
+                                  static_cast<qreal>(buffer.size.width()) / buffer.fbo->width(),
+                                  static_cast<qreal>(buffer.size.height()) / buffer.fbo->height());
+        }
+        return frame;
     }
 
-    GLuint framebufferTexture()
+    /*! \brief Mark the texture from acquireFrame() as drawn. UI thread only.
+     */
+    void releaseFrame()
     {
-        return m_textureId;
+        Buffer& buffer = m_buffers[m_displayIndex];
+        if (!buffer.texture)
+            return;
+
+        auto f = QOpenGLContext::currentContext()->extraFunctions();
+        if (buffer.released)
+        {
+            // Drawn again without being handed back, the newer fence covers both draws.
+            f->glDeleteSync(buffer.released);
+        }
+        buffer.released = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        f->glFlush();
     }
 
+    VideoFrameSyncStats stats() const
+    {
+        VideoFrameSyncStats stats;
+        stats.uiFenceWaits = m_stats.uiFenceWaits;
+        stats.uiPendingFences = m_stats.uiPendingFences;
+        stats.renderFenceWaits = m_stats.renderFenceWaits;
+        stats.renderFenceWaitNs = m_stats.renderFenceWaitNs;
+        stats.renderFenceMaxWaitNs = m_stats.renderFenceMaxWaitNs;
+        return stats;
+    }
+
+    /*! \brief Request a frame. Requests made while a frame renders are never lost.
+     */
     void update()
     {
+        m_pendingFrames++;
+        m_pacingStats.updates++;
+
+        QMutexLocker locker(&m_mutex);
         m_waitForFrameReady.wakeAll();
     }
 
 protected:
     void run()
     {
+        for (auto worker : m_streamWorkers)
+        {
+            worker->start();
+        }
+
+        // Make the OpenGL context current on offscreen surface.
+        m_context->makeCurrent(m_surface.data());
+
         while (1)
         {
+            //wait the frame ready signal to update frame buffer.
+            {
+                QMutexLocker locker(&m_mutex);
+                while (!m_exiting && m_pendingFrames.load() == 0)
+                {
+                    m_waitForFrameReady.wait(&m_mutex);
+                }
+            }
+
+            if (m_pacing == VideoFramePacing::LatestWins)
+            {
+                waitForFrameInterval();
+            }
+
             // Stops the thread if exit flag is set.
             if (m_exiting)
                 break;
 
-            //wait the frame ready signal to update frame buffer.
+            if (m_pacing == VideoFramePacing::LatestWins)
+            {
+                // All the requests so far are served by this frame.
+                int served = m_pendingFrames.exchange(0);
+                m_pacingStats.coalesced += qMax(0, served - 1);
+            }
+            else
             {
-                QMutex frameReadymutex;
-                QMutexLocker frameReadyLocker(&frameReadymutex);
-                m_waitForFrameReady.wait(&frameReadymutex);
+                m_pendingFrames--;
             }
 
-            // Lock the rendering mutex.
-            QMutexLocker lock(&m_mutex);
+            m_lastFrameStart = FrameProfiler::now();
 
-            // Make the OpenGL context current on offscreen surface.
-            m_context->makeCurrent(m_surface.data());
+            PROFILE_SCOPE("RenderingThread::frame");
 
             // Initialize if not done.
             if (!m_initialized)
@@ -111,23 +589,261 @@ protected:
             // Render the frame
             renderFrame();
 
-            // Release OpenGL context
-            m_context->doneCurrent();
+            // Notify UI about new frame. One queued update covers every frame until paintGL runs.
+            if (!m_updatePosted.exchange(true))
+            {
+                QMetaObject::invokeMethod(m_widget, "update", Qt::QueuedConnection);
+            }
+        }
 
-            // Notify UI about new frame.
-            QMetaObject::invokeMethod(m_widget, "update");
+        // The FBOs belong to this context, release them while it is current.
+        auto f = m_context->extraFunctions();
+        for (auto& buffer : m_buffers)
+        {
+            if (buffer.ready) f->glDeleteSync(buffer.ready);
+            if (buffer.released) f->glDeleteSync(buffer.released);
+            m_framebufferPool.release(buffer.fbo);
+            buffer = Buffer();
+        }
+        m_framebufferPool.clear();
+
+        for (auto& fence : m_streamReleased)
+        {
+            if (fence) f->glDeleteSync(fence);
+        }
+        m_streamReleased.clear();
+
+        // Release OpenGL context
+        m_context->doneCurrent();
+
+        for (auto worker : m_streamWorkers)
+        {
+            worker->stop();
+            worker->wait();
         }
     }
 
 private slots:
     void updateFrameBuffer()
     {
-        QOpenGLFramebufferObjectFormat framebufferFormat;
-        framebufferFormat.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
-
+        QMutexLocker locker(&m_mutex);
         m_framebufferSize = QSize(m_widget->width(), m_widget->height());
-        m_renderFbo = QSharedPointer<QOpenGLFramebufferObject>::create(
-            m_framebufferSize, framebufferFormat);
+    }
+
+private:
+    struct Buffer
+    {
+        QSharedPointer<QOpenGLFramebufferObject> fbo;
+        GLuint texture = 0;
+        // Size of the frame, the pooled FBO may be larger.
+        QSize size;
+        QRect destination;
+        // Signaled when the frame is rendered. Set by this thread, consumed by the UI.
+        GLsync ready = nullptr;
+        // Signaled when the UI has drawn the texture. Set by the UI, consumed by this thread.
+        GLsync released = nullptr;
+    };
+
+    struct PacingStats
+    {
+        std::atomic<quint64> updates { 0 };
+        std::atomic<quint64> coalesced { 0 };
+        std::atomic<quint64> produced { 0 };
+        std::atomic<quint64> presented { 0 };
+        std::atomic<quint64> dropped { 0 };
+    };
+
+    // Fence counters, written by one thread each and read for diagnostics.
+    struct Stats
+    {
+        std::atomic<quint64> uiFenceWaits { 0 };
+        std::atomic<quint64> uiPendingFences { 0 };
+        std::atomic<quint64> renderFenceWaits { 0 };
+        std::atomic<qint64> renderFenceWaitNs { 0 };
+        std::atomic<qint64> renderFenceMaxWaitNs { 0 };
+    };
+
+    // Wait until the UI has stopped sampling the buffer before rendering into it.
+    void waitForRelease(Buffer& buffer)
+    {
+        if (!buffer.released)
+            return;
+
+        PROFILE_SCOPE("RenderingThread::waitForRelease");
+
+        auto f = m_context->extraFunctions();
+        const qint64 start = FrameProfiler::now();
+        f->glClientWaitSync(buffer.released, GL_SYNC_FLUSH_COMMANDS_BIT, RELEASE_TIMEOUT_NS);
+        const qint64 waited = FrameProfiler::now() - start;
+        f->glDeleteSync(buffer.released);
+        buffer.released = nullptr;
+
+        m_stats.renderFenceWaits++;
+        m_stats.renderFenceWaitNs += waited;
+        if (waited > m_stats.renderFenceMaxWaitNs)
+        {
+            m_stats.renderFenceMaxWaitNs = waited;
+        }
+    }
+
+    static const int BUFFER_COUNT = 3;
+    static const int BUFFER_INDEX_MASK = 0x3;
+    // Set in m_readyState when the ready buffer hasn't been displayed yet.
+    static const int FRESH_FRAME = 0x4;
+    // Don't let a lost UI context stall the video forever.
+    static const GLuint64 RELEASE_TIMEOUT_NS = 100000000;
+
+    // Swap the finished render buffer with the ready one.
+    void publishFrame()
+    {
+        int previous = m_readyState.exchange(m_renderIndex | FRESH_FRAME, std::memory_order_acq_rel);
+        m_renderIndex = previous & BUFFER_INDEX_MASK;
+
+        if (previous & FRESH_FRAME)
+        {
+            // The UI never took the previous frame.
+            m_pacingStats.dropped++;
+        }
+    }
+
+    struct InkOverlay
+    {
+        bool enabled = false;
+        QVector<InkTile> tiles;
+        InkStrokeGeometry current;
+        QTransform transform;
+    };
+
+    // Paint the ink into the frame with QPainter on this thread's context.
+    void drawInk(Buffer& buffer, const InkOverlay& ink)
+    {
+        PROFILE_SCOPE("RenderingThread::drawInk");
+
+        buffer.fbo->bind();
+
+        {
+            QOpenGLPaintDevice device(buffer.fbo->size());
+            QPainter painter(&device);
+            painter.setRenderHint(QPainter::Antialiasing);
+            painter.setRenderHint(QPainter::SmoothPixmapTransform);
+
+            // The paint device is Y-down from the top of the FBO, the frame sits in its bottom-left corner.
+            painter.setTransform(ink.transform * QTransform(1, 0, 0, -1, 0, buffer.fbo->height()));
+
+            for (const auto& tile : ink.tiles)
+            {
+                painter.drawImage(tile.rect, tile.image, tile.source);
+            }
+            drawStrokeGeometry(painter, ink.current);
+        }
+
+        // Leave the state the compositor expects.
+        auto f = m_context->functions();
+        f->glDisable(GL_SCISSOR_TEST);
+        f->glDisable(GL_STENCIL_TEST);
+        f->glDisable(GL_BLEND);
+
+        buffer.fbo->release();
+    }
+
+    // Render every stream on a worker, then copy the streams into the frame.
+    void renderStreams(Buffer& buffer, const QSharedPointer<LiveVideoStreamCompositor>& compositor,
+                       const LiveVideoStreamCompositor::VideoStreamMappings& renderMapping,
+                       const QSize& framebufferSize)
+    {
+        PROFILE_SCOPE("RenderingThread::renderStreams");
+
+        auto f = m_context->extraFunctions();
+        const int streamCount = renderMapping.count();
+        const int workerCount = m_streamWorkers.size();
+        m_streamReleased.resize(workerCount);
+
+        QVector<VideoStreamTiming> timings(streamCount);
+
+        // More streams than workers are rendered in rounds.
+        for (int first = 0; first < streamCount; first += workerCount)
+        {
+            const int jobs = qMin(workerCount, streamCount - first);
+
+            QVector<QRect> destinations(jobs);
+            for (int i = 0; i < jobs; i++)
+            {
+                auto mapping = singleStreamMapping(renderMapping, first + i);
+                destinations[i] = mapping.begin()->destination;
+
+                m_streamWorkers[i]->post(compositor, mapping, framebufferSize, m_streamReleased[i]);
+                m_streamReleased[i] = nullptr;
+            }
+
+            m_streamWorkersDone.acquire(jobs);
+
+            PROFILE_SCOPE("RenderingThread::compositeStreams");
+
+            for (int i = 0; i < jobs; i++)
+            {
+                auto worker = m_streamWorkers[i];
+
+                GLsync ready = worker->takeReadyFence();
+                if (ready)
+                {
+                    f->glWaitSync(ready, 0, GL_TIMEOUT_IGNORED);
+                    f->glDeleteSync(ready);
+                }
+
+                // Both FBOs hold the frame in their bottom-left corner, so the destination is the same rect in both.
+                QOpenGLFramebufferObject::blitFramebuffer(buffer.fbo.data(), destinations[i],
+                                                          worker->framebuffer(), destinations[i],
+                                                          GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+                timings[first + i].destination = destinations[i];
+                timings[first + i].lastNs = worker->elapsedNs();
+            }
+
+            // The workers wait on these before they render into their FBOs again.
+            for (int i = 0; i < jobs; i++)
+            {
+                m_streamReleased[i] = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            f->glFlush();
+        }
+
+        updateStreamTimings(timings);
+    }
+
+    void updateStreamTimings(const QVector<VideoStreamTiming>& frame)
+    {
+        QMutexLocker locker(&m_streamTimingsMutex);
+
+        if (m_streamTimings.size() != frame.size())
+        {
+            // Stream selection changed, start over.
+            m_streamTimings = QVector<VideoStreamTiming>(frame.size());
+        }
+
+        for (int i = 0; i < frame.size(); i++)
+        {
+            auto& timing = m_streamTimings[i];
+            timing.destination = frame[i].destination;
+            timing.frames++;
+            timing.lastNs = frame[i].lastNs;
+            timing.totalNs += frame[i].lastNs;
+            timing.maxNs = qMax(timing.maxNs, frame[i].lastNs);
+        }
+    }
+
+    // Sleep until one display interval has passed since the last frame started.
+    void waitForFrameInterval()
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_exiting)
+        {
+            qint64 remainingNs = m_lastFrameStart + m_frameIntervalNs - FrameProfiler::now();
+            if (remainingNs <= 0)
+                break;
+
+            // Updates arriving meanwhile wake us early, they are picked up by this frame.
+            m_waitForFrameReady.wait(&m_mutex, static_cast<unsigned long>(qMax<qint64>(1, remainingNs / 1000000)));
+        }
     }
 
 private:
@@ -137,25 +853,47 @@ private:
     QSharedPointer<QOffscreenSurface> m_surface;
     // OpengL widget
     VideoWidget* m_widget;
+
+    // Guards m_framebufferSize, m_ink and the frame ready wait, never held while rendering.
+    QMutex m_mutex;
+    QWaitCondition m_waitForFrameReady;
     // Size of frame buffer
     QSize m_framebufferSize;
+    InkOverlay m_ink;
 
-    // Rendering mutex
-    QMutex m_mutex;
+    // Frames requested since the render thread last woke up.
+    std::atomic<int> m_pendingFrames { 0 };
     // True if the application is exiting
-    bool m_exiting = false;
+    std::atomic<bool> m_exiting { false };
     // True if the OpenGL is initialized
     bool m_initialized = false;
 
-    // Framebuffer texture ID for the UI thread.
-    GLuint m_textureId = 0;
-
-    // Framebuffer for thread to render the live stream.
-    QSharedPointer<QOpenGLFramebufferObject> m_renderFbo;
-
-    QRect m_destination;
-
-    QWaitCondition m_waitForFrameReady;
+    Buffer m_buffers[BUFFER_COUNT];
+    FramebufferPool m_framebufferPool;
+
+    // Parallel stream rendering, empty when rendering serially.
+    QVector<QSharedPointer<StreamRenderWorker>> m_streamWorkers;
+    QSemaphore m_streamWorkersDone;
+    // Per worker fence of the last composite that read its FBO.
+    QVector<GLsync> m_streamReleased;
+    mutable QMutex m_streamTimingsMutex;
+    QVector<VideoStreamTiming> m_streamTimings;
+    // Buffer index owned by the render thread.
+    int m_renderIndex = 0;
+    // Index of the newest finished buffer, with FRESH_FRAME until the UI takes it.
+    std::atomic<int> m_readyState { 1 };
+    // Buffer index owned by the UI thread.
+    int m_displayIndex = 2;
+
+    Stats m_stats;
+
+    std::atomic<VideoFramePacing> m_pacing { VideoFramePacing::LatestWins };
+    // Display refresh interval, 60 Hz unless the screen reports otherwise.
+    qint64 m_frameIntervalNs = 16666667;
+    qint64 m_lastFrameStart = 0;
+    // An update() is queued to the widget and paintGL hasn't run since.
+    std::atomic<bool> m_updatePosted { false };
+    PacingStats m_pacingStats;
 };
 
 
@@ -171,7 +909,14 @@ VideoWidget::VideoWidget(QWidget* parent)
     : QOpenGLWidget(parent)
     , m_lastScaleFactor(0)
     , m_startZoomFactor(1)
-    , m_viewportManipulationEnabled(true) {
+    , m_viewportManipulationEnabled(true)
+    , m_framePacing(VideoFramePacing::LatestWins)
+    , m_parallelStreamRendering(false)
+    , m_inkCompositing(false)
+    , m_readback(new PixelReadback(this))
+    , m_zoomPending(false)
+    , m_pendingZoom(1)
+    , m_mappedStreamCount(-1) {
     setAutoFillBackground(false);
     setAttribute(Qt::WA_NoSystemBackground, true);
 
@@ -188,6 +933,14 @@ VideoWidget::VideoWidget(QWidget* parent)
     m_touchSensitivity = settings->value("touch_sensitivity", 250).toReal();
     m_touchTreshold = settings->value("touch_treshold", 5).toReal();
     m_zoomRange = QPointF(settings->value("zoom_range_min", 1).toReal(), settings->value("zoom_range_max", 10).toReal());
+
+    // Apply the accumulated gesture input once per display refresh.
+    qreal refreshRate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60;
+    m_gestureTimer.setSingleShot(true);
+    m_gestureTimer.setTimerType(Qt::PreciseTimer);
+    m_gestureTimer.setInterval(qMax(1, qRound(1000.0 / (refreshRate > 0 ? refreshRate : 60))));
+    connect(&m_gestureTimer, &QTimer::timeout, this, &VideoWidget::applyPendingZoomAndPan);
+    connect(&m_inkTiles, &InkTileCache::tilesChanged, this, &VideoWidget::pushInk);
 }
 
 void VideoWidget::resizeGL(int width, int height) {
@@ -210,6 +963,10 @@ void VideoWidget::paintGL() {
     if (!m_renderingThread)
         return;
 
+    PROFILE_SCOPE("VideoWidget::paintGL");
+
+    m_renderingThread->beginPaint();
+
     if (m_model) {
         if (m_renderMapping.count() != m_model->selectedVideoStreamSources().count()) {
             updateZoomAndPan();
@@ -218,25 +975,18 @@ void VideoWidget::paintGL() {
         if (m_renderMapping.empty())
             return;
 
-        m_renderingThread->lock();
-
         auto f = QOpenGLContext::currentContext()->functions();
 
         f->glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         f->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        GLuint textureId = m_renderingThread->framebufferTexture();
+        auto frame = m_renderingThread->acquireFrame();
+        if (!frame.texture)
+            return;
 
-        f->glBindTexture(GL_TEXTURE_2D, textureId);
-        glBegin(GL_QUADS);
-        for (int i = 0; i < 4; ++i)
-        {
-            glTexCoord2f(Vertex[i][1][0], Vertex[i][1][1]);
-            glVertex2f(Vertex[i][0][0], Vertex[i][0][1]);
-        }
-        glEnd();
+        m_blit.draw(frame.texture, QMatrix4x4(), frame.source);
 
-        m_renderingThread->unlock();
+        m_renderingThread->releaseFrame();
     }
 }
 
@@ -254,6 +1004,7 @@ void VideoWidget::setModel(QSharedPointer<LiveCaptureModel> model,
     m_model = model;
     m_compositor = compositor;
     m_viewportManipulationEnabled = viewportManipulationEnabled;
+    m_mappedStreamCount = -1;
 
     updateTransform();
 
@@ -273,6 +1024,9 @@ void VideoWidget::onVideoStreamStateChanged() {
     }
     m_connections.clear();
 
+    // Other sources may be selected in the same number, the mapping has to be redone regardless.
+    m_mappedStreamCount = -1;
+
     updateZoomAndPan();
 }
 
@@ -283,9 +1037,11 @@ void VideoWidget::updateTransform() {
 
             if (m_viewportManipulationEnabled && frameSize.isValid()) {
                 const auto zoomAndPan = m_videoStreamZoomAndPan[firstStream];
-                m_transform = calculateTransform(zoomAndPan.pan, zoomAndPan.zoom);
-                const auto inverse = m_transform.inverted();
-                auto absoluteViewport = inverse.mapRect(rect());
+                const auto transform = calculateTransform(zoomAndPan.pan, zoomAndPan.zoom);
+                if (!updateMappingInputs(transform, frameSize, QRectF()))
+                    return;
+
+                auto absoluteViewport = m_inverseTransform.mapRect(rect());
 
                 // Invert Y-axis
                 absoluteViewport = QRect(absoluteViewport.x(),
@@ -303,7 +1059,9 @@ void VideoWidget::updateTransform() {
             } else {
                 // Update viewport to make sure it includes only video frame
                 auto viewport = m_model->viewport();
-                m_transform = Utilities::transformFromViewport(&viewport, frameSize, rect());
+                const auto transform = Utilities::transformFromViewport(&viewport, frameSize, rect());
+                if (!updateMappingInputs(transform, frameSize, viewport))
+                    return;
 
                 QRectF videoFrameRectangle(viewport.left() * frameSize.width(),
                                            viewport.top() * frameSize.height(),
@@ -323,6 +1081,136 @@ void VideoWidget::updateTransform() {
     }
 }
 
+bool VideoWidget::updateMappingInputs(const QTransform& transform, const QSize& frameSize, const QRectF& viewport) {
+    const int streamCount = m_model->selectedVideoStreamSources().count();
+
+    if (streamCount == m_mappedStreamCount && transform == m_transform && frameSize == m_mappedFrameSize &&
+            rect() == m_mappedRect && viewport == m_mappedViewport) {
+        return false;
+    }
+
+    m_transform = transform;
+    m_inverseTransform = transform.inverted();
+    m_mappedFrameSize = frameSize;
+    m_mappedRect = rect();
+    m_mappedViewport = viewport;
+    m_mappedStreamCount = streamCount;
+
+    // Keep the ink pinned to the video.
+    pushInk();
+
+    return true;
+}
+
+void VideoWidget::setInkData(QSharedPointer<InkData> inkData) {
+    if (m_inkData) {
+        disconnect(m_inkData.data(), nullptr, this, nullptr);
+    }
+    disconnect(m_inkCurrentStrokeConnection);
+
+    m_inkData = inkData;
+
+    // The tiles follow the stroke changes themselves and ask for a push when they change.
+    m_inkTiles.setInkData(inkData);
+
+    if (m_inkData) {
+        connect(m_inkData.data(), &InkData::strokeAdded, this, &VideoWidget::onInkStrokeAdded);
+        connect(m_inkData.data(), &InkData::cleared, this, &VideoWidget::syncInk);
+        connect(m_inkData.data(), &InkData::strokesReset, this, &VideoWidget::syncInk);
+        connect(m_inkData.data(), &InkData::canvasSizeChanged, this, &VideoWidget::pushInk);
+    }
+
+    syncInk();
+}
+
+QFuture<QImage> VideoWidget::captureFrame() {
+    return m_readback->capture();
+}
+
+#ifdef HAVE_FFMPEG
+void VideoWidget::setVideoRecorder(VideoRecorder* recorder) {
+    disconnect(m_recorderConnection);
+    m_recorder = recorder;
+
+    if (m_recorder) {
+        m_recorderConnection = connect(this, &QOpenGLWidget::frameSwapped, this, [this]() {
+            if (m_recorder && m_recorder->isRecording()) {
+                m_recorder->record(captureFrame(), FrameProfiler::now());
+            }
+        });
+    }
+}
+#endif
+
+void VideoWidget::setInkCompositing(bool enabled) {
+    m_inkCompositing = enabled;
+    pushInk();
+}
+
+void VideoWidget::syncInk() {
+    m_inkCurrentStroke = InkStrokeGeometry();
+    disconnect(m_inkCurrentStrokeConnection);
+
+    if (m_inkData) {
+        watchCurrentInkStroke(m_inkData->currentStroke());
+    }
+
+    pushInk();
+}
+
+void VideoWidget::onInkStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke) {
+    Q_UNUSED(addedStroke)
+
+    watchCurrentInkStroke(newStroke);
+    pushInk();
+}
+
+void VideoWidget::watchCurrentInkStroke(QSharedPointer<InkStroke> stroke) {
+    disconnect(m_inkCurrentStrokeConnection);
+
+    m_inkCurrentStroke = InkStrokeGeometry::fromStroke(*stroke);
+
+    InkStroke* current = stroke.data();
+    m_inkCurrentStrokeConnection = connect(current, &InkStroke::pointAdded, this,
+                                           [this, current](const QPoint& point, double width) {
+        // Only the new point goes to the render thread, the tiles and the rest of the stroke stay.
+        // Copying the stroke's points would make its next addPoint() copy them all again.
+        const int pointWidth = static_cast<int>(width);
+        m_inkCurrentStroke.color = current->color();
+        m_inkCurrentStroke.points.push_back(qMakePair(point, pointWidth));
+
+        if (m_renderingThread) {
+            m_renderingThread->appendInkPoint(m_inkCurrentStroke.color, point, pointWidth);
+        }
+    });
+}
+
+void VideoWidget::pushInk() {
+    if (!m_renderingThread)
+        return;
+
+    if (!m_inkCompositing || !m_inkData || m_inkData->canvasSize().isEmpty() || !m_compositor ||
+        !m_compositor->frameSize().isValid()) {
+        m_renderingThread->setInk(false, QVector<InkTile>(), InkStrokeGeometry(), QTransform());
+        return;
+    }
+
+    // Ink canvas (Y-down) -> video frame (Y-up, like m_transform expects) -> widget.
+    const auto frameSize = m_compositor->frameSize();
+    const auto canvasSize = m_inkData->canvasSize();
+    QTransform canvasToFrame = QTransform::fromScale(static_cast<qreal>(frameSize.width()) / canvasSize.width(),
+                                                     static_cast<qreal>(frameSize.height()) / canvasSize.height());
+    canvasToFrame *= QTransform(1, 0, 0, -1, 0, frameSize.height());
+    const QTransform canvasToWidget = canvasToFrame * m_transform;
+
+    // Only the tiles in view, at the resolution they are shown at.
+    const qreal scale = std::sqrt(std::abs(canvasToWidget.determinant()));
+    const QRectF visible = canvasToWidget.inverted().mapRect(QRectF(rect())) &
+                           QRectF(QPointF(0, 0), QSizeF(canvasSize));
+
+    m_renderingThread->setInk(true, m_inkTiles.tiles(visible, scale), m_inkCurrentStroke, canvasToWidget);
+}
+
 QTransform VideoWidget::calculateTransform(const QPointF& pan, qreal zoom) {
     QTransform transform;
 
@@ -366,38 +1254,74 @@ void VideoWidget::wheelEvent(QWheelEvent* event) {
 bool VideoWidget::zoomTo(QPointF relativePosition, qreal delta) {
     bool result = false;
 
-    if (auto firstStream = m_model->fullscreenVideoStreamModel()) {
-        const auto zoomAndPan = m_videoStreamZoomAndPan[firstStream];
-        auto newZoom = zoomAndPan.zoom + delta;
+    if (m_model->fullscreenVideoStreamModel()) {
+        const auto zoom = effectiveZoom();
+        auto newZoom = zoom + delta;
 
         // Limit the zoom by configured boundaries
         newZoom = qBound(m_zoomRange.x(), newZoom, m_zoomRange.y());
-        const auto updatedDelta = zoomAndPan.zoom - newZoom;
+        const auto updatedDelta = zoom - newZoom;
 
         // Stop moving viewport if we are near maximum/minimum zoom level
         if (qAbs(updatedDelta) > std::numeric_limits<qreal>::epsilon()) {
             // Invert screen y-coordinate because OpenGL is in inverted Y
             relativePosition.setY(height() - relativePosition.y());
 
-            // Calculate where in target image current cursor position points to
-            auto absolutePosition = m_transform.inverted().map(relativePosition);
+            // Applied with the other input of this frame in applyPendingZoomAndPan()
+            m_zoomPending = true;
+            m_pendingZoom = newZoom;
+            m_pendingZoomAnchor = relativePosition;
 
-            // Calculate new transformation
-            auto newTransform = calculateTransform(zoomAndPan.pan, newZoom);
+            if (!m_gestureTimer.isActive()) {
+                m_gestureTimer.start();
+            }
+
+            result = true;
+        }
+    }
 
-            // And now calculate image position back to viewer coordinate system with updated transformation
-            auto newRelativePosition = newTransform.map(absolutePosition);
+    return result;
+}
 
-            // Since we want to maintain same position under the cursor we calculate the difference and shift
-            auto shift = relativePosition - newRelativePosition;
+qreal VideoWidget::effectiveZoom() {
+    if (m_zoomPending) {
+        return m_pendingZoom;
+    }
 
-            updateZoomAndPan(newZoom, zoomAndPan.pan + shift);
+    if (auto firstStream = m_model->fullscreenVideoStreamModel()) {
+        return m_videoStreamZoomAndPan[firstStream].zoom;
+    }
 
-            result = true;
+    return 1;
+}
+
+void VideoWidget::applyPendingZoomAndPan() {
+    PROFILE_SCOPE("VideoWidget::applyPendingZoomAndPan");
+
+    if (auto firstStream = m_model->fullscreenVideoStreamModel()) {
+        const auto zoomAndPan = m_videoStreamZoomAndPan[firstStream];
+        auto zoom = zoomAndPan.zoom;
+        auto pan = zoomAndPan.pan + m_pendingPan;
+
+        if (m_zoomPending) {
+            // Calculate where in target image the zoom anchor points to
+            const auto inverse = m_pendingPan.isNull() ? m_inverseTransform
+                                                       : calculateTransform(pan, zoom).inverted();
+            auto absolutePosition = inverse.map(m_pendingZoomAnchor);
+
+            // Calculate new transformation
+            auto newTransform = calculateTransform(pan, m_pendingZoom);
+
+            // Since we want to maintain same position under the anchor we calculate the difference and shift
+            pan += m_pendingZoomAnchor - newTransform.map(absolutePosition);
+            zoom = m_pendingZoom;
         }
+
+        updateZoomAndPan(zoom, pan);
     }
 
-    return result;
+    m_zoomPending = false;
+    m_pendingPan = QPointF();
 }
 
 void VideoWidget::updateZoomAndPan(qreal zoom, QPointF pan) {
@@ -450,12 +1374,16 @@ void VideoWidget::updateZoomAndPan(qreal zoom, QPointF pan) {
 }
 
 void VideoWidget::moveCenter(QPointF offset) {
-    if (auto firstStream = m_model->fullscreenVideoStreamModel()) {
-        const auto zoomAndPan = m_videoStreamZoomAndPan[firstStream];
-
+    if (m_model->fullscreenVideoStreamModel()) {
         // Invert Y
         offset.ry() *= -1;
-        updateZoomAndPan(zoomAndPan.zoom, zoomAndPan.pan + offset);
+
+        // Applied with the other input of this frame in applyPendingZoomAndPan()
+        m_pendingPan += offset;
+
+        if (!m_gestureTimer.isActive()) {
+            m_gestureTimer.start();
+        }
     }
 }
 
@@ -549,9 +1477,8 @@ bool VideoWidget::gestureEvent(QGestureEvent *event) {
 void VideoWidget::pinchTriggered(QPinchGesture *gesture) {
     // track gesture state for workaround because pan gesture is not sent when pinch is not active
     if (gesture->state() == Qt::GestureStarted) {
-        if (auto firstStream = m_model->fullscreenVideoStreamModel()) {
-            const auto zoomAndPan = m_videoStreamZoomAndPan[firstStream];
-            m_startZoomFactor = zoomAndPan.zoom;
+        if (m_model->fullscreenVideoStreamModel()) {
+            m_startZoomFactor = effectiveZoom();
         }
 
         m_lastScaleFactor = gesture->totalScaleFactor();
@@ -585,7 +1512,11 @@ void VideoWidget::startThread()
         stopThread();
 
     makeCurrent();
-    m_renderingThread = QSharedPointer<RenderingThread>::create(this);
+    const int streamWorkers = m_parallelStreamRendering
+            ? qBound(2, QThread::idealThreadCount() - 1, MAX_STREAM_WORKERS) : 0;
+    m_renderingThread = QSharedPointer<RenderingThread>::create(this, streamWorkers);
+    m_renderingThread->setPacing(m_framePacing);
+    pushInk();
 
     m_renderingThread->initialize();
 
@@ -606,11 +1537,60 @@ void VideoWidget::stopThread()
 
 void VideoWidget::initializeGL()
 {
-    glEnable(GL_TEXTURE_2D);
+    m_blit.create();
     startThread();
 }
 
 VideoWidget::~VideoWidget()
 {
     stopThread();
+
+    makeCurrent();
+    m_readback->releaseResources();
+    m_blit.destroy();
+    doneCurrent();
+}
+
+VideoFrameSyncStats VideoWidget::frameSyncStats() const
+{
+    return m_renderingThread ? m_renderingThread->stats() : VideoFrameSyncStats();
+}
+
+void VideoWidget::setFramePacing(VideoFramePacing pacing)
+{
+    m_framePacing = pacing;
+
+    if (m_renderingThread)
+    {
+        m_renderingThread->setPacing(pacing);
+    }
+}
+
+VideoFramePacingStats VideoWidget::framePacingStats() const
+{
+    return m_renderingThread ? m_renderingThread->pacingStats() : VideoFramePacingStats();
+}
+
+void VideoWidget::setParallelStreamRendering(bool enabled)
+{
+    if (m_parallelStreamRendering == enabled)
+        return;
+
+    m_parallelStreamRendering = enabled;
+
+    // The workers are created with the thread.
+    if (m_renderingThread)
+    {
+        startThread();
+    }
+}
+
+QVector<VideoStreamTiming> VideoWidget::streamTimings() const
+{
+    return m_renderingThread ? m_renderingThread->streamTimings() : QVector<VideoStreamTiming>();
+}
+
+FramebufferPool::Stats VideoWidget::framebufferPoolStats() const
+{
+    return m_renderingThread ? m_renderingThread->framebufferPoolStats() : FramebufferPool::Stats();
 }
@@ -7,16 +7,82 @@
 #include <QSharedPointer>
 #include <QGestureEvent>
 #include <QOpenGLFramebufferObject>
+#include <QPointer>
+#include <QTimer>
 #include <QTransform>
 
 #include <video_source/videopipeline.h>
 
 #include "model/live_capture_model.h"
 #include "components/live_video_stream_compositor.h"
+#include "blit_program.h"
+#include "framebuffer_pool.h"
+#include "ink_geometry.h"
+#include "ink_tile_cache.h"
+#include "pixel_readback.h"
 
+class InkData;
+class InkStroke;
 class QAbstractVideoSurface;
 class VideoWidgetSurface;
+#ifdef HAVE_FFMPEG
+class VideoRecorder;
+#endif
 class RenderingThread;
+
+/*! \brief GL fence counters of the frame handoff between the render thread and the UI.
+ */
+struct VideoFrameSyncStats
+{
+    // Frames the UI context queued a fence wait for.
+    quint64 uiFenceWaits = 0;
+    // Of those, frames whose rendering was still running on the GPU.
+    quint64 uiPendingFences = 0;
+    // Times the render thread waited for the UI to finish drawing a buffer.
+    quint64 renderFenceWaits = 0;
+    qint64 renderFenceWaitNs = 0;
+    qint64 renderFenceMaxWaitNs = 0;
+};
+
+/*! \brief How the render thread turns compositor updates into frames.
+ */
+enum class VideoFramePacing
+{
+    // Render at most once per display refresh, from the newest compositor state.
+    LatestWins,
+    // Render once per compositor update, even when the display can't show them all.
+    EveryFrame
+};
+
+/*! \brief Frame counters of the video render thread.
+ */
+struct VideoFramePacingStats
+{
+    // Compositor updates received.
+    quint64 updates = 0;
+    // Updates folded into a frame rendered for a later update.
+    quint64 coalesced = 0;
+    // Frames rendered by the render thread.
+    quint64 produced = 0;
+    // Frames picked up by paintGL.
+    quint64 presented = 0;
+    // Frames replaced by a newer one before paintGL picked them up.
+    quint64 dropped = 0;
+};
+
+/*! \brief Render time of one stream with parallel stream rendering.
+ */
+struct VideoStreamTiming
+{
+    // Where the stream is drawn in the frame.
+    QRect destination;
+    quint64 frames = 0;
+    // Time until the GPU finished the stream, of the last frame, the slowest frame and all frames.
+    qint64 lastNs = 0;
+    qint64 maxNs = 0;
+    qint64 totalNs = 0;
+};
+
 class VideoWidget : public QOpenGLWidget
 {
     Q_OBJECT
@@ -28,6 +94,51 @@ public:
     QSharedPointer<LiveVideoStreamCompositor> getCompositor() { return m_compositor; }
     LiveVideoStreamCompositor::VideoStreamMappings getRenderMapping() { return m_renderMapping; }
 
+    VideoFrameSyncStats frameSyncStats() const;
+
+    void setFramePacing(VideoFramePacing pacing);
+    VideoFramePacing framePacing() const { return m_framePacing; }
+    VideoFramePacingStats framePacingStats() const;
+
+    /*! \brief Allocations and memory of the render thread's FBOs.
+     */
+    FramebufferPool::Stats framebufferPoolStats() const;
+
+    /*! \brief Render each selected stream on its own worker context, then composite them.
+     *  Requires the compositor to accept concurrent blitFramebuffer() calls for different streams.
+     */
+    void setParallelStreamRendering(bool enabled);
+    bool parallelStreamRendering() const { return m_parallelStreamRendering; }
+
+    /*! \brief Per stream render times, in the order of the render mapping. Parallel rendering only.
+     */
+    QVector<VideoStreamTiming> streamTimings() const;
+
+    /*! \brief Ink drawn over the video when ink compositing is enabled.
+     */
+    void setInkData(QSharedPointer<InkData> inkData);
+
+    /*! \brief Draw the ink into the video frames on the render thread, mapped through the
+     *  zoom/pan transform. Replaces a separate translucent ink window over the video.
+     */
+    void setInkCompositing(bool enabled);
+    bool inkCompositing() const { return m_inkCompositing; }
+
+    /*! \brief The committed ink is composited from these tiles, rendered in the background.
+     */
+    InkTileCache* inkTileCache() { return &m_inkTiles; }
+
+    /*! \brief Capture the frame as shown (video, and ink when composited) without stalling the GPU.
+     *  The image arrives a frame or two later through the future.
+     */
+    QFuture<QImage> captureFrame();
+
+#ifdef HAVE_FFMPEG
+    /*! \brief Capture every presented frame into the recorder while it is recording. Null stops.
+     */
+    void setVideoRecorder(VideoRecorder* recorder);
+#endif
+
 public slots:
     void setModel(QSharedPointer<LiveCaptureModel> model,
                   QSharedPointer<LiveVideoStreamCompositor> compositor,
@@ -37,6 +148,10 @@ private slots:
     void onVideoStreamStateChanged();
     void onCompositorUpdated();
     void updateTransform();
+    void applyPendingZoomAndPan();
+    void syncInk();
+    void onInkStrokeAdded(QSharedPointer<InkStroke> addedStroke, QSharedPointer<InkStroke> newStroke);
+    void pushInk();
 
 signals:
     void viewportManipulationEnabledChanged(bool viewportManipulationEnabled);
@@ -69,12 +184,42 @@ private:
     void moveCenter(QPointF offset);
     bool zoomTo(QPointF relativePosition, qreal zoomLevel);
 
+    /*! \brief Zoom of the first stream including the zoom not applied yet.
+     */
+    qreal effectiveZoom();
+
+    /*! \brief Remember the inputs of the render mapping.
+     *  \return False when they are the same as last time and the mapping is still valid.
+     */
+    bool updateMappingInputs(const QTransform& transform, const QSize& frameSize, const QRectF& viewport);
+
+    void watchCurrentInkStroke(QSharedPointer<InkStroke> stroke);
+
     /*! \brief This is needed to track gesture and mouse to work around the problem of Pan Gesture
                events are not raised when PinchGesture is not active.
      */
     bool m_pinchGestureActive;
 
     QTransform m_transform;
+    // m_transform.inverted(), updated together with m_transform.
+    QTransform m_inverseTransform;
+
+    /*! \brief Wheel, mouse and pinch input is accumulated here and applied once per frame
+               by m_gestureTimer, so fast gestures don't recompute the mapping per event.
+     */
+    QTimer m_gestureTimer;
+    bool m_zoomPending;
+    qreal m_pendingZoom;
+    // Widget position (OpenGL Y) that stays in place while zooming.
+    QPointF m_pendingZoomAnchor;
+    QPointF m_pendingPan;
+
+    // Inputs of the current m_renderMapping.
+    QSize m_mappedFrameSize;
+    QRect m_mappedRect;
+    QRectF m_mappedViewport;
+    // Reset when the stream state changes, since the sources may change without their count.
+    int m_mappedStreamCount;
 
     QPointF m_clickedPos;
 
@@ -100,6 +245,26 @@ private:
 
     QSharedPointer<RenderingThread> m_renderingThread;
 
+    // Draws the rendering thread's frame.
+    BlitProgram m_blit;
+
+    VideoFramePacing m_framePacing;
+    bool m_parallelStreamRendering;
+
+    // Ink composited by the render thread: tiles of the committed strokes of m_inkData and a
+    // mirror of the stroke being drawn.
+    QSharedPointer<InkData> m_inkData;
+    bool m_inkCompositing;
+    InkTileCache m_inkTiles;
+    InkStrokeGeometry m_inkCurrentStroke;
+    QMetaObject::Connection m_inkCurrentStrokeConnection;
+
+    PixelReadback* m_readback;
+#ifdef HAVE_FFMPEG
+    QPointer<VideoRecorder> m_recorder;
+    QMetaObject::Connection m_recorderConnection;
+#endif
+
     void startThread();
     void stopThread();
 };
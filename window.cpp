@@ -19,6 +19,11 @@ Window::~Window()
     delete ui;
 }
 
+InkLayerGLWidget* Window::inkLayer() const
+{
+    return ui->inkGLWidget;
+}
+
 void Window::keyPressEvent(QKeyEvent *e)
 {
     if (e->key() == Qt::Key_Escape)
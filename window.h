@@ -10,6 +10,8 @@ namespace Ui {
 class Window;
 }
 
+class InkLayerGLWidget;
+
 class Window : public QWidget
 {
     Q_OBJECT
@@ -18,6 +20,8 @@ public:
     explicit Window(QWidget *parent = 0);
     ~Window();
 
+    InkLayerGLWidget* inkLayer() const;
+
 protected:
     void keyPressEvent(QKeyEvent *event);
 